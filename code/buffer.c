@@ -1,6 +1,8 @@
 #include "buffer.h"
 #include "lvl5_stretchy_buffer.h"
 #include "parser.c"
+#include "regex.c"
+#include "dependency.c"
 
 inline i32 get_gap_count(Buffer *b) {
   i32 result = b->capacity - b->count;
@@ -28,6 +30,54 @@ char get_buffer_char(Buffer *b, i32 pos) {
   return result;
 }
 
+// NOTE(lvl5): the codepoint starting at pos and how many bytes it takes
+u32 get_buffer_codepoint(Buffer *b, i32 pos, i32 *length) {
+  u32 result = (u8)get_buffer_char(b, pos);
+  *length = 1;
+  
+  if (b->is_utf8 && result >= 0x80) {
+    char bytes[4];
+    i32 count = min(utf8_sequence_length((char)result), b->count - 1 - pos);
+    for (i32 i = 0; i < count; i++) {
+      bytes[i] = get_buffer_char(b, pos + i);
+    }
+    result = utf8_decode(bytes, count, length);
+  }
+  return result;
+}
+
+i32 buffer_next_codepoint(Buffer *b, i32 pos) {
+  i32 length = 1;
+  get_buffer_codepoint(b, pos, &length);
+  i32 result = min(pos + length, b->count - 1);
+  return result;
+}
+
+i32 buffer_prev_codepoint(Buffer *b, i32 pos) {
+  i32 result = max(pos - 1, 0);
+  if (b->is_utf8) {
+    // walk back to the lead byte, at most 3 continuation bytes,
+    // but only if its sequence really ends at pos
+    i32 start = result;
+    while (start > 0 && pos - start < 4 && utf8_is_continuation(get_buffer_char(b, start))) {
+      start--;
+    }
+    i32 length = 1;
+    get_buffer_codepoint(b, start, &length);
+    if (start + length == pos) {
+      result = start;
+    }
+  }
+  return result;
+}
+
+i8 buffer_get_advance(Font *font, Buffer *b, i32 pos, i32 *length) {
+  u32 codepoint = get_buffer_codepoint(b, pos, length);
+  u32 next = (u8)get_buffer_char(b, min(pos + *length, b->count - 1));
+  i8 result = font_get_codepoint_advance(font, codepoint, next);
+  return result;
+}
+
 V2 get_buffer_xy(Buffer *b, i32 pos) {
   V2 result = v2_zero();
   
@@ -48,16 +98,17 @@ V2 get_screen_position_in_buffer(Font *font, Buffer *b, i32 pos) {
   begin_profiler_function();
   V2 result = v2(0, -(f32)font->line_spacing);
   
-  for (i32 char_index = 0; char_index < pos; char_index++) {
+  i32 length = 1;
+  for (i32 char_index = 0; char_index < pos; char_index += length) {
     char first = get_buffer_char(b, char_index);
-    char second = get_buffer_char(b, char_index+1);
+    length = 1;
     if (first == '\n') {
       result.x = 0;
       result.y -= font->line_spacing;
       continue;
     }
     
-    result.x += font_get_advance(font, first, second);
+    result.x += buffer_get_advance(font, b, char_index, &length);
   }
   
   end_profiler_function();
@@ -130,7 +181,7 @@ void buffer_parse(Buffer *buffer) {
   push_arena_context(&buffer->cache.arena); {
     buffer->cache.scope = add_scope(null, 1024);
     buffer->cache.dependencies = sb_new(String, 16);
-    buffer->cache.colors = sb_new(Syntax, buffer->count);
+    buffer->cache.comments = sb_new(Color_Span, 64);
     
     u32 average_token_size = 3;
     u32 token_count_guess = buffer->count / average_token_size;
@@ -147,105 +198,743 @@ void buffer_parse(Buffer *buffer) {
     
     buffer_tokenize(parser);
     parse_program(parser);
-    
-    buffer->cache.locked = false;
   }
   pop_context();
   
   end_profiler_function();
 }
 
-String resolve_include_path(String include) {
-  String result = include;
+i32 find_first_token_ending_after(Token *tokens, i32 count, i32 pos) {
+  i32 low = 0;
+  i32 high = count;
+  while (low < high) {
+    i32 mid = low + (high - low)/2;
+    if (tokens[mid].end <= pos) {
+      low = mid + 1;
+    } else {
+      high = mid;
+    }
+  }
+  return low;
+}
+
+i32 find_first_span_ending_after(Color_Span *spans, i32 count, i32 pos) {
+  i32 low = 0;
+  i32 high = count;
+  while (low < high) {
+    i32 mid = low + (high - low)/2;
+    if (spans[mid].end <= pos) {
+      low = mid + 1;
+    } else {
+      high = mid;
+    }
+  }
+  return low;
+}
+
+Color_Iterator buffer_colors_begin(Buffer *buffer, i32 pos) {
+  Color_Iterator result = {0};
+  
+  if (buffer->cache.tokens) {
+    result.tokens = buffer->cache.tokens;
+    result.token_count = sb_count(buffer->cache.tokens);
+    result.token_index = find_first_token_ending_after(result.tokens,
+                                                       result.token_count, pos);
+  }
+  if (buffer->cache.comments) {
+    result.comments = buffer->cache.comments;
+    result.comment_count = sb_count(buffer->cache.comments);
+    result.comment_index = find_first_span_ending_after(result.comments,
+                                                        result.comment_count, pos);
+  }
+  
+  return result;
+}
+
+Syntax color_iterator_get(Color_Iterator *it, i32 pos) {
+  Syntax result = Syntax_DEFAULT;
+  
+  while (it->token_index < it->token_count &&
+         it->tokens[it->token_index].end <= pos) {
+    it->token_index++;
+  }
+  while (it->comment_index < it->comment_count &&
+         it->comments[it->comment_index].end <= pos) {
+    it->comment_index++;
+  }
+  
+  if (it->token_index < it->token_count &&
+      it->tokens[it->token_index].start <= pos) {
+    result = it->tokens[it->token_index].color;
+  } else if (it->comment_index < it->comment_count &&
+             it->comments[it->comment_index].start <= pos) {
+    result = it->comments[it->comment_index].color;
+  }
+  
   return result;
 }
 
-Buffer **buffer_get_dependent_buffers(Buffer *buffer) {
+#define FIND_SLICE_SIZE megabytes(32)
+
+void find_all_in_memory(char *data, i32 start, i32 end, String needle,
+                        Find_Match **matches)
+{
+  i32 pos = start;
+  while (pos < end) {
+    i64 found = find_literal(data + pos, end - pos, needle);
+    if (found < 0) break;
+    i32 match_start = pos + (i32)found;
+    Find_Match match = {match_start, match_start + (i32)needle.count};
+    sb_push(*matches, match);
+    pos = match_start + 1;
+  }
+}
+
+// NOTE(lvl5): pushes every match that starts in [start, end), in order.
+// the two halves of the gap buffer are searched in place,
+// only the few chars around the gap get copied
+void buffer_find_literal_in_range(Buffer *buffer, String needle, i32 start, i32 end,
+                                  Find_Match **matches)
+{
   begin_profiler_function();
-  push_scratch_context();
-  Buffer **dependents = sb_new(Buffer **, 16);
-  
-  for (u32 buffer_index = 0;
-       buffer_index < sb_count(buffer->editor->buffers);
-       buffer_index++) 
-  {
-    Buffer *other = buffer->editor->buffers + buffer_index;
-    for (u32 dep_index = 0; 
-         dep_index < sb_count(other->cache.dependencies);
-         dep_index++) 
-    {
-      // TODO(lvl5): need to search in the file system like the preprocessor does
-      String include = other->cache.dependencies[dep_index];
-      if (string_compare(include, buffer->path)) {
-        sb_push(dependents, other);
-        break;
+  
+  i32 needle_count = (i32)needle.count;
+  i32 text_count = buffer->count - 1; // last char is 0
+  i32 gap_start = get_gap_start(buffer);
+  i32 gap_count = get_gap_count(buffer);
+  i32 search_end = min(end + needle_count - 1, text_count);
+  
+  if (needle_count > 0 && start < search_end) {
+    i32 first_end = min(search_end, gap_start);
+    if (start < first_end) {
+      find_all_in_memory(buffer->data, start, first_end, needle, matches);
+    }
+    
+    // matches that straddle the gap
+    if (needle_count > 1 && start < gap_start && search_end > gap_start) {
+      i32 left = max(start, gap_start - (needle_count - 1));
+      i32 right = min(search_end, gap_start + needle_count - 1);
+      
+      Mem_Size mark = scratch_get_mark();
+      char *joined = scratch_push_array(char, right - left);
+      for (i32 i = left; i < right; i++) {
+        joined[i - left] = get_buffer_char(buffer, i);
+      }
+      
+      Find_Match *straddling = null;
+      push_scratch_context();
+      straddling = sb_new(Find_Match, 8);
+      find_all_in_memory(joined, 0, right - left, needle, &straddling);
+      pop_context();
+      
+      for (u32 i = 0; i < sb_count(straddling); i++) {
+        Find_Match match = {
+          left + straddling[i].start,
+          left + straddling[i].end,
+        };
+        if (match.start < gap_start && match.end > gap_start) {
+          sb_push(*matches, match);
+        }
+      }
+      scratch_set_mark(mark);
+    }
+    
+    i32 second_start = max(start, gap_start);
+    if (second_start < search_end) {
+      // logical positions after the gap are offset by gap_count in memory
+      char *second = buffer->data + gap_count;
+      find_all_in_memory(second, second_start, search_end, needle, matches);
+    }
+  }
+  
+  end_profiler_function();
+}
+
+Regex_Input buffer_regex_input(Buffer *buffer) {
+  i32 gap_start = get_gap_start(buffer);
+  Regex_Input result = {
+    .first = buffer->data,
+    .first_count = gap_start,
+    .second = buffer->data + get_gap_count(buffer),
+    .count = buffer->count - 1, // last char is 0
+  };
+  return result;
+}
+
+// NOTE(lvl5): pushes the matches that start in [start, end) and returns where the
+// next range should start. regex matches don't overlap and can run past end
+i32 buffer_find_in_range(Buffer *buffer, i32 start, i32 end, Find_Match **matches) {
+  Buffer_Find *find = &buffer->find;
+  i32 result = end;
+  
+  if (find->is_regex) {
+    if (find->regex.valid) {
+      begin_profiler_function();
+      Regex_Input input = buffer_regex_input(buffer);
+      
+      i32 pos = start;
+      while (pos < end) {
+        i32 match_end = 0;
+        i32 match_start = regex_find(&find->regex, &input, pos, end, &match_end);
+        if (match_start < 0) break;
+        
+        Find_Match match = {match_start, match_end};
+        sb_push(*matches, match);
+        pos = match_end;
       }
+      result = max(pos, end);
+      end_profiler_function();
     }
+  } else {
+    buffer_find_literal_in_range(buffer, find->query, start, end, matches);
+  }
+  return result;
+}
+
+// NOTE(lvl5): forgets all matches, they get found again by buffer_find_step
+void buffer_find_reset(Buffer *buffer) {
+  Buffer_Find *find = &buffer->find;
+  if (find->head) {
+    sb_count(find->head) = 0;
+    sb_count(find->tail) = 0;
+  }
+  find->split = min(max(find->split, 0), max(buffer->count - 1, 0));
+  find->head_scan_pos = 0;
+  find->tail_scan_pos = find->split;
+}
+
+// NOTE(lvl5): the visible range is searched right away,
+// the rest of the buffer by buffer_find_step
+void buffer_find_set_query(Buffer *buffer, String query, bool is_regex,
+                           i32 visible_start, i32 visible_end)
+{
+  begin_profiler_function();
+  Buffer_Find *find = &buffer->find;
+  
+  push_system_context();
+  if (!find->head) {
+    find->head = sb_new(Find_Match, 64);
+    find->tail = sb_new(Find_Match, 64);
+  }
+  if (find->query.data) {
+    free_memory(find->query.data);
   }
+  find->query = alloc_string(query.data, query.count);
   
+  regex_free(&find->regex);
+  find->is_regex = is_regex;
+  if (is_regex && query.count) {
+    find->regex = regex_compile(find->query);
+  }
   pop_context();
   
+  find->split = visible_start;
+  buffer_find_reset(buffer);
+  
+  i32 text_count = buffer->count - 1;
+  i32 end = min(max(visible_end, find->split), text_count);
+  if (find->query.count) {
+    find->tail_scan_pos = buffer_find_in_range(buffer, find->split, end, &find->tail);
+  }
+  
   end_profiler_function();
-  return dependents;
 }
 
-void buffer_update_cache(Buffer *buffer) {
-  buffer_parse(buffer);
-  buffer->cache.generation = buffer->editor->generation;
+// NOTE(lvl5): searches the next slice, call once a frame. returns true when done
+bool buffer_find_step(Buffer *buffer) {
+  begin_profiler_function();
+  Buffer_Find *find = &buffer->find;
+  i32 text_count = buffer->count - 1;
+  
+  bool done = true;
+  if (find->query.count) {
+    if (find->tail_scan_pos < text_count) {
+      i32 end = (i32)min((i64)find->tail_scan_pos + FIND_SLICE_SIZE, (i64)text_count);
+      find->tail_scan_pos = buffer_find_in_range(buffer, find->tail_scan_pos, end,
+                                                 &find->tail);
+    } else if (find->head_scan_pos < find->split) {
+      i32 end = (i32)min((i64)find->head_scan_pos + FIND_SLICE_SIZE, (i64)find->split);
+      find->head_scan_pos = buffer_find_in_range(buffer, find->head_scan_pos, end,
+                                                 &find->head);
+    }
+    done = find->tail_scan_pos >= text_count && find->head_scan_pos >= find->split;
+  }
+  
+  end_profiler_function();
+  return done;
+}
+
+i32 buffer_find_match_count(Buffer *buffer) {
+  Buffer_Find *find = &buffer->find;
+  i32 result = 0;
+  if (find->head) {
+    result = sb_count(find->head) + sb_count(find->tail);
+  }
+  return result;
+}
+
+Find_Match buffer_find_get_match(Buffer_Find *find, i32 index) {
+  i32 head_count = sb_count(find->head);
+  Find_Match result = index < head_count
+    ? find->head[index]
+    : find->tail[index - head_count];
+  return result;
+}
+
+// NOTE(lvl5): start of the first match after pos, wrapping around. -1 if there are none
+i32 buffer_find_next(Buffer *buffer, i32 pos) {
+  Buffer_Find *find = &buffer->find;
+  i32 count = buffer_find_match_count(buffer);
+  
+  i32 low = 0;
+  i32 high = count;
+  while (low < high) {
+    i32 mid = low + (high - low)/2;
+    if (buffer_find_get_match(find, mid).start <= pos) {
+      low = mid + 1;
+    } else {
+      high = mid;
+    }
+  }
+  
+  i32 result = -1;
+  if (count) {
+    result = buffer_find_get_match(find, low < count ? low : 0).start;
+  }
+  return result;
+}
+
+// NOTE(lvl5): starts at the first match that ends after pos.
+// positions passed to find_iterator_in_match must never go backwards
+Find_Iterator buffer_find_begin(Buffer *buffer, i32 pos) {
+  Find_Iterator result = {
+    .find = &buffer->find,
+    .index = 0,
+    .count = buffer->find.query.count ? buffer_find_match_count(buffer) : 0,
+  };
   
-  Buffer **dependents = buffer_get_dependent_buffers(buffer);
-  for (u32 i = 0; i < sb_count(dependents); i++) {
-    Buffer *dep = dependents[i];
+  i32 high = result.count;
+  while (result.index < high) {
+    i32 mid = result.index + (high - result.index)/2;
+    if (buffer_find_get_match(result.find, mid).end <= pos) {
+      result.index = mid + 1;
+    } else {
+      high = mid;
+    }
+  }
+  return result;
+}
+
+bool find_iterator_in_match(Find_Iterator *it, i32 pos) {
+  while (it->index < it->count &&
+         buffer_find_get_match(it->find, it->index).end <= pos) {
+    it->index++;
+  }
+  
+  bool result = it->index < it->count &&
+    buffer_find_get_match(it->find, it->index).start <= pos;
+  return result;
+}
+
+// NOTE(lvl5): whether a match overlaps [start, end). like find_iterator_in_match,
+// start must never go backwards
+bool find_iterator_any_in_range(Find_Iterator *it, i32 start, i32 end) {
+  while (it->index < it->count &&
+         buffer_find_get_match(it->find, it->index).end <= start) {
+    it->index++;
+  }
+  
+  bool result = it->index < it->count &&
+    buffer_find_get_match(it->find, it->index).start < end;
+  return result;
+}
+
+typedef struct {
+  i32 codepoints;
+  i32 last_checkpoint;
+  // no checkpoint goes here, the one after the scanned range is already there
+  i32 end;
+} Line_Scan;
+
+// NOTE(lvl5): scans [start, end), which must be on one side of the gap.
+// data[pos] is the char at pos
+void line_index_scan(Line_Index *index, char *data, i32 start, i32 end,
+                     Line_Scan *scan, bool is_utf8)
+{
+  i32 pos = start;
+  while (pos < end) {
+    i32 block_end = min(scan->last_checkpoint + LINE_INDEX_CHUNK_SIZE, end);
+    char *newline = (char *)memchr(data + pos, '\n', block_end - pos);
+    i32 next = newline ? (i32)(newline - data) + 1 : block_end;
+    scan->codepoints += is_utf8 ? utf8_count_codepoints(data + pos, next - pos) : next - pos;
     
-    if (dep->cache.generation != dep->editor->generation) {
-      if (_InterlockedCompareExchange((volatile long *)&dep->cache.locked,
-                                      true,
-                                      false) == false) 
-      {
-        global_os.queue_add(global_os.thread_queue, buffer_update_cache, dep);
+    if (newline) {
+      sb_push(index->line_starts, next);
+    }
+    if (newline || next == scan->last_checkpoint + LINE_INDEX_CHUNK_SIZE) {
+      if (next < scan->end) {
+        Line_Checkpoint checkpoint = { .pos = next, .codepoints = scan->codepoints };
+        sb_push(index->checkpoints, checkpoint);
       }
+      scan->last_checkpoint = next;
     }
+    pos = next;
   }
+}
+
+// NOTE(lvl5): the last checkpoint at or before pos
+i32 line_index_find_checkpoint(Line_Index *index, i32 pos) {
+  Line_Checkpoint *checkpoints = index->checkpoints;
+  i32 low = 0;
+  i32 high = sb_count(checkpoints);
+  while (low + 1 < high) {
+    i32 mid = low + (high - low)/2;
+    if (checkpoints[mid].pos <= pos) {
+      low = mid;
+    } else {
+      high = mid;
+    }
+  }
+  return low;
+}
+
+// NOTE(lvl5): the first line start after pos
+i32 line_index_find_line_after(Line_Index *index, i32 pos) {
+  i32 *starts = index->line_starts;
+  i32 low = 0;
+  i32 high = sb_count(starts);
+  while (low < high) {
+    i32 mid = low + (high - low)/2;
+    if (starts[mid] <= pos) {
+      low = mid + 1;
+    } else {
+      high = mid;
+    }
+  }
+  return low;
+}
+
+// NOTE(lvl5): dirty is whether [start, end) is all that changed since the last
+// update, positions after it moved by the change in length. otherwise everything
+// is rebuilt.
+// the scan starts at the checkpoint before start and runs up to the first old
+// checkpoint after the edit. the entries after that only get shifted
+void buffer_update_line_index(Buffer *buffer, bool dirty, i32 start, i32 end) {
+  begin_profiler_function();
+  Line_Index *index = &buffer->lines;
+  
+  if (!index->line_starts) {
+    push_system_context();
+    index->line_starts = sb_new(i32, 256);
+    index->checkpoints = sb_new(Line_Checkpoint, 256);
+    pop_context();
+    dirty = false;
+  }
+  
+  i32 text_count = buffer->count - 1; // last char is 0
+  i32 delta = text_count - index->text_count;
+  
+  i32 first_checkpoint = 0;
+  i32 tail_checkpoint = sb_count(index->checkpoints);
+  if (dirty) {
+    first_checkpoint = line_index_find_checkpoint(index, start);
+    i32 old_end = end - delta;
+    tail_checkpoint = first_checkpoint + 1;
+    while (tail_checkpoint < (i32)sb_count(index->checkpoints) &&
+           index->checkpoints[tail_checkpoint].pos < old_end) {
+      tail_checkpoint++;
+    }
+  } else {
+    sb_count(index->checkpoints) = 0;
+    sb_count(index->line_starts) = 0;
+    Line_Checkpoint zero = {0};
+    sb_push(index->checkpoints, zero);
+    sb_push(index->line_starts, 0);
+    tail_checkpoint = 1;
+  }
+  
+  Line_Checkpoint resume = index->checkpoints[first_checkpoint];
+  bool has_tail = tail_checkpoint < (i32)sb_count(index->checkpoints);
+  Line_Checkpoint tail = has_tail ? index->checkpoints[tail_checkpoint] : (Line_Checkpoint){0};
+  i32 scan_end = has_tail ? tail.pos + delta : text_count;
   
+  // a line start at resume.pos means a newline before it, which is still there.
+  // the ones up to and including tail.pos get scanned again
+  i32 first_line = line_index_find_line_after(index, resume.pos);
+  i32 tail_line = has_tail
+    ? line_index_find_line_after(index, tail.pos)
+    : (i32)sb_count(index->line_starts);
+  
+  Mem_Size mark = scratch_get_mark();
+  i32 tail_line_count = sb_count(index->line_starts) - tail_line;
+  i32 tail_checkpoint_count = sb_count(index->checkpoints) - tail_checkpoint;
+  i32 *tail_lines = scratch_push_array(i32, tail_line_count);
+  Line_Checkpoint *tail_checkpoints = scratch_push_array(Line_Checkpoint, tail_checkpoint_count);
+  memcpy(tail_lines, index->line_starts + tail_line, sizeof(i32)*tail_line_count);
+  memcpy(tail_checkpoints, index->checkpoints + tail_checkpoint,
+         sizeof(Line_Checkpoint)*tail_checkpoint_count);
+  sb_count(index->line_starts) = first_line;
+  sb_count(index->checkpoints) = first_checkpoint + 1;
+  
+  Line_Scan scan = {
+    .codepoints = resume.codepoints,
+    .last_checkpoint = resume.pos,
+    .end = scan_end,
+  };
+  i32 gap_start = get_gap_start(buffer);
+  i32 first_end = min(gap_start, scan_end);
+  if (resume.pos < first_end) {
+    line_index_scan(index, buffer->data, resume.pos, first_end, &scan, buffer->is_utf8);
+  }
+  i32 second_start = max(resume.pos, gap_start);
+  if (second_start < scan_end) {
+    line_index_scan(index, buffer->data + get_gap_count(buffer), second_start, scan_end,
+                    &scan, buffer->is_utf8);
+  }
+  
+  i32 codepoint_delta = scan.codepoints - tail.codepoints;
+  for (i32 i = 0; i < tail_line_count; i++) {
+    sb_push(index->line_starts, tail_lines[i] + delta);
+  }
+  for (i32 i = 0; i < tail_checkpoint_count; i++) {
+    Line_Checkpoint checkpoint = {
+      .pos = tail_checkpoints[i].pos + delta,
+      .codepoints = tail_checkpoints[i].codepoints + codepoint_delta,
+    };
+    // a removal right at resume.pos moves the tail onto it
+    if (checkpoint.pos > index->checkpoints[sb_count(index->checkpoints) - 1].pos) {
+      sb_push(index->checkpoints, checkpoint);
+    }
+  }
+  scratch_set_mark(mark);
+  
+  index->text_count = text_count;
+  end_profiler_function();
+}
+
+// NOTE(lvl5): the line index is only up to date outside of edit transactions
+i32 buffer_get_line(Buffer *buffer, i32 pos) {
+  assert(!buffer->edit.dirty);
+  i32 *starts = buffer->lines.line_starts;
+  i32 low = 0;
+  i32 high = sb_count(starts);
+  while (low + 1 < high) {
+    i32 mid = low + (high - low)/2;
+    if (starts[mid] <= pos) {
+      low = mid;
+    } else {
+      high = mid;
+    }
+  }
+  return low;
+}
+
+i32 buffer_codepoints_before(Buffer *buffer, i32 pos) {
+  Line_Index *index = &buffer->lines;
+  i32 result = 0;
+  i32 start = 0;
+  if (index->checkpoints && sb_count(index->checkpoints)) {
+    Line_Checkpoint checkpoint = index->checkpoints[line_index_find_checkpoint(index, pos)];
+    result = checkpoint.codepoints;
+    start = checkpoint.pos;
+  }
+  
+  for (i32 i = start; i < pos; i++) {
+    result += !buffer->is_utf8 || !utf8_is_continuation(get_buffer_char(buffer, i));
+  }
+  return result;
+}
+
+// NOTE(lvl5): in codepoints, 0 based
+i32 buffer_get_column(Buffer *buffer, i32 pos) {
+  i32 line_start = buffer->lines.line_starts[buffer_get_line(buffer, pos)];
+  i32 result = buffer_codepoints_before(buffer, pos) -
+    buffer_codepoints_before(buffer, line_start);
+  return result;
+}
+
+// NOTE(lvl5): lines before the edit keep their hashes and the ones after it move
+// along with their text, only the lines in [start, end] are cleared
+void buffer_update_line_hashes(Buffer *buffer, i32 old_line_count, i32 start, i32 end) {
+  Line_Index *index = &buffer->lines;
+  i32 line_count = sb_count(index->line_starts);
+  
+  if (!index->hashes) {
+    push_system_context();
+    index->hashes = sb_new(Line_Hash, 256);
+    pop_context();
+  }
+  
+  i32 first_line = buffer_get_line(buffer, start);
+  i32 end_line = buffer_get_line(buffer, end) + 1;
+  i32 old_end_line = end_line - (line_count - old_line_count);
+  if ((i32)sb_count(index->hashes) != old_line_count || old_end_line < first_line) {
+    first_line = 0;
+    end_line = line_count;
+    old_end_line = 0;
+  }
+  
+  Line_Hash zero = {0};
+  while ((i32)sb_count(index->hashes) < line_count) {
+    sb_push(index->hashes, zero);
+  }
+  
+  Line_Hash *hashes = index->hashes;
+  i32 moved_count = line_count - end_line;
+  if (end_line > old_end_line) {
+    for (i32 i = moved_count - 1; i >= 0; i--) {
+      hashes[end_line + i] = hashes[old_end_line + i];
+    }
+  } else if (end_line < old_end_line) {
+    for (i32 i = 0; i < moved_count; i++) {
+      hashes[end_line + i] = hashes[old_end_line + i];
+    }
+  }
+  for (i32 line = first_line; line < end_line; line++) {
+    hashes[line] = zero;
+  }
+  sb_count(index->hashes) = line_count;
+}
+
+// NOTE(lvl5): the same text hashes the same wherever the gap is
+u64 buffer_hash_text(Buffer *buffer, i32 start, i32 end) {
+  i32 gap_start = get_gap_start(buffer);
+  i32 first_end = min(end, gap_start);
+  i32 second_start = max(start, gap_start);
+  
+  u64 result = HASH_BYTES_64_SEED;
+  if (start < first_end) {
+    result = hash_bytes_64_continue(result, buffer->data + start, first_end - start);
+  }
+  if (second_start < end) {
+    result = hash_bytes_64_continue(result, buffer->data + second_start + get_gap_count(buffer),
+                                    end - second_start);
+  }
+  return result;
+}
+
+// NOTE(lvl5): the token and comment spans over [start, end), relative to start
+u64 buffer_hash_colors(Buffer *buffer, i32 start, i32 end) {
+  Color_Iterator it = buffer_colors_begin(buffer, start);
+  u64 result = HASH_BYTES_64_SEED;
+  
+  for (i32 i = it.token_index; i < it.token_count && it.tokens[i].start < end; i++) {
+    Token *token = it.tokens + i;
+    i32 span[3] = {
+      max(token->start, start) - start,
+      min(token->end, end) - start,
+      token->color,
+    };
+    result = hash_bytes_64_continue(result, span, sizeof(span));
+  }
+  for (i32 i = it.comment_index; i < it.comment_count && it.comments[i].start < end; i++) {
+    Color_Span *comment = it.comments + i;
+    i32 span[3] = {
+      max(comment->start, start) - start,
+      min(comment->end, end) - start,
+      // comments lose to tokens, so they hash differently from the same token span
+      -1 - (i32)comment->color,
+    };
+    result = hash_bytes_64_continue(result, span, sizeof(span));
+  }
+  return result;
+}
+
+// NOTE(lvl5): the cache lock must be held
+void buffer_update_cache(Buffer *buffer) {
+  // the main thread can bump the generation while we parse, that edit needs another pass
+  i32 generation = buffer->editor->generation;
+  buffer_parse(buffer);
+  buffer->cache.generation = generation;
+  
+  dependency_graph_set_includes(&buffer->editor->deps, buffer->node_index,
+                                buffer->cache.dependencies);
 }
 
 // NOTE(lvl5): only call this from the main thread
 void buffer_changed(Buffer *buffer) {
   begin_profiler_function();
   
+  bool dirty = buffer->edit.dirty;
+  i32 old_line_count = buffer->lines.line_starts ? sb_count(buffer->lines.line_starts) : 0;
+  buffer_update_line_index(buffer, dirty, buffer->edit.dirty_start, buffer->edit.dirty_end);
+  buffer->edit.dirty = false;
+  buffer_update_line_hashes(buffer, old_line_count,
+                            dirty ? buffer->edit.dirty_start : 0,
+                            dirty ? buffer->edit.dirty_end : buffer->count - 1);
+  
   if (buffer->editor) {
     buffer->editor->generation++;
-    buffer->cache.locked = true;
+    buffer_cache_lock(buffer);
     buffer_update_cache(buffer);
-    buffer->cache.locked = false;
+    buffer_cache_unlock(buffer);
+    
+    dependency_schedule_dependents(buffer->editor, buffer);
+  }
+  
+  if (buffer->find.query.count) {
+    buffer_find_reset(buffer);
   }
   
   end_profiler_function();
 }
 
+void buffer_edit_begin(Buffer *buffer) {
+  buffer->edit.depth++;
+}
+
+void buffer_edit_end(Buffer *buffer) {
+  assert(buffer->edit.depth > 0);
+  buffer->edit.depth--;
+  if (buffer->edit.depth == 0 && buffer->edit.dirty) {
+    buffer_changed(buffer);
+  }
+}
+
+// NOTE(lvl5): the dirty range is in positions after the edit,
+// so it is kept up to date with every edit that follows
+void buffer_mark_dirty(Buffer *buffer, i32 pos, i32 inserted, i32 removed) {
+  i32 start = buffer->edit.dirty_start;
+  i32 end = buffer->edit.dirty_end;
+  
+  if (!buffer->edit.dirty) {
+    start = pos;
+    end = pos;
+  }
+  
+  if (end > pos + removed) {
+    end -= removed;
+  } else if (end > pos) {
+    end = pos;
+  }
+  if (end > pos) {
+    end += inserted;
+  }
+  
+  buffer->edit.dirty = true;
+  buffer->edit.dirty_start = min(start, pos);
+  buffer->edit.dirty_end = max(end, pos + inserted);
+}
+
 
 #define BUFFER_INCREMENT_SIZE 1024
 
-void buffer_insert_string(Buffer *b, String str) {
+// NOTE(lvl5): makes room for count more chars, so a batch of inserts
+// reallocates at most once
+void buffer_reserve(Buffer *b, i32 count) {
   begin_profiler_function();
+  push_system_context();
   
-  Context *cur = get_context();
-  Context system_ctx = *cur;
-  system_ctx.allocator = system_allocator;
-  push_context(system_ctx);
-  
-  bool not_scratch = get_context()->allocator == system_allocator;
-  assert(not_scratch);
-  if (b->count + (i32)str.count > b->capacity) {
+  if (b->count + count > b->capacity) {
     char *old_data = b->data;
     i32 old_gap_start = get_gap_start(b);
     i32 old_gap_count = get_gap_count(b);
     
-    i32 required_count = b->count + (i32)str.count;
-    if (b->count + (i32)str.count > b->capacity) {
+    i32 required_count = b->count + count;
+    if (b->count + count > b->capacity) {
       b->capacity = ceil_f32_i32((f32)required_count / (f32)BUFFER_INCREMENT_SIZE)*BUFFER_INCREMENT_SIZE;
     }
-    while (b->count + (i32)str.count > b->capacity) {
+    while (b->count + count > b->capacity) {
       b->capacity = b->capacity*2;
     }
     
@@ -256,29 +945,43 @@ void buffer_insert_string(Buffer *b, String str) {
     i32 gap_count = get_gap_count(b);
     
     i32 first_count = min(gap_start, b->count);
-    for (i32 i = 0; i < first_count; i++) {
-      b->data[i] = old_data[i];
-    }
-    
     i32 second_count = b->count - first_count;
-    for (i32 i = 0; i < second_count; i++) {
-      b->data[gap_start+gap_count+i] = old_data[old_gap_start+old_gap_count+i];
+    if (old_data) {
+      memcpy(b->data, old_data, first_count);
+      memcpy(b->data + gap_start + gap_count,
+             old_data + old_gap_start + old_gap_count,
+             second_count);
+      free_memory(old_data);
     }
-    free_memory(old_data);
   }
   
+  pop_context();
+  end_profiler_function();
+}
+
+void buffer_insert_string(Buffer *b, String str) {
+  begin_profiler_function();
   
-  for (i32 i = 0; i < (i32)str.count; i++) {
-    b->data[b->cursor+i] = str.data[i];
-  }
+  Context *cur = get_context();
+  Context system_ctx = *cur;
+  system_ctx.allocator = system_allocator;
+  push_context(system_ctx);
+  
+  bool not_scratch = get_context()->allocator == system_allocator;
+  assert(not_scratch);
+  buffer_reserve(b, (i32)str.count);
+  
+  memcpy(b->data + b->cursor, str.data, str.count);
   
   if (b->mark > b->cursor) {
     b->mark += (i32)str.count;
   }
+  
+  buffer_edit_begin(b);
+  buffer_mark_dirty(b, b->cursor, (i32)str.count, 0);
   b->cursor += (i32)str.count;
   b->count += (i32)str.count;
-  
-  buffer_changed(b);
+  buffer_edit_end(b);
   
   pop_context(system_ctx);
   
@@ -290,6 +993,7 @@ Buffer buffer_make_empty() {
   
   Buffer b = {0};
   b.capacity = 0;
+  b.is_utf8 = true;
   
   buffer_insert_string(&b, const_string("\0"));
   set_cursor(&b, 0);
@@ -299,6 +1003,41 @@ Buffer buffer_make_empty() {
   return b;
 }
 
+// NOTE(lvl5): for buffers that aren't registered with an editor, like the ones
+// text inputs keep. the arrays are all system allocated
+void buffer_free(Buffer *b) {
+  push_system_context();
+  if (b->data) {
+    free_memory(b->data);
+  }
+  if (b->lines.line_starts) {
+    sb_free(b->lines.line_starts);
+    sb_free(b->lines.checkpoints);
+  }
+  if (b->lines.hashes) {
+    sb_free(b->lines.hashes);
+  }
+  if (b->cursors) {
+    sb_free(b->cursors);
+  }
+  
+  Buffer_Find *find = &b->find;
+  if (find->head) {
+    sb_free(find->head);
+    sb_free(find->tail);
+  }
+  if (find->query.data) {
+    free_memory(find->query.data);
+  }
+  regex_free(&find->regex);
+  
+  if (b->cache.arena.data) {
+    free_memory(b->cache.arena.data);
+  }
+  pop_context();
+  zero_memory_slow(b, sizeof(Buffer));
+}
+
 Buffer *editor_add_buffer(Editor *editor, String path) {
   begin_profiler_function();
   
@@ -316,11 +1055,12 @@ Buffer *editor_add_buffer(Editor *editor, String path) {
   Mem_Size arena_size = megabytes(16);
   arena_init(&b.cache.arena, alloc_array(byte, arena_size), arena_size);
   
-  buffer_changed(&b);
-  
   sb_push(editor->buffers, b);
   Buffer *buffer = editor->buffers + sb_count(editor->buffers) - 1;
   
+  dependency_register_buffer(editor, buffer);
+  buffer_changed(buffer);
+  
   
   pop_context(system_ctx);
   end_profiler_function();
@@ -337,7 +1077,9 @@ void buffer_remove_backward(Buffer *b, i32 count) {
     b->cursor -= count;
     b->count -= count;
     
-    buffer_changed(b);
+    buffer_edit_begin(b);
+    buffer_mark_dirty(b, b->cursor, 0, count);
+    buffer_edit_end(b);
   }
   
   end_profiler_function();
@@ -352,7 +1094,151 @@ void buffer_remove_forward(Buffer *b, i32 count) {
     }
     b->count -= count;
     
-    buffer_changed(b);
+    buffer_edit_begin(b);
+    buffer_mark_dirty(b, b->cursor, 0, count);
+    buffer_edit_end(b);
+  }
+  
+  end_profiler_function();
+}
+
+// NOTE(lvl5): copies the text in [start, end) to dst, returns how many chars that was
+i32 buffer_copy_range(Buffer *b, i32 start, i32 end, char *dst) {
+  i32 gap_start = get_gap_start(b);
+  i32 gap_count = get_gap_count(b);
+  
+  i32 first_end = min(end, gap_start);
+  i32 first_count = max(first_end - start, 0);
+  if (first_count) {
+    memcpy(dst, b->data + start, first_count);
+  }
+  
+  i32 second_start = max(start, gap_start);
+  i32 second_count = max(end - second_start, 0);
+  if (second_count) {
+    memcpy(dst + first_count, b->data + second_start + gap_count, second_count);
+  }
+  
+  i32 result = first_count + second_count;
+  return result;
+}
+
+// NOTE(lvl5): where pos ends up once every match is replaced.
+// positions inside a match go after its replacement
+i32 replace_map_position(Find_Match *matches, i32 match_count,
+                         i32 replacement_count, i32 pos)
+{
+  i32 shift = 0;
+  i32 result = -1;
+  for (i32 i = 0; i < match_count && matches[i].start < pos; i++) {
+    if (pos < matches[i].end) {
+      result = matches[i].start + shift + replacement_count;
+      break;
+    }
+    shift += replacement_count - (matches[i].end - matches[i].start);
+  }
+  
+  if (result < 0) {
+    result = pos + shift;
+  }
+  return result;
+}
+
+// NOTE(lvl5): replaces every match of the find query in one go. the new text is
+// written straight into a fresh gap buffer and there is only one edit,
+// so the buffer gets reparsed once no matter how many matches there are
+void buffer_replace_all(Buffer *b, String replacement) {
+  begin_profiler_function();
+  Buffer_Find *find = &b->find;
+  
+  if (find->query.count) {
+    push_system_context();
+    
+    Find_Match *matches = sb_new(Find_Match, 1024);
+    buffer_find_in_range(b, 0, b->count - 1, &matches);
+    
+    // literal matches can overlap, only the first one of those gets replaced
+    i32 match_count = 0;
+    i32 last_end = 0;
+    for (u32 i = 0; i < sb_count(matches); i++) {
+      if (matches[i].start >= last_end) {
+        last_end = matches[i].end;
+        matches[match_count++] = matches[i];
+      }
+    }
+    
+    if (match_count) {
+      i32 replacement_count = (i32)replacement.count;
+      i32 new_count = b->count;
+      for (i32 i = 0; i < match_count; i++) {
+        new_count += replacement_count - (matches[i].end - matches[i].start);
+      }
+      i32 new_cursor = replace_map_position(matches, match_count, replacement_count,
+                                            b->cursor);
+      i32 new_mark = replace_map_position(matches, match_count, replacement_count,
+                                          b->mark);
+      
+      i32 capacity = (new_count/BUFFER_INCREMENT_SIZE + 1)*BUFFER_INCREMENT_SIZE;
+      // one extra \0 after the buffer for kerning
+      char *data = alloc_array(char, capacity + 1);
+      data[capacity] = '\0';
+      
+      i32 written = 0;
+      i32 pos = 0;
+      for (i32 i = 0; i < match_count; i++) {
+        written += buffer_copy_range(b, pos, matches[i].start, data + written);
+        memcpy(data + written, replacement.data, replacement_count);
+        written += replacement_count;
+        pos = matches[i].end;
+      }
+      // this includes the 0 at the end
+      written += buffer_copy_range(b, pos, b->count, data + written);
+      assert(written == new_count);
+      
+      // the text was written without a gap, open it up at the cursor
+      i32 after_cursor = new_count - new_cursor;
+      memmove(data + capacity - after_cursor, data + new_cursor, after_cursor);
+      
+      i32 dirty_start = matches[0].start;
+      i32 old_dirty_end = matches[match_count - 1].end;
+      i32 new_dirty_end = old_dirty_end + new_count - b->count;
+      
+      free_memory(b->data);
+      b->data = data;
+      b->capacity = capacity;
+      b->count = new_count;
+      b->cursor = new_cursor;
+      b->mark = new_mark;
+      
+      // the mapping keeps the order, so only neighbours can end up on top of each other
+      if (b->cursors) {
+        i32 kept = 0;
+        for (u32 i = 0; i < sb_count(b->cursors); i++) {
+          Buffer_Cursor cursor = b->cursors[i];
+          cursor.pos = replace_map_position(matches, match_count, replacement_count,
+                                            cursor.pos);
+          cursor.mark = replace_map_position(matches, match_count, replacement_count,
+                                             cursor.mark);
+          cursor.preferred_col_pos = replace_map_position(matches, match_count,
+                                                          replacement_count,
+                                                          cursor.preferred_col_pos);
+          bool duplicate = cursor.pos == new_cursor ||
+            (kept > 0 && b->cursors[kept - 1].pos == cursor.pos);
+          if (!duplicate) {
+            b->cursors[kept++] = cursor;
+          }
+        }
+        sb_count(b->cursors) = kept;
+      }
+      
+      buffer_edit_begin(b);
+      buffer_mark_dirty(b, dirty_start, new_dirty_end - dirty_start,
+                        old_dirty_end - dirty_start);
+      buffer_edit_end(b);
+    }
+    
+    free_memory(__get_header(matches));
+    pop_context();
   }
   
   end_profiler_function();
@@ -363,10 +1249,9 @@ f32 get_pixel_position_in_line(Font *font, Buffer *b, i32 pos) {
   
   i32 line_start = seek_line_start(b, pos);
   f32 result = 0;
-  for (i32 i = line_start; i < pos; i++) {
-    result += font_get_advance(font, 
-                               get_buffer_char(b, i),
-                               get_buffer_char(b, i + 1));
+  i32 length = 1;
+  for (i32 i = line_start; i < pos; i += length) {
+    result += buffer_get_advance(font, b, i, &length);
   }
   
   end_profiler_function();
@@ -381,7 +1266,7 @@ b32 move_cursor_direction(Font *font, Buffer *b, Command direction) {
   switch (direction) {
     case Command_MOVE_CURSOR_RIGHT: {
       if (cursor < b->count-1) {
-        cursor++;
+        cursor = buffer_next_codepoint(b, cursor);
         b->preferred_col_pos = cursor;
         result = true;
       }
@@ -389,7 +1274,7 @@ b32 move_cursor_direction(Font *font, Buffer *b, Command direction) {
     
     case Command_MOVE_CURSOR_LEFT: {
       if (cursor > 0) {
-        cursor--;
+        cursor = buffer_prev_codepoint(b, cursor);
         b->preferred_col_pos = cursor;
         result = true;
       }
@@ -398,25 +1283,24 @@ b32 move_cursor_direction(Font *font, Buffer *b, Command direction) {
     case Command_MOVE_CURSOR_DOWN: {
       i32 line_start = seek_line_start(b, cursor);
       
-      f32 cur_pixel = get_screen_position_in_buffer(font, b, b->preferred_col_pos).x;
+      f32 cur_pixel = get_pixel_position_in_line(font, b, b->preferred_col_pos);
       i32 line_end = seek_line_end(b, cursor);
       
       i32 want = min(line_end + 1, b->count - 1);
       f32 want_pixel = 0;
       while (want < b->count-1 && get_buffer_char(b, want) != '\n') {
-        i8 advance = font_get_advance(font, 
-                                      get_buffer_char(b, want), 
-                                      get_buffer_char(b, want+1));
+        i32 length = 1;
+        i8 advance = buffer_get_advance(font, b, want, &length);
         if (want_pixel + advance > cur_pixel) {
           if (cur_pixel - want_pixel < want_pixel + advance - cur_pixel) {
             break;
           } else {
-            want++;
+            want += length;
             break;
           }
         }
         want_pixel += advance;
-        want++;
+        want += length;
       }
       
       cursor = want;
@@ -425,25 +1309,24 @@ b32 move_cursor_direction(Font *font, Buffer *b, Command direction) {
     case Command_MOVE_CURSOR_UP: {
       i32 line_start = seek_line_start(b, cursor);
       
-      f32 cur_pixel = get_screen_position_in_buffer(font, b, b->preferred_col_pos).x;
+      f32 cur_pixel = get_pixel_position_in_line(font, b, b->preferred_col_pos);
       i32 line_end = seek_line_end(b, cursor);
       
       i32 want = seek_line_start(b, line_start-1);
       f32 want_pixel = 0;
       while (want + 1 < line_start) {
-        i8 advance = font_get_advance(font, 
-                                      get_buffer_char(b, want), 
-                                      get_buffer_char(b, want+1));
+        i32 length = 1;
+        i8 advance = buffer_get_advance(font, b, want, &length);
         if (want_pixel + advance > cur_pixel) {
           if (cur_pixel - want_pixel < want_pixel + advance - cur_pixel) {
             break;
           } else {
-            want++;
+            want += length;
             break;
           }
         }
         want_pixel += advance;
-        want++;
+        want += length;
       }
       
       cursor = want;
@@ -480,9 +1363,7 @@ String buffer_part_to_string(Buffer *buffer, i32 start, i32 end) {
   
   if ((start < buffer->cursor) & (end >= buffer->cursor)) {
     str.data = scratch_push_array(char, str.count);
-    for (i32 i = 0; i < (i32)str.count; i++) {
-      str.data[i] = get_buffer_char(buffer, start + i);
-    }
+    buffer_copy_range(buffer, start, end, str.data);
   } else if (start < buffer->cursor) {
     str.data = buffer->data + start;
   } else {
@@ -498,31 +1379,94 @@ String text_buffer_to_string(Buffer *buffer) {
   return result;
 }
 
+// NOTE(lvl5): the old contents are thrown away
+void exchange_reserve(Exchange *exchange, i32 count) {
+  if (count > exchange->capacity) {
+    push_system_context();
+    if (exchange->data) {
+      free_memory(exchange->data);
+    }
+    exchange->capacity = max(count, exchange->capacity*2);
+    exchange->data = alloc_array(char, exchange->capacity);
+    pop_context();
+  }
+}
+
 void buffer_copy(Buffer *buffer, Exchange *exchange) {
-  i32 start = min(buffer->cursor, buffer->mark);
-  i32 end = max(buffer->cursor, buffer->mark);
-  exchange->count = end - start;
-  assert(exchange->count <= MAX_EXCHANGE_COUNT);
-  for (i32 i = 0; i < exchange->count; i++) {
-    exchange->data[i] = get_buffer_char(buffer, start+i);
+  begin_profiler_function();
+  
+  // NOTE(lvl5): an empty selection leaves the clipboard alone
+  if (buffer->cursor != buffer->mark) {
+    i32 start = min(buffer->cursor, buffer->mark);
+    i32 end = max(buffer->cursor, buffer->mark);
+    exchange_reserve(exchange, end - start);
+    exchange->count = buffer_copy_range(buffer, start, end, exchange->data);
+    
+    if (global_os.set_clipboard &&
+        global_os.set_clipboard(make_string(exchange->data, exchange->count))) {
+      exchange->clipboard_sequence = global_os.get_clipboard_sequence();
+    }
   }
+  
+  end_profiler_function();
 }
 
 void buffer_paste(Buffer *buffer, Exchange *exchange) {
+  begin_profiler_function();
+  
+  // NOTE(lvl5): something else was copied since our last copy
+  if (global_os.get_clipboard &&
+      global_os.get_clipboard_sequence() != exchange->clipboard_sequence) {
+    push_system_context();
+    String text = global_os.get_clipboard();
+    if (text.data) {
+      exchange_reserve(exchange, (i32)text.count);
+      memcpy(exchange->data, text.data, text.count);
+      exchange->count = (i32)text.count;
+      free_memory(text.data);
+    }
+    pop_context();
+    exchange->clipboard_sequence = global_os.get_clipboard_sequence();
+  }
+  
   String str = make_string(exchange->data, exchange->count);
   buffer_insert_string(buffer, str);
+  
+  end_profiler_function();
 }
 
-void buffer_cut(Buffer *buffer, Exchange *exchange) {
-  buffer_copy(buffer, exchange);
-  i32 count = buffer->cursor - buffer->mark;
-  if (buffer->cursor < buffer->mark) {
-    i32 tmp = buffer->cursor;
-    buffer->cursor = buffer->mark;
-    buffer->mark = tmp;
-    count *= -1;
+// NOTE(lvl5): the identifier the position is in or right after,
+// empty if there is none
+String buffer_get_identifier_at(Buffer *buffer, i32 pos) {
+  i32 start = pos;
+  while (start > 0 &&
+         (is_alpha(get_buffer_char(buffer, start - 1)) ||
+          is_digit(get_buffer_char(buffer, start - 1)))) {
+    start--;
+  }
+  i32 end = pos;
+  while (end < buffer->count &&
+         (is_alpha(get_buffer_char(buffer, end)) ||
+          is_digit(get_buffer_char(buffer, end)))) {
+    end++;
+  }
+  
+  String result = {0};
+  if (end > start && !is_digit(get_buffer_char(buffer, start))) {
+    result = buffer_part_to_string(buffer, start, end);
+  }
+  return result;
+}
+
+// NOTE(lvl5): the cursor has to move through set_cursor, it is the gap start
+void buffer_remove_selection(Buffer *buffer) {
+  i32 start = min(buffer->cursor, buffer->mark);
+  i32 end = max(buffer->cursor, buffer->mark);
+  if (end > start) {
+    set_cursor(buffer, end);
+    buffer->mark = start;
+    buffer_remove_backward(buffer, end - start);
   }
-  buffer_remove_backward(buffer, count);
 }
 
 
@@ -563,6 +1507,8 @@ void buffer_indent(Buffer *buffer) {
 }
 
 void buffer_input_string(Buffer *buffer, String str) {
+  buffer_edit_begin(buffer);
+  
   if (str.data[0] == '}') {
     i32 start = seek_line_start(buffer, buffer->cursor);
     bool only_indent = true;
@@ -581,4 +1527,229 @@ void buffer_input_string(Buffer *buffer, String str) {
       str.data[0] != '\r') {
     buffer_insert_string(buffer, str);
   }
+  
+  buffer_edit_end(buffer);
+}
+
+i32 buffer_cursor_count(Buffer *buffer) {
+  i32 result = 1 + (buffer->cursors ? sb_count(buffer->cursors) : 0);
+  return result;
+}
+
+void buffer_clear_cursors(Buffer *buffer) {
+  if (buffer->cursors) {
+    sb_count(buffer->cursors) = 0;
+  }
+}
+
+Cursor_Iterator buffer_cursors_begin(Buffer *buffer) {
+  begin_profiler_function();
+  
+  Cursor_Iterator it = {
+    .buffer = buffer,
+    .count = buffer_cursor_count(buffer),
+    .primary_index = -1,
+    .index = -1,
+  };
+  it.cursors = scratch_push_array(Buffer_Cursor, it.count);
+  
+  // the extra cursors are sorted already, the main one just goes in between
+  Buffer_Cursor primary = {buffer->cursor, buffer->mark, buffer->preferred_col_pos};
+  i32 written = 0;
+  for (i32 i = 0; i < it.count - 1; i++) {
+    if (it.primary_index < 0 && buffer->cursors[i].pos > primary.pos) {
+      it.primary_index = written;
+      it.cursors[written++] = primary;
+    }
+    it.cursors[written++] = buffer->cursors[i];
+  }
+  if (it.primary_index < 0) {
+    it.primary_index = written;
+    it.cursors[written++] = primary;
+  }
+  
+  buffer_edit_begin(buffer);
+  end_profiler_function();
+  return it;
+}
+
+bool buffer_cursors_next(Cursor_Iterator *it) {
+  Buffer *buffer = it->buffer;
+  
+  if (it->index >= 0) {
+    Buffer_Cursor *visited = it->cursors + it->index;
+    visited->pos = buffer->cursor;
+    visited->mark = buffer->mark;
+    visited->preferred_col_pos = buffer->preferred_col_pos;
+    it->shift += buffer->count - it->count_before;
+  }
+  
+  it->index++;
+  bool result = it->index < it->count;
+  if (result) {
+    Buffer_Cursor *next = it->cursors + it->index;
+    i32 last = buffer->count - 1;
+    set_cursor(buffer, clamp_i32(next->pos + it->shift, 0, last));
+    buffer->mark = clamp_i32(next->mark + it->shift, 0, last);
+    buffer->preferred_col_pos = clamp_i32(next->preferred_col_pos + it->shift, 0, last);
+    it->count_before = buffer->count;
+  }
+  return result;
+}
+
+// NOTE(lvl5): cursors that ran into each other become one
+void buffer_cursors_end(Cursor_Iterator *it) {
+  begin_profiler_function();
+  Buffer *buffer = it->buffer;
+  Buffer_Cursor *cursors = it->cursors;
+  
+  // edits keep the order, but moves can swap neighbours
+  for (i32 i = 1; i < it->count; i++) {
+    Buffer_Cursor cursor = cursors[i];
+    bool is_primary = i == it->primary_index;
+    i32 j = i - 1;
+    while (j >= 0 && cursors[j].pos > cursor.pos) {
+      cursors[j + 1] = cursors[j];
+      if (j == it->primary_index) it->primary_index = j + 1;
+      j--;
+    }
+    cursors[j + 1] = cursor;
+    if (is_primary) it->primary_index = j + 1;
+  }
+  
+  Buffer_Cursor primary = cursors[it->primary_index];
+  if (it->count > 1) {
+    if (!buffer->cursors) {
+      push_system_context();
+      buffer->cursors = sb_new(Buffer_Cursor, 64);
+      pop_context();
+    }
+    sb_count(buffer->cursors) = 0;
+    
+    for (i32 i = 0; i < it->count; i++) {
+      Buffer_Cursor cursor = cursors[i];
+      bool duplicate = cursor.pos == primary.pos ||
+        (i > 0 && cursors[i - 1].pos == cursor.pos);
+      if (i != it->primary_index && !duplicate) {
+        sb_push(buffer->cursors, cursor);
+      }
+    }
+  }
+  
+  set_cursor(buffer, primary.pos);
+  buffer->mark = primary.mark;
+  buffer->preferred_col_pos = primary.preferred_col_pos;
+  
+  buffer_edit_end(buffer);
+  end_profiler_function();
+}
+
+// NOTE(lvl5): keeps the extra cursors sorted, positions that already have one are skipped
+void buffer_add_cursor(Buffer *buffer, Buffer_Cursor cursor) {
+  if (!buffer->cursors) {
+    push_system_context();
+    buffer->cursors = sb_new(Buffer_Cursor, 64);
+    pop_context();
+  }
+  
+  i32 count = sb_count(buffer->cursors);
+  i32 low = 0;
+  i32 high = count;
+  while (low < high) {
+    i32 mid = low + (high - low)/2;
+    if (buffer->cursors[mid].pos < cursor.pos) {
+      low = mid + 1;
+    } else {
+      high = mid;
+    }
+  }
+  
+  bool exists = cursor.pos == buffer->cursor ||
+    (low < count && buffer->cursors[low].pos == cursor.pos);
+  if (!exists) {
+    sb_push(buffer->cursors, cursor);
+    memmove(buffer->cursors + low + 1, buffer->cursors + low,
+            (count - low)*sizeof(Buffer_Cursor));
+    buffer->cursors[low] = cursor;
+  }
+}
+
+// NOTE(lvl5): a new cursor one line above the topmost cursor, or below the bottommost one
+void buffer_add_cursor_vertical(Font *font, Buffer *buffer, Command direction) {
+  begin_profiler_function();
+  
+  Buffer_Cursor primary = {buffer->cursor, buffer->mark, buffer->preferred_col_pos};
+  Buffer_Cursor edge = primary;
+  i32 extra_count = buffer_cursor_count(buffer) - 1;
+  if (extra_count) {
+    Buffer_Cursor first = buffer->cursors[0];
+    Buffer_Cursor last = buffer->cursors[extra_count - 1];
+    if (direction == Command_MOVE_CURSOR_UP && first.pos < edge.pos) {
+      edge = first;
+    } else if (direction == Command_MOVE_CURSOR_DOWN && last.pos > edge.pos) {
+      edge = last;
+    }
+  }
+  
+  set_cursor(buffer, edge.pos);
+  buffer->preferred_col_pos = edge.preferred_col_pos;
+  i32 line_start = seek_line_start(buffer, edge.pos);
+  move_cursor_direction(font, buffer, direction);
+  Buffer_Cursor added = {buffer->cursor, buffer->cursor, buffer->preferred_col_pos};
+  
+  set_cursor(buffer, primary.pos);
+  buffer->mark = primary.mark;
+  buffer->preferred_col_pos = primary.preferred_col_pos;
+  
+  if (seek_line_start(buffer, added.pos) != line_start) {
+    buffer_add_cursor(buffer, added);
+  }
+  
+  end_profiler_function();
+}
+
+// NOTE(lvl5): a cursor on every occurrence of the selection, or of the identifier
+// under the cursor when nothing is selected. the occurrences come out sorted,
+// so the extra cursors are just replaced
+void buffer_add_cursors_at_matches(Buffer *buffer) {
+  begin_profiler_function();
+  
+  i32 start = min(buffer->cursor, buffer->mark);
+  i32 end = max(buffer->cursor, buffer->mark);
+  
+  push_scratch_context();
+  String needle = end > start
+    ? buffer_part_to_string(buffer, start, end)
+    : buffer_get_identifier_at(buffer, buffer->cursor);
+  pop_context();
+  
+  if (needle.count) {
+    push_system_context();
+    Find_Match *matches = sb_new(Find_Match, 256);
+    buffer_find_literal_in_range(buffer, needle, 0, buffer->count - 1, &matches);
+    
+    buffer_clear_cursors(buffer);
+    if (!buffer->cursors) {
+      buffer->cursors = sb_new(Buffer_Cursor, sb_count(matches));
+    }
+    
+    i32 last_end = 0;
+    for (u32 i = 0; i < sb_count(matches); i++) {
+      Find_Match match = matches[i];
+      if (match.start >= last_end) {
+        last_end = match.end;
+        // the main cursor already sits on its own occurrence
+        bool is_primary = match.start <= buffer->cursor && buffer->cursor <= match.end;
+        if (!is_primary) {
+          Buffer_Cursor cursor = {match.end, match.start, match.end};
+          sb_push(buffer->cursors, cursor);
+        }
+      }
+    }
+    
+    free_memory(__get_header(matches));
+    pop_context();
+  }
+  
+  end_profiler_function();
 }
@@ -3,27 +3,111 @@
 #include "lvl5_string.h"
 #include "parser.h"
 #include "lvl5_intrinsics.h"
+#include "regex.h"
+#include "lvl5_utf8.h"
 
-#define MAX_EXCHANGE_COUNT 1024
+// NOTE(lvl5): the last thing that was copied. it is also put on the os clipboard,
+// and only read back from there when someone else changed it since
 typedef struct {
-  char data[MAX_EXCHANGE_COUNT];
+  char *data;
   i32 count;
+  i32 capacity;
+  u32 clipboard_sequence;
 } Exchange;
 
 typedef struct Editor Editor;
 
+typedef struct {
+  i32 start;
+  i32 end;
+} Find_Match;
+
+// NOTE(lvl5): matches are found in slices, starting at split (the top of the
+// view) and wrapping around. matches before split go to head, the rest to tail,
+// so head followed by tail is always sorted
+typedef struct {
+  String query;
+  bool is_regex;
+  Regex regex;
+  
+  Find_Match *head;
+  Find_Match *tail;
+  i32 split;
+  i32 head_scan_pos;
+  i32 tail_scan_pos;
+} Buffer_Find;
+
+typedef struct {
+  Buffer_Find *find;
+  i32 index;
+  i32 count;
+} Find_Iterator;
+
+typedef struct {
+  i32 pos;
+  i32 mark;
+  i32 preferred_col_pos;
+} Buffer_Cursor;
+
+#define LINE_INDEX_CHUNK_SIZE 64
+
+// NOTE(lvl5): filled in by the renderer when it draws the line, a text_hash of 0
+// means the line was edited since. colors change with every reparse, so color_hash
+// is only good while color_generation matches the buffer's cache generation
+typedef struct {
+  u64 text_hash;
+  u64 color_hash;
+  i32 color_generation;
+} Line_Hash;
+
+typedef struct {
+  i32 pos;
+  i32 codepoints; // before pos
+} Line_Checkpoint;
+
+// NOTE(lvl5): buffer_changed rescans only the edited range and shifts the entries
+// after it. a line is a binary search over line_starts, and a column only counts the
+// codepoints since the checkpoint before it, so nothing scans a whole line
+typedef struct {
+  i32 *line_starts;
+  // one at every line start, and one every LINE_INDEX_CHUNK_SIZE bytes inside
+  // a line. after edits they can be up to twice that far apart
+  Line_Checkpoint *checkpoints;
+  // one per line
+  Line_Hash *hashes;
+  // the text the index is for, without the 0 at the end
+  i32 text_count;
+} Line_Index;
+
 typedef struct Buffer {
   String path;
   
   char *data;
   i32 count;
   i32 capacity;
+  // NOTE(lvl5): files that fail validation are shown a byte at a time
+  bool is_utf8;
+  Line_Index lines;
   
   i32 cursor;
   i32 mark;
   i32 preferred_col_pos;
+  // NOTE(lvl5): the cursors besides the main one, sorted by pos.
+  // the gap always follows the main cursor
+  Buffer_Cursor *cursors;
   
   Editor *editor;
+  i32 node_index;
+  Buffer_Find find;
+  
+  // NOTE(lvl5): edits inside buffer_edit_begin/end only grow the dirty range,
+  // buffer_changed runs once when the outermost one ends
+  struct {
+    i32 depth;
+    bool dirty;
+    i32 dirty_start;
+    i32 dirty_end;
+  } edit;
   
   struct {
     volatile b32 locked;
@@ -32,14 +116,40 @@ typedef struct Buffer {
     Scope *scope;
     Arena arena;
     String *dependencies;
-    Syntax *colors;
+    Color_Span *comments;
     Token *tokens;
   } cache;
 } Buffer;
 
+// NOTE(lvl5): visits every cursor in position order, the one being visited is
+// loaded into buffer->cursor and buffer->mark. edits at one cursor only shift the
+// ones after it, so the gap moves through the buffer once
+typedef struct {
+  Buffer *buffer;
+  Buffer_Cursor *cursors;
+  i32 count;
+  i32 primary_index;
+  i32 index;
+  i32 shift;
+  i32 count_before;
+} Cursor_Iterator;
+
+// NOTE(lvl5): walks the token and comment spans of a buffer in order,
+// positions passed to color_iterator_get must never go backwards
+typedef struct {
+  Token *tokens;
+  i32 token_count;
+  i32 token_index;
+  
+  Color_Span *comments;
+  i32 comment_count;
+  i32 comment_index;
+} Color_Iterator;
+
 
 String buffer_part_to_string(Buffer *, i32, i32);
 char get_buffer_char(Buffer *, i32);
+String resolve_include_path(Editor *, String, String);
 
 #define BUFFER_H
 #endif
\ No newline at end of file
@@ -64,11 +64,20 @@ typedef struct {
   void (*close_file)(os_File);
   void (*read_file)(os_File, void*, u64, u64);
   u64 (*get_file_size)(os_File);
+  os_File_Info (*get_file_info)(String);
+  void *(*map_file)(String, u64 *);
+  void (*unmap_file)(void *);
+  bool (*write_entire_file)(String, void *, u64);
+  bool (*set_clipboard)(String);
+  String (*get_clipboard)();
+  u32 (*get_clipboard_sequence)();
+  void (*wake_main_thread)();
   void (*debug_pring)(char *);
   
   // threads
   Thread_Queue *thread_queue;
   void (*queue_add)(Thread_Queue *, Worker *, void *);
+  i32 thread_count;
   
   Global_Context_Info *context_info;
   Profiler_Event *profiler_events;
@@ -80,6 +89,10 @@ typedef struct {
   bool initialized;
   bool reloaded;
   bool running;
+  // NOTE(lvl5): set by editor_update. busy means the next update has to run
+  // right away instead of waiting for a message, drawn that there is a frame to show
+  bool busy;
+  bool drawn;
   os_Window window;
   
   byte *data;
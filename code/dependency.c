@@ -0,0 +1,617 @@
+#include "dependency.h"
+
+void dependency_lock(Dependency_Graph *graph) {
+  while (_InterlockedCompareExchange(&graph->lock, true, false) != false) {
+    _mm_pause();
+  }
+}
+
+void dependency_unlock(Dependency_Graph *graph) {
+  _InterlockedExchange(&graph->lock, false);
+}
+
+// NOTE(lvl5): held while a buffer's cache is rebuilt, by the main thread or a worker
+void buffer_cache_lock(Buffer *buffer) {
+  while (_InterlockedCompareExchange((volatile long *)&buffer->cache.locked,
+                                     true, false) != false) {
+    _mm_pause();
+  }
+}
+
+void buffer_cache_unlock(Buffer *buffer) {
+  _InterlockedExchange((volatile long *)&buffer->cache.locked, false);
+}
+
+
+String path_get_parent_dir(String path) {
+  String result = make_string(path.data, 0);
+  for (i64 i = (i64)path.count - 1; i >= 0; i--) {
+    if (path.data[i] == '/' || path.data[i] == '\\') {
+      result.count = i;
+      break;
+    }
+  }
+  return result;
+}
+
+// NOTE(lvl5): turns "src\\foo/./bar/../baz.h" into "src/foo/baz.h",
+// result is allocated with the current allocator
+String normalize_path(String path) {
+  String result = make_string(alloc_array(char, path.count), 0);
+  
+  u64 i = 0;
+  while (i < path.count) {
+    u64 segment_start = i;
+    while (i < path.count && path.data[i] != '/' && path.data[i] != '\\') {
+      i++;
+    }
+    String segment = substring(path, segment_start, i);
+    i++;
+    
+    if (segment.count == 0 || string_compare(segment, const_string("."))) {
+      continue;
+    }
+    
+    if (string_compare(segment, const_string(".."))) {
+      String parent = path_get_parent_dir(result);
+      String last = substring(result, parent.count, result.count);
+      bool can_pop = result.count > 0 &&
+        !string_compare(last, const_string("..")) &&
+        !string_compare(last, const_string("/.."));
+      if (can_pop) {
+        result.count = parent.count;
+        continue;
+      }
+    }
+    
+    if (result.count > 0) {
+      result.data[result.count++] = '/';
+    }
+    copy_memory_slow(result.data + result.count, segment.data, segment.count);
+    result.count += segment.count;
+  }
+  
+  return result;
+}
+
+
+void dependency_graph_init(Dependency_Graph *graph) {
+  push_system_context();
+  
+  *graph = (Dependency_Graph){0};
+  graph->nodes = sb_new(Dependency_Node *, 64);
+  graph->include_dirs = sb_new(String, 8);
+  graph->ready = sb_new(Dependency_Job, 64);
+  
+  graph->node_table_capacity = 256;
+  graph->node_table = alloc_array(i32, graph->node_table_capacity);
+  zero_memory_slow(graph->node_table, sizeof(i32)*graph->node_table_capacity);
+  
+  graph->include_cache_capacity = 256;
+  graph->include_cache = alloc_array(Include_Cache_Entry, graph->include_cache_capacity);
+  zero_memory_slow(graph->include_cache,
+                   sizeof(Include_Cache_Entry)*graph->include_cache_capacity);
+  
+  pop_context();
+}
+
+u32 include_cache_get_slot(Include_Cache_Entry *cache, u32 capacity, String key) {
+  u32 slot = hash_string(key) & (capacity - 1);
+  while (cache[slot].key.count && !string_compare(cache[slot].key, key)) {
+    slot = (slot + 1) & (capacity - 1);
+  }
+  return slot;
+}
+
+// lock must be held. moves the entries over to a table of new_capacity,
+// the ones that failed to resolve are only kept if keep_missing is set
+void include_cache_rebuild(Dependency_Graph *graph, u32 new_capacity, bool keep_missing) {
+  Include_Cache_Entry *old_cache = graph->include_cache;
+  u32 old_capacity = graph->include_cache_capacity;
+  
+  push_system_context();
+  graph->include_cache = alloc_array(Include_Cache_Entry, new_capacity);
+  zero_memory_slow(graph->include_cache, sizeof(Include_Cache_Entry)*new_capacity);
+  graph->include_cache_capacity = new_capacity;
+  graph->include_cache_count = 0;
+  
+  for (u32 i = 0; i < old_capacity; i++) {
+    Include_Cache_Entry *entry = old_cache + i;
+    if (entry->key.count) {
+      if (entry->found || keep_missing) {
+        u32 slot = include_cache_get_slot(graph->include_cache, new_capacity, entry->key);
+        graph->include_cache[slot] = *entry;
+        graph->include_cache_count++;
+      } else {
+        free_memory(entry->key.data);
+      }
+    }
+  }
+  free_memory(old_cache);
+  pop_context();
+}
+
+// lock must be held
+void include_cache_clear(Dependency_Graph *graph) {
+  push_system_context();
+  for (u32 i = 0; i < graph->include_cache_capacity; i++) {
+    Include_Cache_Entry *entry = graph->include_cache + i;
+    if (entry->key.count) {
+      free_memory(entry->key.data);
+    }
+    if (entry->resolved.count) {
+      free_memory(entry->resolved.data);
+    }
+  }
+  pop_context();
+  
+  zero_memory_slow(graph->include_cache,
+                   sizeof(Include_Cache_Entry)*graph->include_cache_capacity);
+  graph->include_cache_count = 0;
+}
+
+void dependency_graph_add_include_dir(Dependency_Graph *graph, String dir) {
+  dependency_lock(graph);
+  
+  push_system_context();
+  sb_push(graph->include_dirs, normalize_path(dir));
+  pop_context();
+  
+  // NOTE(lvl5): anything that failed to resolve might resolve now
+  include_cache_clear(graph);
+  
+  dependency_unlock(graph);
+}
+
+// NOTE(lvl5): for when files might have changed on disk
+void dependency_graph_clear_include_cache(Dependency_Graph *graph) {
+  dependency_lock(graph);
+  include_cache_clear(graph);
+  dependency_unlock(graph);
+}
+
+// NOTE(lvl5): opening a buffer can only make includes resolve that didn't before,
+// the ones that did already found the file on disk
+void dependency_graph_drop_missing_includes(Dependency_Graph *graph) {
+  dependency_lock(graph);
+  include_cache_rebuild(graph, graph->include_cache_capacity, false);
+  dependency_unlock(graph);
+}
+
+
+u32 dependency_get_node_slot(i32 *table, u32 capacity,
+                             Dependency_Node **nodes, String path)
+{
+  u32 index = hash_string(path) & (capacity - 1);
+  while (table[index] &&
+         !string_compare(nodes[table[index] - 1]->path, path))
+  {
+    index = (index + 1) & (capacity - 1);
+  }
+  return index;
+}
+
+// lock must be held
+i32 dependency_find_node(Dependency_Graph *graph, String path) {
+  u32 slot = dependency_get_node_slot(graph->node_table,
+                                      graph->node_table_capacity,
+                                      graph->nodes, path);
+  i32 result = graph->node_table[slot] - 1;
+  return result;
+}
+
+// lock must be held, path must already be normalized
+i32 dependency_get_node(Dependency_Graph *graph, String path) {
+  i32 result = dependency_find_node(graph, path);
+  
+  if (result < 0) {
+    push_system_context();
+    
+    if ((sb_count(graph->nodes) + 1)*2 > graph->node_table_capacity) {
+      u32 new_capacity = graph->node_table_capacity*2;
+      i32 *new_table = alloc_array(i32, new_capacity);
+      zero_memory_slow(new_table, sizeof(i32)*new_capacity);
+      
+      for (u32 i = 0; i < sb_count(graph->nodes); i++) {
+        u32 slot = dependency_get_node_slot(new_table, new_capacity,
+                                            graph->nodes, graph->nodes[i]->path);
+        new_table[slot] = i + 1;
+      }
+      
+      free_memory(graph->node_table);
+      graph->node_table = new_table;
+      graph->node_table_capacity = new_capacity;
+    }
+    
+    Dependency_Node *node = alloc_struct(Dependency_Node);
+    *node = (Dependency_Node){
+      .path = alloc_string(path.data, path.count),
+      .buffer_index = -1,
+      .includes = sb_new(i32, 8),
+      .included_by = sb_new(i32, 8),
+    };
+    
+    result = sb_count(graph->nodes);
+    sb_push(graph->nodes, node);
+    
+    u32 slot = dependency_get_node_slot(graph->node_table,
+                                        graph->node_table_capacity,
+                                        graph->nodes, node->path);
+    graph->node_table[slot] = result + 1;
+    
+    pop_context();
+  }
+  
+  return result;
+}
+
+
+bool include_file_exists(Editor *editor, String path) {
+  bool result = get_existing_buffer(editor, path) != null;
+  if (!result && global_os.get_file_info) {
+    result = global_os.get_file_info(path).exists;
+  }
+  return result;
+}
+
+// NOTE(lvl5): include is the literal text including the quotes or brackets.
+// "quoted" includes are looked up next to the including file first,
+// <bracketed> ones only in the include dirs, the same way the preprocessor does.
+// returns an empty string if the file can't be found,
+// otherwise the path is allocated with the current allocator
+String resolve_include_path(Editor *editor, String from_path, String include) {
+  begin_profiler_function();
+  
+  String result = {0};
+  
+  bool is_system = include.count >= 2 && include.data[0] == '<' &&
+    include.data[include.count - 1] == '>';
+  bool is_quoted = include.count >= 2 && include.data[0] == '"' &&
+    include.data[include.count - 1] == '"';
+  
+  if (is_system || is_quoted) {
+    Dependency_Graph *graph = &editor->deps;
+    String name = substring(include, 1, include.count - 1);
+    String from_dir = path_get_parent_dir(from_path);
+    
+    String key = is_system
+      ? include
+      : concat(concat(from_dir, const_string("|")), include);
+    
+    // NOTE(lvl5): copy while the lock is held, the cache can be cleared
+    // by another thread as soon as we let go
+    dependency_lock(graph);
+    Include_Cache_Entry *entry = graph->include_cache +
+      include_cache_get_slot(graph->include_cache, graph->include_cache_capacity, key);
+    bool cached = entry->key.count > 0;
+    if (cached && entry->found) {
+      result = alloc_string(entry->resolved.data, entry->resolved.count);
+    }
+    dependency_unlock(graph);
+    
+    // NOTE(lvl5): the lookup hits the disk, so it runs without the lock.
+    // two threads can both miss the same key, then the first one's entry stays
+    if (!cached) {
+      String found = {0};
+      
+      push_scratch_context();
+      if (!is_system) {
+        String candidate = from_dir.count
+          ? concat(concat(from_dir, const_string("/")), name)
+          : name;
+        candidate = normalize_path(candidate);
+        if (include_file_exists(editor, candidate)) {
+          found = candidate;
+        }
+      }
+      for (u32 dir_index = 0;
+           !found.count && dir_index < sb_count(graph->include_dirs);
+           dir_index++)
+      {
+        String dir = graph->include_dirs[dir_index];
+        String candidate = normalize_path(concat(concat(dir, const_string("/")), name));
+        if (include_file_exists(editor, candidate)) {
+          found = candidate;
+        }
+      }
+      pop_context();
+      
+      dependency_lock(graph);
+      if ((graph->include_cache_count + 1)*2 > graph->include_cache_capacity) {
+        include_cache_rebuild(graph, graph->include_cache_capacity*2, true);
+      }
+      
+      entry = graph->include_cache +
+        include_cache_get_slot(graph->include_cache, graph->include_cache_capacity, key);
+      if (!entry->key.count) {
+        push_system_context();
+        entry->key = alloc_string(key.data, key.count);
+        entry->found = found.count > 0;
+        if (entry->found) {
+          entry->resolved = alloc_string(found.data, found.count);
+        }
+        pop_context();
+        graph->include_cache_count++;
+      }
+      
+      if (entry->found) {
+        result = alloc_string(entry->resolved.data, entry->resolved.count);
+      }
+      dependency_unlock(graph);
+    }
+  }
+  
+  end_profiler_function();
+  return result;
+}
+
+
+void remove_node_index(i32 *indices, i32 node_index) {
+  for (u32 i = 0; i < sb_count(indices); i++) {
+    if (indices[i] == node_index) {
+      indices[i] = indices[sb_count(indices) - 1];
+      sb_count(indices)--;
+      break;
+    }
+  }
+}
+
+// NOTE(lvl5): replaces the outgoing edges of the node, keeping the reverse
+// edges in sync. includes must be resolved paths
+void dependency_graph_set_includes(Dependency_Graph *graph, i32 node_index,
+                                   String *includes)
+{
+  begin_profiler_function();
+  dependency_lock(graph);
+  push_system_context();
+  
+  Dependency_Node *node = graph->nodes[node_index];
+  for (u32 i = 0; i < sb_count(node->includes); i++) {
+    Dependency_Node *old = graph->nodes[node->includes[i]];
+    remove_node_index(old->included_by, node_index);
+  }
+  sb_count(node->includes) = 0;
+  
+  for (u32 i = 0; i < sb_count(includes); i++) {
+    i32 include_index = dependency_get_node(graph, includes[i]);
+    // dependency_get_node can grow the node list, but nodes themselves never move
+    Dependency_Node *include = graph->nodes[include_index];
+    
+    bool duplicate = false;
+    for (u32 j = 0; j < sb_count(node->includes); j++) {
+      if (node->includes[j] == include_index) {
+        duplicate = true;
+        break;
+      }
+    }
+    
+    if (!duplicate && include_index != node_index) {
+      sb_push(node->includes, include_index);
+      sb_push(include->included_by, node_index);
+    }
+  }
+  
+  pop_context();
+  dependency_unlock(graph);
+  end_profiler_function();
+}
+
+void dependency_register_buffer(Editor *editor, Buffer *buffer) {
+  Dependency_Graph *graph = &editor->deps;
+  
+  push_scratch_context();
+  String path = normalize_path(buffer->path);
+  pop_context();
+  
+  dependency_lock(graph);
+  buffer->node_index = dependency_get_node(graph, path);
+  graph->nodes[buffer->node_index]->buffer_index = (i32)(buffer - editor->buffers);
+  dependency_unlock(graph);
+  
+  // NOTE(lvl5): a file that failed to resolve before might be open now
+  dependency_graph_drop_missing_includes(graph);
+}
+
+
+typedef struct {
+  Dependency_Graph *graph;
+  i32 *affected;
+  i32 *stack;
+  i32 *index;
+  i32 *low_link;
+  bool *on_stack;
+  i32 next_index;
+  i32 component_count;
+} Tarjan_State;
+
+// NOTE(lvl5): tarjan's strongly connected components over the affected subgraph.
+// every node in an include cycle ends up in the same component and the edges
+// inside a component are ignored when scheduling, which breaks the cycle
+void dependency_strong_connect(Tarjan_State *s, i32 local) {
+  s->index[local] = s->next_index;
+  s->low_link[local] = s->next_index;
+  s->next_index++;
+  sb_push(s->stack, local);
+  s->on_stack[local] = true;
+  
+  Dependency_Node *node = s->graph->nodes[s->affected[local]];
+  for (u32 i = 0; i < sb_count(node->includes); i++) {
+    Dependency_Node *include = s->graph->nodes[node->includes[i]];
+    if (include->schedule_id != node->schedule_id) continue;
+    
+    // NOTE(lvl5): pending holds the local index while we are sorting
+    i32 include_local = include->pending;
+    if (s->index[include_local] < 0) {
+      dependency_strong_connect(s, include_local);
+      s->low_link[local] = min(s->low_link[local], s->low_link[include_local]);
+    } else if (s->on_stack[include_local]) {
+      s->low_link[local] = min(s->low_link[local], s->index[include_local]);
+    }
+  }
+  
+  if (s->low_link[local] == s->index[local]) {
+    i32 component = s->component_count++;
+    while (true) {
+      i32 top = s->stack[--sb_count(s->stack)];
+      s->on_stack[top] = false;
+      s->graph->nodes[s->affected[top]]->component = component;
+      if (top == local) break;
+    }
+  }
+}
+
+void dependency_worker(void *data);
+
+// lock must be held
+void dependency_launch_workers(Editor *editor) {
+  Dependency_Graph *graph = &editor->deps;
+  i32 max_workers = max(global_os.thread_count, 1);
+  while (graph->worker_count < max_workers &&
+         graph->worker_count < (i32)sb_count(graph->ready))
+  {
+    graph->worker_count++;
+    global_os.queue_add(global_os.thread_queue, dependency_worker, editor);
+  }
+}
+
+// lock must be held
+void dependency_job_finished(Editor *editor, Dependency_Job job) {
+  Dependency_Graph *graph = &editor->deps;
+  Dependency_Node *node = graph->nodes[job.node_index];
+  
+  for (u32 i = 0; i < sb_count(node->included_by); i++) {
+    Dependency_Node *parent = graph->nodes[node->included_by[i]];
+    if (parent->schedule_id == job.schedule_id &&
+        parent->component != node->component)
+    {
+      parent->pending--;
+      if (parent->pending == 0) {
+        Dependency_Job next = {
+          .node_index = node->included_by[i],
+          .schedule_id = job.schedule_id,
+        };
+        sb_push(graph->ready, next);
+      }
+    }
+  }
+  
+  dependency_launch_workers(editor);
+}
+
+void buffer_update_cache(Buffer *buffer);
+
+void dependency_worker(void *data) {
+  Editor *editor = (Editor *)data;
+  Dependency_Graph *graph = &editor->deps;
+  
+  while (true) {
+    dependency_lock(graph);
+    if (sb_count(graph->ready) == 0) {
+      graph->worker_count--;
+      dependency_unlock(graph);
+      break;
+    }
+    Dependency_Job job = graph->ready[--sb_count(graph->ready)];
+    i32 buffer_index = graph->nodes[job.node_index]->buffer_index;
+    dependency_unlock(graph);
+    
+    if (buffer_index >= 0) {
+      Buffer *buffer = editor->buffers + buffer_index;
+      // NOTE(lvl5): if someone else is rebuilding this buffer, the files that include
+      // it can't go before that is done, so wait for it rather than skip the job
+      buffer_cache_lock(buffer);
+      if (buffer->cache.generation != editor->generation) {
+        Mem_Size mark = scratch_get_mark();
+        buffer_update_cache(buffer);
+        scratch_set_mark(mark);
+        // the new colors get drawn
+        global_os.wake_main_thread();
+      }
+      buffer_cache_unlock(buffer);
+    }
+    
+    dependency_lock(graph);
+    dependency_job_finished(editor, job);
+    dependency_unlock(graph);
+  }
+}
+
+// NOTE(lvl5): only call this from the main thread, after the buffer itself
+// has been reparsed. every file that includes it, directly or not, gets reparsed
+// on the worker threads, each one only after everything it includes is done
+void dependency_schedule_dependents(Editor *editor, Buffer *buffer) {
+  begin_profiler_function();
+  Dependency_Graph *graph = &editor->deps;
+  
+  dependency_lock(graph);
+  push_scratch_context();
+  
+  i32 schedule_id = ++graph->schedule_id;
+  Dependency_Node *root = graph->nodes[buffer->node_index];
+  root->schedule_id = schedule_id;
+  root->component = -1;
+  
+  // NOTE(lvl5): collect everything reachable through the reverse edges
+  i32 *affected = sb_new(i32, 64);
+  i32 *queue = sb_new(i32, 64);
+  sb_push(queue, buffer->node_index);
+  for (u32 queue_index = 0; queue_index < sb_count(queue); queue_index++) {
+    Dependency_Node *node = graph->nodes[queue[queue_index]];
+    for (u32 i = 0; i < sb_count(node->included_by); i++) {
+      i32 parent_index = node->included_by[i];
+      Dependency_Node *parent = graph->nodes[parent_index];
+      if (parent->schedule_id != schedule_id) {
+        parent->schedule_id = schedule_id;
+        parent->pending = sb_count(affected);
+        sb_push(affected, parent_index);
+        sb_push(queue, parent_index);
+      }
+    }
+  }
+  
+  i32 affected_count = sb_count(affected);
+  if (affected_count) {
+    Tarjan_State s = {
+      .graph = graph,
+      .affected = affected,
+      .stack = sb_new(i32, 64),
+      .index = scratch_push_array(i32, affected_count),
+      .low_link = scratch_push_array(i32, affected_count),
+      .on_stack = scratch_push_array(bool, affected_count),
+    };
+    for (i32 i = 0; i < affected_count; i++) {
+      s.index[i] = -1;
+      s.on_stack[i] = false;
+    }
+    // the root is already parsed, so it is never waited on
+    root->schedule_id = 0;
+    for (i32 i = 0; i < affected_count; i++) {
+      if (s.index[i] < 0) {
+        dependency_strong_connect(&s, i);
+      }
+    }
+    
+    for (i32 i = 0; i < affected_count; i++) {
+      Dependency_Node *node = graph->nodes[affected[i]];
+      node->pending = 0;
+      for (u32 j = 0; j < sb_count(node->includes); j++) {
+        Dependency_Node *include = graph->nodes[node->includes[j]];
+        if (include->schedule_id == schedule_id &&
+            include->component != node->component)
+        {
+          node->pending++;
+        }
+      }
+      if (node->pending == 0) {
+        Dependency_Job job = { .node_index = affected[i], .schedule_id = schedule_id };
+        sb_push(graph->ready, job);
+      }
+    }
+    
+    dependency_launch_workers(editor);
+  }
+  
+  pop_context();
+  dependency_unlock(graph);
+  end_profiler_function();
+}
@@ -0,0 +1,48 @@
+#ifndef DEPENDENCY_H
+#include "lvl5_types.h"
+#include "lvl5_string.h"
+
+typedef struct {
+  String path;
+  i32 buffer_index; // -1 if the file is not open
+  
+  i32 *includes;
+  i32 *included_by;
+  
+  // NOTE(lvl5): only valid while a reparse pass with this schedule_id is running
+  i32 schedule_id;
+  i32 pending;
+  i32 component;
+} Dependency_Node;
+
+typedef struct {
+  String key;
+  String resolved;
+  bool found;
+} Include_Cache_Entry;
+
+typedef struct {
+  i32 node_index;
+  i32 schedule_id;
+} Dependency_Job;
+
+typedef struct {
+  Dependency_Node **nodes;
+  
+  // path -> node_index + 1, 0 is empty
+  i32 *node_table;
+  u32 node_table_capacity;
+  
+  Include_Cache_Entry *include_cache;
+  u32 include_cache_capacity;
+  u32 include_cache_count;
+  String *include_dirs;
+  
+  Dependency_Job *ready;
+  i32 schedule_id;
+  volatile long worker_count;
+  volatile long lock;
+} Dependency_Graph;
+
+#define DEPENDENCY_H
+#endif
@@ -1,5 +1,7 @@
 #include "editor.h"
 #include "layout.c"
+#include "symbol_index.c"
+#include "search.c"
 
 
 Keybind *get_keybind(Editor *editor, os_Keycode keycode, 
@@ -36,6 +38,8 @@ Buffer *open_file_into_new_buffer(Os os, Editor *editor, String path)
   os.close_file(file);
   
   String str = make_string(file_memory, file_size);
+  // NOTE(lvl5): anything that isn't valid utf-8 is shown byte by byte, so it round-trips
+  buffer->is_utf8 = utf8_validate(file_memory, file_size);
   buffer_insert_string(buffer, str);
   free_memory(file_memory);
   
@@ -46,6 +50,92 @@ Buffer *open_file_into_new_buffer(Os os, Editor *editor, String path)
   return inserted;
 }
 
+void editor_open_location(Editor *editor, Panel *panel, String path, i32 pos) {
+  Buffer *target = get_existing_buffer(editor, path);
+  if (!target) {
+    target = open_file_into_new_buffer(global_os, editor, path);
+  }
+  
+  set_cursor(target, min(pos, target->count - 1));
+  panel->type = Panel_Type_BUFFER;
+  panel->buffer_view = (Buffer_View){
+    .buffer = target,
+  };
+}
+
+bool editor_input_is_focused(Editor *editor, Buffer_View *input_view) {
+  bool result = ui_ids_equal(editor->layout.interactive, (ui_Id){input_view});
+  return result;
+}
+
+bool editor_text_input_is_focused(Editor *editor) {
+  bool result =
+    (editor->search.open && editor_input_is_focused(editor, &editor->search.input_view)) ||
+    (editor->find_open && (editor_input_is_focused(editor, &editor->find_input_view) ||
+                           editor_input_is_focused(editor, &editor->replace_input_view))) ||
+    (editor->symbol_picker_open &&
+     editor_input_is_focused(editor, &editor->symbol_input_view));
+  return result;
+}
+
+void editor_close_file_list(Editor *editor) {
+  if (editor->files) {
+    push_system_context();
+    for (u32 i = 0; i < sb_count(editor->files); i++) {
+      free_memory(editor->files[i].data);
+    }
+    sb_free(editor->files);
+    pop_context();
+  }
+  editor->files = null;
+  editor->file_dialog_open = false;
+  editor->selected_file_name = (String){0};
+}
+
+#define SYMBOL_PICKER_MAX_ROWS 200
+
+// NOTE(lvl5): asked again every time instead of kept, the strings point into the
+// index and symbol_index_poll can swap it. uses the current allocator
+Symbol_Location *editor_get_picker_symbols(Editor *editor) {
+  Symbol_Location *result = null;
+  if (editor->symbol_picker_exact) {
+    result = symbol_index_find(&editor->symbols, editor->symbol_picker_name);
+  } else {
+    String prefix = buffer_part_to_string(&editor->symbol_input, 0,
+                                          editor->symbol_input.count - 1);
+    result = symbol_index_search(&editor->symbols, prefix, SYMBOL_PICKER_MAX_ROWS);
+  }
+  return result;
+}
+
+void editor_close_symbol_picker(Editor *editor) {
+  if (editor->symbol_picker_name.data) {
+    push_system_context();
+    free_memory(editor->symbol_picker_name.data);
+    pop_context();
+  }
+  editor->symbol_picker_name = (String){0};
+  editor->symbol_picker_open = false;
+  if (editor_input_is_focused(editor, &editor->symbol_input_view)) {
+    editor->layout.interactive = INVALID_UI_ID;
+  }
+}
+
+void editor_open_symbol_picker(Editor *editor, String name, bool exact) {
+  editor_close_symbol_picker(editor);
+  editor->symbol_picker_open = true;
+  editor->symbol_picker_exact = exact;
+  if (exact) {
+    push_system_context();
+    editor->symbol_picker_name = alloc_string(name.data, name.count);
+    pop_context();
+  }
+  editor->symbol_list = (ui_List){0};
+  editor->layout.interactive = exact
+    ? INVALID_UI_ID
+    : (ui_Id){&editor->symbol_input_view};
+}
+
 void execute_command(Editor *editor, Renderer *renderer, Command command) {
   begin_profiler_function();
   Font *font = renderer->state.font;
@@ -61,6 +151,102 @@ void execute_command(Editor *editor, Renderer *renderer, Command command) {
     } break;
   }
   
+  // NOTE(lvl5): the file lister takes the arrows and enter while it is open,
+  // unless a text box has focus
+  if (editor->files && editor->file_dialog_open &&
+      !editor_text_input_is_focused(editor))
+  {
+    if (command == Command_MOVE_CURSOR_UP) {
+      command = Command_LISTER_MOVE_UP;
+    } else if (command == Command_MOVE_CURSOR_DOWN) {
+      command = Command_LISTER_MOVE_DOWN;
+    } else if (command == Command_NEWLINE) {
+      command = Command_NONE;
+      i32 selected = editor->file_list.selected;
+      if (selected >= 0 && selected < (i32)sb_count(editor->files)) {
+        editor->selected_file_name = editor->files[selected];
+        command = Command_FILE_OPEN;
+      }
+    }
+  }
+  
+  // NOTE(lvl5): the symbol picker takes the arrows and enter while its box has focus,
+  // or always when it lists definitions, which has no box
+  if (editor->symbol_picker_open &&
+      (editor->symbol_picker_exact ||
+       editor_input_is_focused(editor, &editor->symbol_input_view)))
+  {
+    if (command == Command_MOVE_CURSOR_UP || command == Command_MOVE_CURSOR_DOWN ||
+        command == Command_NEWLINE)
+    {
+      push_scratch_context();
+      Symbol_Location *locations = editor_get_picker_symbols(editor);
+      pop_context();
+      i32 count = sb_count(locations);
+      
+      if (command == Command_NEWLINE) {
+        i32 selected = editor->symbol_list.selected;
+        if (selected >= 0 && selected < count) {
+          Symbol_Location location = locations[selected];
+          editor_close_symbol_picker(editor);
+          editor_open_location(editor, panel, location.path, location.pos);
+        }
+      } else {
+        ui_list_move(&editor->symbol_list, count,
+                     command == Command_MOVE_CURSOR_DOWN ? 1 : -1);
+      }
+      command = Command_NONE;
+    }
+  }
+  
+  // NOTE(lvl5): editing commands go to the search and find boxes while they have focus
+  if (editor->symbol_picker_open &&
+      editor_input_is_focused(editor, &editor->symbol_input_view)) {
+    buffer = &editor->symbol_input;
+  } else if (editor->search.open &&
+      editor_input_is_focused(editor, &editor->search.input_view)) {
+    buffer = &editor->search.input;
+    if (command == Command_NEWLINE) {
+      command = Command_NONE;
+      Search_Index *search = &editor->search;
+      search_lock(search);
+      bool has_result = sb_count(search->results) > 0;
+      Search_Result result = has_result ? search->results[0] : (Search_Result){0};
+      String path = has_result ? search->files[result.file_index]->path : (String){0};
+      search_unlock(search);
+      
+      if (has_result) {
+        editor_open_location(editor, panel, path, result.pos);
+        search->open = false;
+        editor->layout.interactive = INVALID_UI_ID;
+      }
+    }
+  } else if (editor->find_open &&
+             editor_input_is_focused(editor, &editor->find_input_view)) {
+    Buffer *target = buffer;
+    buffer = &editor->find_input;
+    if (command == Command_NEWLINE) {
+      command = Command_NONE;
+      if (target) {
+        i32 next = buffer_find_next(target, target->cursor);
+        if (next >= 0) {
+          set_cursor(target, next);
+        }
+      }
+    }
+  } else if (editor->find_open &&
+             editor_input_is_focused(editor, &editor->replace_input_view)) {
+    Buffer *target = buffer;
+    buffer = &editor->replace_input;
+    if (command == Command_NEWLINE) {
+      command = Command_NONE;
+      if (target) {
+        buffer_replace_all(target, buffer_part_to_string(&editor->replace_input, 0,
+                                                         editor->replace_input.count - 1));
+      }
+    }
+  }
+  
   switch (command) {
     case Command_SET_MARK: {
       buffer->mark = buffer->cursor;
@@ -69,10 +255,21 @@ void execute_command(Editor *editor, Renderer *renderer, Command command) {
       buffer_copy(buffer, &editor->exchange);
     } break;
     case Command_PASTE: {
-      buffer_paste(buffer, &editor->exchange);
+      Cursor_Iterator it = buffer_cursors_begin(buffer);
+      while (buffer_cursors_next(&it)) {
+        buffer_paste(buffer, &editor->exchange);
+      }
+      buffer_cursors_end(&it);
     } break;
     case Command_CUT: {
-      buffer_cut(buffer, &editor->exchange);
+      // NOTE(lvl5): the main cursor's selection goes to the clipboard,
+      // every cursor's selection gets removed
+      buffer_copy(buffer, &editor->exchange);
+      Cursor_Iterator it = buffer_cursors_begin(buffer);
+      while (buffer_cursors_next(&it)) {
+        buffer_remove_selection(buffer);
+      }
+      buffer_cursors_end(&it);
     } break;
     
     case Command_MOVE_CURSOR_WORD_START:
@@ -82,49 +279,131 @@ void execute_command(Editor *editor, Renderer *renderer, Command command) {
     case Command_MOVE_CURSOR_RIGHT:
     case Command_MOVE_CURSOR_UP:
     case Command_MOVE_CURSOR_DOWN:
-    case Command_MOVE_CURSOR_LEFT: {
-      move_cursor_direction(font, buffer, command);
-    } break;
-    
-    case Command_LISTER_MOVE_DOWN:
-    case Command_LISTER_MOVE_UP: {
-#if 0
-      File_Dialog;
-      
-      i32 count = (i32)sb_count(lister->items);
-      if (command == Command_LISTER_MOVE_DOWN) {
-        lister->index++;
-        if (lister->index >= count) lister->index = 0;
-      } else if (command == Command_LISTER_MOVE_UP) {
-        lister->index--;
-        if (lister->index < 0) lister->index = count-1;
+    case Command_MOVE_CURSOR_LEFT:
+    case Command_REMOVE_BACKWARD:
+    case Command_REMOVE_FORWARD:
+    case Command_NEWLINE:
+    case Command_TAB: {
+      // NOTE(lvl5): these run at every cursor, as one edit
+      Cursor_Iterator it = buffer_cursors_begin(buffer);
+      while (buffer_cursors_next(&it)) {
+        switch (command) {
+          case Command_REMOVE_BACKWARD: {
+            buffer_remove_backward(buffer, buffer->cursor -
+                                   buffer_prev_codepoint(buffer, buffer->cursor));
+          } break;
+          case Command_REMOVE_FORWARD: {
+            buffer_remove_forward(buffer, buffer_next_codepoint(buffer, buffer->cursor) -
+                                  buffer->cursor);
+          } break;
+          case Command_NEWLINE: {
+            buffer_newline(buffer);
+          } break;
+          case Command_TAB: {
+            buffer_indent(buffer);
+          } break;
+          default: {
+            move_cursor_direction(font, buffer, command);
+          } break;
+        }
       }
-#endif
+      buffer_cursors_end(&it);
     } break;
     
-    case Command_REMOVE_BACKWARD: {
-      buffer_remove_backward(buffer, 1);
+    case Command_ADD_CURSOR_ABOVE: {
+      buffer_add_cursor_vertical(font, buffer, Command_MOVE_CURSOR_UP);
     } break;
-    case Command_REMOVE_FORWARD: {
-      buffer_remove_forward(buffer, 1);
+    case Command_ADD_CURSOR_BELOW: {
+      buffer_add_cursor_vertical(font, buffer, Command_MOVE_CURSOR_DOWN);
     } break;
-    case Command_NEWLINE: {
-      buffer_newline(buffer);
+    case Command_ADD_CURSORS_AT_MATCHES: {
+      buffer_add_cursors_at_matches(buffer);
     } break;
-    case Command_TAB: {
-      buffer_indent(buffer);
+    case Command_CLEAR_CURSORS: {
+      buffer_clear_cursors(buffer);
+    } break;
+    
+    case Command_SAVE_BUFFER: {
+      // the input boxes take buffer over, but it's the panel's buffer that gets saved
+      Buffer *target = buffer_view ? buffer_view->buffer : null;
+      if (target) {
+        String text = buffer_part_to_string(target, 0, target->count - 1);
+        if (global_os.write_entire_file(target->path, text.data, text.count)) {
+          symbol_index_rebuild(editor);
+        }
+      }
+    } break;
+    
+    case Command_SCREENSHOT: {
+      renderer->capture = true;
+    } break;
+    
+    case Command_LISTER_MOVE_DOWN:
+    case Command_LISTER_MOVE_UP: {
+      if (editor->files) {
+        i32 count = (i32)sb_count(editor->files);
+        ui_list_move(&editor->file_list, count, command == Command_LISTER_MOVE_DOWN ? 1 : -1);
+      }
     } break;
+    
     case Command_OPEN_FILE_DIALOG: {
+      editor_close_file_list(editor);
+      
       Context *cur = get_context();
       Context system_ctx = *cur;
       system_ctx.allocator = system_allocator;
       push_context(system_ctx);
       
       editor->files = global_os.get_file_names(editor->path);
+      editor->file_list = (ui_List){
+        .selected = -1,
+      };
       
       pop_context();
     } break;
     
+    case Command_GO_TO_DEFINITION: {
+      push_scratch_context();
+      String name = buffer_get_identifier_at(buffer, buffer->cursor);
+      Symbol_Location *locations = symbol_index_find(&editor->symbols, name);
+      pop_context();
+      
+      if (name.count && sb_count(locations) == 1) {
+        Symbol_Location location = locations[0];
+        editor_open_location(editor, panel, location.path, location.pos);
+      } else if (name.count && sb_count(locations) > 1) {
+        editor_open_symbol_picker(editor, name, true);
+      }
+    } break;
+    
+    case Command_SEARCH_SYMBOLS: {
+      if (editor->symbol_picker_open) {
+        editor_close_symbol_picker(editor);
+      } else {
+        editor_open_symbol_picker(editor, (String){0}, false);
+      }
+    } break;
+    
+    case Command_FIND: {
+      editor->find_open = !editor->find_open;
+      editor->layout.interactive = editor->find_open
+        ? (ui_Id){&editor->find_input_view}
+        : INVALID_UI_ID;
+      
+      Panel *active = editor->panels + editor->active_panel_index;
+      if (!editor->find_open && active->type == Panel_Type_BUFFER) {
+        buffer_find_set_query(active->buffer_view.buffer, (String){0}, false, 0, 0);
+      }
+    } break;
+    
+    case Command_SEARCH_PROJECT: {
+      Search_Index *search = &editor->search;
+      search->open = !search->open;
+      editor->layout.interactive = search->open
+        ? (ui_Id){&search->input_view}
+        : INVALID_UI_ID;
+    } break;
+    
     case Command_FILE_OPEN: {
       String file_name = editor->selected_file_name;
       if (string_compare(const_string(".."), file_name)) {
@@ -142,6 +421,8 @@ void execute_command(Editor *editor, Renderer *renderer, Command command) {
           .buffer = buffer,
         };
       }
+      // the file name points into the list, so it goes last
+      editor_close_file_list(editor);
     } break;
   }
   end_profiler_function();
@@ -198,12 +479,10 @@ extern void editor_update(Os os, Editor_Memory *memory, os_Input *input) {
     
     
     
-    state->font = os.load_font(const_string("fonts/inconsolata.ttf"), 
-                               const_string("Inconsolata"),
-                               26);
+    state->font = renderer_load_font(const_string("fonts/inconsolata.ttf"), 26);
     
     V2 window_size = os.get_window_size(memory->window);
-    init_renderer(os.gl, renderer, shader, &state->font, window_size);
+    init_renderer(os.gl, renderer, Render_Backend_OPENGL, shader, &state->font, window_size);
     
     
     Editor *editor = &state->editor;
@@ -216,6 +495,31 @@ extern void editor_update(Os os, Editor_Memory *memory, os_Input *input) {
       editor->layout = make_layout(renderer, input, editor);
       editor->path = const_string("src");
       
+      dependency_graph_init(&editor->deps);
+      dependency_graph_add_include_dir(&editor->deps, editor->path);
+      
+      symbol_index_init(&editor->symbols, const_string("symbols.index"));
+      symbol_index_rebuild(editor);
+      
+      search_init(&editor->search);
+      search_refresh(editor);
+      
+      editor->find_input = buffer_make_empty();
+      editor->find_input_view = (Buffer_View){
+        .buffer = &editor->find_input,
+        .is_single_line = true,
+      };
+      editor->replace_input = buffer_make_empty();
+      editor->replace_input_view = (Buffer_View){
+        .buffer = &editor->replace_input,
+        .is_single_line = true,
+      };
+      editor->symbol_input = buffer_make_empty();
+      editor->symbol_input_view = (Buffer_View){
+        .buffer = &editor->symbol_input,
+        .is_single_line = true,
+      };
+      
       Buffer *buffer = editor_add_buffer(editor, const_string("<scratch>"));
       
       
@@ -324,12 +628,73 @@ extern void editor_update(Os os, Editor_Memory *memory, os_Input *input) {
                        .command = Command_TAB,
                        .keycode = os_Keycode_TAB,
                        }));
+    sb_push(keybinds, ((Keybind){
+                       .views = Panel_Type_BUFFER,
+                       .command = Command_ADD_CURSOR_ABOVE,
+                       .keycode = os_Keycode_ARROW_UP,
+                       .ctrl = true,
+                       .alt = true,
+                       }));
+    sb_push(keybinds, ((Keybind){
+                       .views = Panel_Type_BUFFER,
+                       .command = Command_ADD_CURSOR_BELOW,
+                       .keycode = os_Keycode_ARROW_DOWN,
+                       .ctrl = true,
+                       .alt = true,
+                       }));
+    sb_push(keybinds, ((Keybind){
+                       .views = Panel_Type_BUFFER,
+                       .command = Command_ADD_CURSORS_AT_MATCHES,
+                       .keycode = 'L',
+                       .ctrl = true,
+                       .shift = true,
+                       }));
+    sb_push(keybinds, ((Keybind){
+                       .views = Panel_Type_BUFFER,
+                       .command = Command_CLEAR_CURSORS,
+                       .keycode = os_Keycode_ESCAPE,
+                       }));
+    sb_push(keybinds, ((Keybind){
+                       .views = Panel_Type_BUFFER,
+                       .command = Command_SCREENSHOT,
+                       .keycode = os_Keycode_F9,
+                       }));
     sb_push(keybinds, ((Keybind){
                        .views = Panel_Type_BUFFER,
                        .command = Command_OPEN_FILE_DIALOG,
                        .keycode = 'O',
                        .ctrl = true,
                        }));
+    sb_push(keybinds, ((Keybind){
+                       .views = Panel_Type_BUFFER,
+                       .command = Command_SAVE_BUFFER,
+                       .keycode = 'S',
+                       .ctrl = true,
+                       }));
+    sb_push(keybinds, ((Keybind){
+                       .views = Panel_Type_BUFFER,
+                       .command = Command_GO_TO_DEFINITION,
+                       .keycode = os_Keycode_F12,
+                       }));
+    sb_push(keybinds, ((Keybind){
+                       .views = Panel_Type_BUFFER,
+                       .command = Command_FIND,
+                       .keycode = 'F',
+                       .ctrl = true,
+                       }));
+    sb_push(keybinds, ((Keybind){
+                       .views = Panel_Type_BUFFER,
+                       .command = Command_SEARCH_PROJECT,
+                       .keycode = 'F',
+                       .ctrl = true,
+                       .shift = true,
+                       }));
+    sb_push(keybinds, ((Keybind){
+                       .views = Panel_Type_BUFFER,
+                       .command = Command_SEARCH_SYMBOLS,
+                       .keycode = 'T',
+                       .ctrl = true,
+                       }));
 #if 0
     sb_push(keybinds, ((Keybind){
                        .views = Panel_Type_FILE_DIALOG_OPEN,
@@ -364,6 +729,7 @@ extern void editor_update(Os os, Editor_Memory *memory, os_Input *input) {
     monokai.colors[Syntax_NUMBER] = monokai.colors[Syntax_MACRO];
     monokai.colors[Syntax_STRING] = 0xFFE6DB74;
     monokai.colors[Syntax_ENUM_MEMBER] = monokai.colors[Syntax_STRING];
+    monokai.colors[Syntax_FIND_MATCH] = 0xFF5B5A4A;
     editor->settings.theme = monokai;
     
     
@@ -390,16 +756,29 @@ extern void editor_update(Os os, Editor_Memory *memory, os_Input *input) {
   
   
   os.collect_messages(memory->window, input);
+  symbol_index_poll(editor);
   
-  
+  // NOTE(lvl5): a frame with input always gets one more after it, because the ui
+  // only sees a click while it is being built, after the part it changes was drawn
+  bool had_input = memory->reloaded || input->char_count > 0 ||
+    input->mouse.left.went_down || input->mouse.left.went_up ||
+    input->mouse.right.went_down || input->mouse.right.went_up ||
+    input->mouse.wheel != 0 ||
+    !v2_equal(input->mouse.p, state->last_mouse_p);
+  state->last_mouse_p = input->mouse.p;
   
   os_Event event;
   while (os.pop_event(&event)) {
+    had_input = true;
     switch (event.type) {
       case os_Event_Type_FOCUS: {
         input->shift = false;
         input->ctrl = false;
         input->alt = false;
+        
+        // NOTE(lvl5): files might have been changed by something else
+        dependency_graph_clear_include_cache(&editor->deps);
+        search_refresh(editor);
       } break;
       
       case os_Event_Type_CLOSE: {
@@ -430,7 +809,14 @@ extern void editor_update(Os os, Editor_Memory *memory, os_Input *input) {
     }
   }
   
-  
+  // NOTE(lvl5): when nothing changed there is nothing to draw,
+  // and main.c sleeps until the next message
+  memory->drawn = had_input || memory->busy;
+  if (!memory->drawn) {
+    pop_context();
+    return;
+  }
+  bool find_pending = false;
   
   
   // NOTE(lvl5): draw layout
@@ -443,6 +829,9 @@ extern void editor_update(Os os, Editor_Memory *memory, os_Input *input) {
   render_clip(renderer, rect2_min_size(v2(-ws.x*0.5f, -ws.y*0.5f), ws));
   
   ui_Layout *l = &editor->layout;
+  bool open_selected_file = false;
+  Symbol_Location picked_symbol = {0};
+  bool symbol_picked = false;
   ui_begin(l);
   
   ui_flex_begin(l, (Style){ 
@@ -461,7 +850,7 @@ extern void editor_update(Os os, Editor_Memory *memory, os_Input *input) {
       ui_dropdown_menu_begin(l, const_string("file"), (Style){0}); {
         draw_command_button(l, const_string("new"), Command_OPEN_FILE_DIALOG);
         draw_command_button(l, const_string("open"), Command_OPEN_FILE_DIALOG);
-        ui_button(l, const_string("save"), button_box);
+        draw_command_button(l, const_string("save"), Command_SAVE_BUFFER);
         ui_button(l, const_string("exit"), button_box);
         
         ui_dropdown_menu_begin(l, const_string("settings"), (Style){
@@ -493,7 +882,8 @@ extern void editor_update(Os os, Editor_Memory *memory, os_Input *input) {
     } ui_menu_bar_end(l);
     
     
-    // NOTE(lvl5): file lister
+    // NOTE(lvl5): file lister. opening a file closes it and frees the names,
+    // so that waits until the rows are drawn
     if (editor->files) {
       if (!editor->file_dialog_open) {
         editor->file_dialog_open = true;
@@ -512,12 +902,184 @@ extern void editor_update(Os os, Editor_Memory *memory, os_Input *input) {
                     .height = (f32)l->renderer->state.font->line_height + 5,
                     });
       
-      for (u8 i = 0; i < sb_count(editor->files); i++) {
-        if (ui_button(l, editor->files[i], button_box)) {
+      i32 first, end;
+      ui_list_begin(l, &editor->file_list, sb_count(editor->files), 20,
+                    (f32)l->renderer->state.font->line_height, (Style){
+                    .flags = ui_ALIGN_STRETCH,
+                    .width = ui_SIZE_STRETCH,
+                    }, &first, &end);
+      for (i32 i = first; i < end; i++) {
+        if (ui_list_row(l, &editor->file_list, i, editor->files[i], button_box)) {
           editor->selected_file_name = editor->files[i];
-          execute_command(l->editor, l->renderer, Command_FILE_OPEN);
+          open_selected_file = true;
+        }
+      }
+      ui_list_end(l);
+      
+      ui_flex_end(l);
+    }
+    
+    // NOTE(lvl5): find in buffer
+    if (editor->find_open) {
+      Panel *active = editor->panels + editor->active_panel_index;
+      
+      ui_flex_begin(l, (Style){
+                    .flags = ui_IGNORE_LAYOUT|ui_ALIGN_STRETCH,
+                    .layer = 2,
+                    .width = px(500),
+                    .bg_color = 0xFF222222,
+                    });
+      ui_input_buffer(l, &editor->find_input_view, &editor->find_input_scroll, (Style){
+                      .bg_color = editor->settings.theme.colors[Syntax_BACKGROUND],
+                      .width = ui_SIZE_STRETCH,
+                      .height = (f32)l->renderer->state.font->line_height + 5,
+                      });
+      ui_input_buffer(l, &editor->replace_input_view, &editor->replace_input_scroll, (Style){
+                      .bg_color = editor->settings.theme.colors[Syntax_BACKGROUND],
+                      .width = ui_SIZE_STRETCH,
+                      .height = (f32)l->renderer->state.font->line_height + 5,
+                      });
+      
+      String regex_label = editor->find_regex
+        ? const_string("regex: on")
+        : const_string("regex: off");
+      if (ui_button(l, regex_label, button_box)) {
+        editor->find_regex = !editor->find_regex;
+      }
+      
+      if (active->type == Panel_Type_BUFFER) {
+        Buffer_View *view = &active->buffer_view;
+        Buffer *buffer = view->buffer;
+        String query = buffer_part_to_string(&editor->find_input, 0,
+                                             editor->find_input.count - 1);
+        if (!string_compare(query, buffer->find.query) ||
+            editor->find_regex != buffer->find.is_regex) {
+          buffer_find_set_query(buffer, query, editor->find_regex,
+                                view->visible_start, view->visible_end);
+        }
+        
+        if (ui_button(l, const_string("replace all (enter)"), button_box)) {
+          buffer_replace_all(buffer, buffer_part_to_string(&editor->replace_input, 0,
+                                                           editor->replace_input.count - 1));
+        }
+        bool done = buffer_find_step(buffer);
+        find_pending = !done;
+        
+        if (buffer->find.is_regex && buffer->find.query.count &&
+            !buffer->find.regex.valid) {
+          ui_label(l, const_string("invalid pattern"), button_box);
+        } else {
+          char count_str[64];
+          sprintf_s(count_str, 64, done ? "%d matches" : "%d matches...",
+                    buffer_find_match_count(buffer));
+          String count_label = from_c_string(count_str);
+          ui_label(l, alloc_string(count_label.data, count_label.count), button_box);
+        }
+      }
+      
+      ui_flex_end(l);
+    }
+    
+    // NOTE(lvl5): project search
+    if (editor->search.open) {
+      Search_Index *search = &editor->search;
+      
+      ui_flex_begin(l, (Style){
+                    .flags = ui_IGNORE_LAYOUT|ui_ALIGN_STRETCH,
+                    .layer = 2,
+                    .width = px(900),
+                    .bg_color = 0xFF222222,
+                    });
+      ui_input_buffer(l, &search->input_view, &search->input_scroll, (Style){
+                      .bg_color = editor->settings.theme.colors[Syntax_BACKGROUND],
+                      .width = ui_SIZE_STRETCH,
+                      .height = (f32)l->renderer->state.font->line_height + 5,
+                      });
+      
+      // NOTE(lvl5): shares the regex toggle with find in buffer
+      String regex_label = editor->find_regex
+        ? const_string("regex: on")
+        : const_string("regex: off");
+      if (ui_button(l, regex_label, button_box)) {
+        editor->find_regex = !editor->find_regex;
+      }
+      
+      String query = buffer_part_to_string(&search->input, 0, search->input.count - 1);
+      if (!string_compare(query, search->query) ||
+          editor->find_regex != search->is_regex) {
+        search_start(editor, query, editor->find_regex);
+      }
+      if (search->is_regex && search->query.count && !search->regex_valid) {
+        ui_label(l, const_string("invalid pattern"), button_box);
+      }
+      
+      // NOTE(lvl5): results keep coming in from the workers, copy what we show
+      // so the lock isn't held while drawing
+      search_lock(search);
+      i32 shown_count = min((i32)sb_count(search->results), 40);
+      Search_Result *shown = scratch_push_array(Search_Result, shown_count);
+      copy_memory_slow(shown, search->results, shown_count*sizeof(Search_Result));
+      i32 total_count = sb_count(search->results);
+      search_unlock(search);
+      
+      for (i32 i = 0; i < shown_count; i++) {
+        if (ui_button(l, shown[i].text, button_box)) {
+          search_lock(search);
+          String path = search->files[shown[i].file_index]->path;
+          search_unlock(search);
+          
+          Panel *panel = editor->panels + editor->active_panel_index;
+          editor_open_location(editor, panel, path, shown[i].pos);
+          search->open = false;
+          l->interactive = INVALID_UI_ID;
+        }
+      }
+      if (total_count > shown_count) {
+        ui_label(l, const_string("..."), button_box);
+      }
+      
+      ui_flex_end(l);
+    }
+    
+    // NOTE(lvl5): symbol picker. picking closes it and frees the name the
+    // label points to, so that waits until the frame is drawn too
+    if (editor->symbol_picker_open) {
+      ui_flex_begin(l, (Style){
+                    .flags = ui_IGNORE_LAYOUT|ui_ALIGN_STRETCH,
+                    .layer = 2,
+                    .width = px(900),
+                    .bg_color = 0xFF222222,
+                    });
+      if (editor->symbol_picker_exact) {
+        ui_label(l, editor->symbol_picker_name, button_box);
+      } else {
+        ui_input_buffer(l, &editor->symbol_input_view, &editor->symbol_input_scroll, (Style){
+                        .bg_color = editor->settings.theme.colors[Syntax_BACKGROUND],
+                        .width = ui_SIZE_STRETCH,
+                        .height = (f32)l->renderer->state.font->line_height + 5,
+                        });
+      }
+      
+      Symbol_Location *locations = editor_get_picker_symbols(editor);
+      i32 count = sb_count(locations);
+      ui_List *list = &editor->symbol_list;
+      // the rows change as the prefix gets typed
+      list->selected = count ? clamp_i32(list->selected, 0, count - 1) : -1;
+      
+      i32 first, end;
+      ui_list_begin(l, list, count, 20, (f32)l->renderer->state.font->line_height, (Style){
+                    .flags = ui_ALIGN_STRETCH,
+                    .width = ui_SIZE_STRETCH,
+                    }, &first, &end);
+      for (i32 i = first; i < end; i++) {
+        String label = concat(concat(locations[i].name, const_string("  ")),
+                              locations[i].path);
+        if (ui_list_row(l, list, i, label, button_box)) {
+          picked_symbol = locations[i];
+          symbol_picked = true;
         }
       }
+      ui_list_end(l);
       
       ui_flex_end(l);
     }
@@ -551,6 +1113,21 @@ extern void editor_update(Os os, Editor_Memory *memory, os_Input *input) {
   ui_end(l);
   
   renderer_end_render(gl, renderer);
+  // NOTE(lvl5): the cpu rasterizer's version of the frame, to diff against
+  // older captures when the renderer changes
+  if (renderer->capture) {
+    renderer->capture = false;
+    bmp_save("screenshot.bmp", renderer->target);
+  }
+  if (open_selected_file) {
+    execute_command(editor, renderer, Command_FILE_OPEN);
+  }
+  if (symbol_picked) {
+    editor_close_symbol_picker(editor);
+    Panel *panel = editor->panels + editor->active_panel_index;
+    editor_open_location(editor, panel, picked_symbol.path, picked_symbol.pos);
+  }
+  memory->busy = had_input || renderer->animating || find_pending;
   
   pop_context();
   
@@ -4,6 +4,9 @@
 #include "renderer.h"
 #include "lvl5_stretchy_buffer.h"
 #include "layout.h"
+#include "dependency.h"
+#include "symbol_index.h"
+#include "search.h"
 
 typedef enum {
   Command_NONE,
@@ -28,6 +31,15 @@ typedef enum {
   Command_LISTER_MOVE_DOWN,
   Command_FILE_OPEN,
   Command_SAVE_BUFFER,
+  Command_GO_TO_DEFINITION,
+  Command_SEARCH_PROJECT,
+  Command_SEARCH_SYMBOLS,
+  Command_FIND,
+  Command_ADD_CURSOR_ABOVE,
+  Command_ADD_CURSOR_BELOW,
+  Command_ADD_CURSORS_AT_MATCHES,
+  Command_CLEAR_CURSORS,
+  Command_SCREENSHOT,
 } Command;
 
 typedef struct Color_Theme {
@@ -76,6 +88,7 @@ typedef struct Editor {
   String path;
   String *files;
   bool file_dialog_open;
+  ui_List file_list;
   String selected_file_name;
   
   Buffer *buffers;
@@ -86,6 +99,28 @@ typedef struct Editor {
   Exchange exchange;
   
   i32 generation;
+  Dependency_Graph deps;
+  Symbol_Index symbols;
+  Search_Index search;
+  
+  bool find_open;
+  bool find_regex;
+  Buffer find_input;
+  Buffer_View find_input_view;
+  V2 find_input_scroll;
+  Buffer replace_input;
+  Buffer_View replace_input_view;
+  V2 replace_input_scroll;
+  
+  // NOTE(lvl5): workspace symbols by prefix, or in exact mode
+  // the definitions of symbol_picker_name when there is more than one
+  bool symbol_picker_open;
+  bool symbol_picker_exact;
+  String symbol_picker_name;
+  Buffer symbol_input;
+  Buffer_View symbol_input_view;
+  V2 symbol_input_scroll;
+  ui_List symbol_list;
   ui_Layout layout;
 } Editor;
 
@@ -95,6 +130,7 @@ typedef struct {
   Renderer renderer;
   Font font;
   Editor editor;
+  V2 last_mouse_p;
 } App_State;
 
 
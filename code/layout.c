@@ -21,13 +21,78 @@ bool ui_id_valid(ui_Id id) {
   return result;
 }
 
+// NOTE(lvl5): ids are pointers, so the low bits are mostly alignment.
+// every bit gets mixed into the result
 u32 hash_ui_id(ui_Id id) {
-  u32 result = (id.bytes[0]) ^ (id.bytes[1] * 3) ^ (id.bytes[2] * 5) ^
-    (id.bytes[3] * 7) ^ (id.bytes[4] * 31) ^ (id.bytes[5] * 13) ^ (id.bytes[6] * 17)
-    ^ (id.bytes[7] * 23);
+  u64 x = (u64)id.ptr;
+  x ^= x >> 33;
+  x *= 0xFF51AFD7ED558CCD;
+  x ^= x >> 33;
+  x *= 0xC4CEB9FE1A85EC53;
+  x ^= x >> 33;
+  u32 result = (u32)x;
   return result;
 }
 
+u32 ui_find_item_slot(ui_Layout *layout, ui_Id id) {
+  u32 mask = layout->item_slot_capacity - 1;
+  u32 slot = hash_ui_id(id) & mask;
+  while (layout->item_slots[slot].generation == layout->generation &&
+         !ui_ids_equal(layout->item_slots[slot].id, id))
+  {
+    slot = (slot + 1) & mask;
+  }
+  return slot;
+}
+
+void ui_grow_item_index(ui_Layout *layout) {
+  ui_Item_Slot *old_slots = layout->item_slots;
+  u32 old_capacity = layout->item_slot_capacity;
+  
+  push_system_context();
+  layout->item_slot_capacity = old_capacity ? old_capacity*2 : 256;
+  layout->item_slots = alloc_array(ui_Item_Slot, layout->item_slot_capacity);
+  zero_memory_slow(layout->item_slots, sizeof(ui_Item_Slot)*layout->item_slot_capacity);
+  for (u32 i = 0; i < old_capacity; i++) {
+    if (old_slots[i].generation == layout->generation) {
+      layout->item_slots[ui_find_item_slot(layout, old_slots[i].id)] = old_slots[i];
+    }
+  }
+  if (old_slots) {
+    free_memory(old_slots);
+  }
+  pop_context();
+}
+
+// NOTE(lvl5): only finds items whose container has ended, see ui_flex_end
+ui_Item *ui_get_item_by_id(ui_Layout *layout, ui_Id id) {
+  ui_Item *result = null;
+  if (layout->item_slot_capacity && ui_id_valid(id)) {
+    ui_Item_Slot *slot = layout->item_slots + ui_find_item_slot(layout, id);
+    if (slot->generation == layout->generation) {
+      result = slot->item;
+    }
+  }
+  return result;
+}
+
+// NOTE(lvl5): with the same id twice, the first one stays
+void ui_index_item(ui_Layout *layout, ui_Item *item) {
+  if (ui_id_valid(item->id)) {
+    if ((layout->item_slot_count + 1)*2 > layout->item_slot_capacity) {
+      ui_grow_item_index(layout);
+    }
+    
+    ui_Item_Slot *slot = layout->item_slots + ui_find_item_slot(layout, item->id);
+    if (slot->generation != layout->generation) {
+      slot->id = item->id;
+      slot->item = item;
+      slot->generation = layout->generation;
+      layout->item_slot_count++;
+    }
+  }
+}
+
 bool ui_is_hot(ui_Layout *layout, ui_Id id) {
   bool result = ui_id_valid(id) && ui_ids_equal(layout->hot, id);
   return result;
@@ -55,28 +120,69 @@ void ui_set_active(ui_Layout *layout, ui_Id id) {
 void ui_set_interactive(ui_Layout *layout, ui_Id id) {
   layout->next_interactive = id;
 }
-u32 get_ui_state_index(ui_Layout *layout, ui_Id id) {
-  u32 hash = hash_ui_id(id);
-  u32 result = 0;
-  
-  while (true) {
-    hash = hash % array_count(layout->keys);
-    ui_Id key = layout->keys[hash];
-    
-    if (!layout->occupancy[hash]) {
-      result = hash;
-      break;
-    } else if (ui_ids_equal(key, id)) {
-      result = hash;
-      break;
-    } else {
-      hash++;
+u32 ui_find_state_slot(ui_State_Slot *states, u32 capacity, ui_Id id) {
+  u32 mask = capacity - 1;
+  u32 slot = hash_ui_id(id) & mask;
+  while (states[slot].last_used && !ui_ids_equal(states[slot].id, id)) {
+    slot = (slot + 1) & mask;
+  }
+  return slot;
+}
+
+void ui_free_state(ui_State *state) {
+  if (state->text_input) {
+    buffer_free(&state->text_input->buffer);
+    push_system_context();
+    free_memory(state->text_input);
+    pop_context();
+    state->text_input = null;
+  }
+}
+
+// NOTE(lvl5): drops the states that weren't used in LAYOUT_STATE_KEEP_FRAMES
+// and rehashes the rest. the table only grows when they still take up a quarter of it
+void ui_sweep_states(ui_Layout *layout) {
+  begin_profiler_function();
+  ui_State_Slot *old_states = layout->states;
+  u32 old_capacity = layout->state_capacity;
+  
+  u32 live_count = 0;
+  for (u32 i = 0; i < old_capacity; i++) {
+    ui_State_Slot *slot = old_states + i;
+    if (slot->last_used && layout->generation - slot->last_used < LAYOUT_STATE_KEEP_FRAMES) {
+      live_count++;
     }
   }
   
-  return result;
+  u32 capacity = old_capacity ? old_capacity : 256;
+  while ((live_count + 1)*4 > capacity) {
+    capacity *= 2;
+  }
+  
+  push_system_context();
+  layout->states = alloc_array(ui_State_Slot, capacity);
+  zero_memory_slow(layout->states, sizeof(ui_State_Slot)*capacity);
+  layout->state_capacity = capacity;
+  layout->state_count = live_count;
+  
+  for (u32 i = 0; i < old_capacity; i++) {
+    ui_State_Slot *slot = old_states + i;
+    if (slot->last_used) {
+      if (layout->generation - slot->last_used < LAYOUT_STATE_KEEP_FRAMES) {
+        layout->states[ui_find_state_slot(layout->states, capacity, slot->id)] = *slot;
+      } else {
+        ui_free_state(&slot->value);
+      }
+    }
+  }
+  if (old_states) {
+    free_memory(old_states);
+  }
+  pop_context();
+  end_profiler_function();
 }
 
+// NOTE(lvl5): the pointer is good until a new id is looked up, that can rebuild the table
 ui_State *layout_get_state_ex(ui_Layout *layout, ui_Id id, bool *exists) {
   begin_profiler_function();
   ui_State *result = null;
@@ -84,14 +190,25 @@ ui_State *layout_get_state_ex(ui_Layout *layout, ui_Id id, bool *exists) {
   *exists = false;
   
   if (ui_id_valid(id)) {
-    u32 index = get_ui_state_index(layout, id);
-    result = layout->values + index;
-    *exists = layout->occupancy[index];
+    if (!layout->state_capacity) {
+      ui_sweep_states(layout);
+    }
     
-    if (!layout->occupancy[index]) {
-      layout->keys[index] = id;
-      layout->occupancy[index] = true;
+    ui_State_Slot *slot = layout->states +
+      ui_find_state_slot(layout->states, layout->state_capacity, id);
+    if (slot->last_used) {
+      *exists = true;
+    } else {
+      if ((layout->state_count + 1)*2 > layout->state_capacity) {
+        ui_sweep_states(layout);
+        slot = layout->states + ui_find_state_slot(layout->states, layout->state_capacity, id);
+      }
+      slot->id = id;
+      slot->value = (ui_State){0};
+      layout->state_count++;
     }
+    slot->last_used = layout->generation;
+    result = &slot->value;
   }
   
   end_profiler_function();
@@ -105,14 +222,24 @@ ui_State *layout_get_state(ui_Layout *layout, ui_Id id) {
 }
 
 
+u32 ui_child_count(ui_Item *item) {
+  u32 result = item->children ? sb_count(item->children) : 0;
+  return result;
+}
+
+// NOTE(lvl5): most items are leaves, so children only get allocated for items that have some
 ui_Item *layout_get_item(ui_Layout *layout, Item_Type type, Style style) {
   begin_profiler_function();
   
+  ui_Item *parent = layout->current_container;
   ui_Item *result = null;
-  if (layout->current_container) {
-    u32 index = sb_count(layout->current_container->children);
-    sb_push(layout->current_container->children, (ui_Item){0});
-    result = layout->current_container->children + index;
+  if (parent) {
+    if (!parent->children) {
+      parent->children = sb_new(ui_Item, 8);
+    }
+    u32 index = sb_count(parent->children);
+    sb_push(parent->children, (ui_Item){0});
+    result = parent->children + index;
   } else {
     result = alloc_struct(ui_Item);
     ui_Item zero_item = {0};
@@ -120,9 +247,9 @@ ui_Item *layout_get_item(ui_Layout *layout, Item_Type type, Style style) {
   }
   
   result->style = style;
-  result->parent = layout->current_container;
+  result->parent = parent;
   result->type = type;
-  result->children = sb_new(ui_Item, 8);
+  result->layer = parent && parent->layer ? parent->layer : style.layer;
   if (style.width.unit == Unit_PIXELS) {
     result->size.x = style.width.value;
   }
@@ -167,7 +294,7 @@ V2 ui_flex_calc_auto_dim(ui_Item *item, i32 main_axis) {
   
   V2 result = v2_zero();
   for (u32 child_index = 0;
-       child_index < sb_count(item->children);
+       child_index < ui_child_count(item);
        child_index++) 
   {
     ui_Item *child = item->children + child_index;
@@ -192,6 +319,16 @@ void ui_flex_end(ui_Layout *layout) {
     layout->current_container = layout->current_container->parent;
   }
   
+  // NOTE(lvl5): the children are where they will stay for the frame now. their own
+  // children could still point at where they were before the array grew
+  for (u32 child_index = 0; child_index < ui_child_count(item); child_index++) {
+    ui_Item *child = item->children + child_index;
+    ui_index_item(layout, child);
+    for (u32 i = 0; i < ui_child_count(child); i++) {
+      child->children[i].parent = child;
+    }
+  }
+  
   bool is_horizontal = flag_is_set(item->style.flags, ui_HORIZONTAL);
   i32 main_axis = is_horizontal ? AXIS_X : AXIS_Y;
   
@@ -219,6 +356,22 @@ Style default_button_style() {
 }
 
 
+f32 ui_measure_text_width(ui_Layout *layout, String str) {
+  Font *font = layout->renderer->state.font;
+  u64 hash = hash_bytes_64(str.data, str.count);
+  if (!hash) {
+    hash = 1;
+  }
+  
+  ui_Text_Width *cached = layout->text_widths + (hash & (LAYOUT_TEXT_WIDTH_CACHE_SIZE - 1));
+  if (cached->hash != hash || cached->font != font) {
+    cached->hash = hash;
+    cached->font = font;
+    cached->width = measure_string_width(layout->renderer, str);
+  }
+  return cached->width;
+}
+
 V2 ui_compute_text_size(ui_Layout *layout, String str, Style style) {
   begin_profiler_function();
   
@@ -231,7 +384,7 @@ V2 ui_compute_text_size(ui_Layout *layout, String str, Style style) {
   
   if (style.width.value == ui_SIZE_AUTO) {
     assert(style.width.unit == Unit_PIXELS);
-    result.x = measure_string_width(layout->renderer, str) +
+    result.x = ui_measure_text_width(layout, str) +
       style.padding_right + style.padding_left;
   }
   
@@ -358,6 +511,78 @@ bool ui_button(ui_Layout *layout, String label, Style style) {
   return result;
 }
 
+void ui_list_move(ui_List *list, i32 count, i32 delta) {
+  if (count > 0) {
+    if (list->selected < 0) {
+      // nothing selected yet, down goes to the first row and up to the last
+      list->selected = delta > 0 ? -1 : 0;
+    }
+    list->selected = (list->selected + delta) % count;
+    if (list->selected < 0) {
+      list->selected += count;
+    }
+    list->selection_moved = true;
+  }
+}
+
+// NOTE(lvl5): rows first to end-1 are the ones to make with ui_list_row.
+// visible_rows sets the height, one more row is made for the one partly scrolled in
+void ui_list_begin(ui_Layout *layout, ui_List *list, i32 count, i32 visible_rows,
+                   f32 row_height, Style style, i32 *first, i32 *end)
+{
+  begin_profiler_function();
+  
+  style.flags |= ui_CLIP;
+  style.height = px(visible_rows*row_height);
+  ui_Item *item = ui_flex_begin_ex(layout, style, Item_Type_LIST);
+  item->list = list;
+  list->row_height = row_height;
+  
+  if (list->hovered) {
+    list->scroll_target -= layout->input->mouse.wheel*3;
+  }
+  if (list->selection_moved && list->selected >= 0) {
+    if (list->selected < list->scroll_target) {
+      list->scroll_target = (f32)list->selected;
+    } else if (list->selected >= list->scroll_target + visible_rows) {
+      list->scroll_target = (f32)(list->selected - visible_rows + 1);
+    }
+    list->selection_moved = false;
+  }
+  list->scroll_target = clamp_f32(list->scroll_target, 0, (f32)max(count - visible_rows, 0));
+  
+  // NOTE(lvl5): eases like the buffer scroll, and snaps once it is close
+  f32 distance = list->scroll_target - list->scroll;
+  if (distance != 0) {
+    list->scroll += abs_f32(distance) > 0.01f ? distance/4 : distance;
+    layout->renderer->animating = true;
+  }
+  
+  i32 first_row = floor_f32_i32(list->scroll);
+  *first = clamp_i32(first_row, 0, max(count - 1, 0));
+  *end = min(*first + visible_rows + 1, count);
+  list->offset = (list->scroll - first_row)*row_height;
+  
+  end_profiler_function();
+}
+
+bool ui_list_row(ui_Layout *layout, ui_List *list, i32 index, String label, Style style) {
+  style.height = px(list->row_height);
+  if (index == list->selected) {
+    style.bg_color = style.active_bg_color;
+  }
+  
+  bool result = ui_button(layout, label, style);
+  if (result) {
+    list->selected = index;
+  }
+  return result;
+}
+
+void ui_list_end(ui_Layout *layout) {
+  ui_flex_end(layout);
+}
+
 void ui_handle_buffer_input(ui_Layout *layout, Buffer *buffer) {
   begin_profiler_function();
   
@@ -365,13 +590,39 @@ void ui_handle_buffer_input(ui_Layout *layout, Buffer *buffer) {
   if (!input->ctrl && !input->alt) {
     if (input->char_count > 0) {
       String str = make_string(input->chars, input->char_count);
-      buffer_input_string(buffer, str);
+      Cursor_Iterator it = buffer_cursors_begin(buffer);
+      buffer_reserve(buffer, (i32)str.count*it.count);
+      while (buffer_cursors_next(&it)) {
+        buffer_input_string(buffer, str);
+      }
+      buffer_cursors_end(&it);
     }
   }
   
   end_profiler_function();
 }
 
+// NOTE(lvl5): like ui_input_text, but the buffer is owned by the caller
+void ui_input_buffer(ui_Layout *layout, Buffer_View *view, V2 *scroll, Style style) {
+  begin_profiler_function();
+  
+  ui_Id id = (ui_Id){view};
+  
+  style.flags |= ui_FOCUSABLE;
+  ui_Item *item = ui_buffer(layout, view, scroll, style);
+  item->id = id;
+  
+  if (ui_is_clicked(layout, id)) {
+    layout->interactive = id;
+  }
+  
+  if (ui_ids_equal(layout->interactive, id)) {
+    ui_handle_buffer_input(layout, view->buffer);
+  }
+  
+  end_profiler_function();
+}
+
 bool ui_panel(ui_Layout *layout, Panel *panel, Style style) {
   begin_profiler_function();
   
@@ -387,7 +638,12 @@ bool ui_panel(ui_Layout *layout, Panel *panel, Style style) {
   button_style.width.value = ui_SIZE_STRETCH;
   button_style.text_color = 0xFF222222;
   
-  ui_label(layout, panel->buffer_view.buffer->path, button_style);
+  Buffer *buffer = panel->buffer_view.buffer;
+  char position_str[32];
+  sprintf_s(position_str, 32, "  %d:%d",
+            buffer_get_line(buffer, buffer->cursor) + 1,
+            buffer_get_column(buffer, buffer->cursor) + 1);
+  ui_label(layout, concat(buffer->path, from_c_string(position_str)), button_style);
   
   Style buffer_style = style;
   buffer_style.width = px(ui_SIZE_STRETCH);
@@ -416,32 +672,11 @@ bool ui_panel(ui_Layout *layout, Panel *panel, Style style) {
 }
 
 
-ui_Item **ui_scratch_get_all_descendents(ui_Item *item) {
-  begin_profiler_function();
-  
-  push_scratch_context();
-  ui_Item **result = sb_new(ui_Item *, 64);
-  pop_context();
-  
-  ui_Item *stack[128];
-  i32 stack_count = 0;
-  stack[stack_count++] = item;
-  
-  while (stack_count) {
-    ui_Item *cur = stack[--stack_count];
-    
-    if (!flag_is_set(cur->style.flags, ui_HIDDEN)) {
-      for (u32 i = 0; i < sb_count(cur->children); i++) {
-        ui_Item *child = cur->children + i;
-        stack[stack_count++] = child;
-        assert(stack_count <= array_count(stack));
-      }
-      
-      sb_push(result, cur);
-    }
+bool ui_item_is_inside(ui_Item *item, ui_Item *ancestor) {
+  while (item && item != ancestor) {
+    item = item->parent;
   }
-  
-  end_profiler_function();
+  bool result = item != null;
   return result;
 }
 
@@ -455,29 +690,27 @@ void ui_widget_dropdown_menu(ui_Layout *layout, ui_Layout_Mode mode, ui_Item *it
       
       ui_State *state = layout_get_state(layout, item->id);
       
-      // NOTE(lvl5): close the menu if a button is clicked
+      // NOTE(lvl5): the contents are in the item index by now. only the active
+      // and the hot item can be clicked, so those are the only ones to look at
       ui_Item *dropdown = item->children + 1;
-      ui_Item **descendents = ui_scratch_get_all_descendents(dropdown);
-      for (u32 i = 0; i < sb_count(descendents); i++) {
-        ui_Item *child = descendents[i];
-        if (child->type == Item_Type_BUTTON) {
-          if (!flag_is_set(child->style.flags, ui_TOGGLE) && ui_is_clicked(layout, child->id)) 
-          {
-            state->open = false;
-            break;
-          }
-        }
+      bool is_open = !flag_is_set(dropdown->style.flags, ui_HIDDEN);
+      
+      // NOTE(lvl5): close the menu if a button is clicked
+      ui_Item *active = ui_get_item_by_id(layout, layout->active);
+      if (is_open && active && ui_item_is_inside(active, dropdown) &&
+          active->type == Item_Type_BUTTON &&
+          !flag_is_set(active->style.flags, ui_TOGGLE) &&
+          ui_is_clicked(layout, active->id))
+      {
+        state->open = false;
       }
       
       // NOTE(lvl5): close the menu if clicked outside of it
       bool clicked_outside = !ui_is_hot(layout, item->id);
       if (layout->input->mouse.left.went_up) {
-        for (u32 i = 0; i < sb_count(descendents); i++) {
-          ui_Item *child = descendents[i];
-          if (ui_is_hot(layout, child->id)) {
-            clicked_outside = false;
-            break;
-          }
+        ui_Item *hot = ui_get_item_by_id(layout, layout->hot);
+        if (is_open && hot && ui_item_is_inside(hot, dropdown)) {
+          clicked_outside = false;
         }
         if (clicked_outside) {
           state->open = false;
@@ -564,24 +797,28 @@ void ui_input_text(ui_Layout *layout, String str, Style style) {
   assert(ui_id_valid(id));
   
   
-  bool exists;
-  ui_State *state = layout_get_state_ex(layout, id, &exists);
-  if (!exists) {
-    state->panel.buffer = buffer_make_empty();
-    state->panel.buffer_view = (Buffer_View){
-      .buffer = &state->panel.buffer,
+  ui_State *state = layout_get_state(layout, id);
+  if (!state->text_input) {
+    push_system_context();
+    ui_Text_Input_State *input = alloc_struct(ui_Text_Input_State);
+    zero_memory_slow(input, sizeof(ui_Text_Input_State));
+    input->buffer = buffer_make_empty();
+    input->buffer_view = (Buffer_View){
+      .buffer = &input->buffer,
       .is_single_line = true,
     };
-    buffer_insert_string(&state->panel.buffer, const_string("test"));
+    buffer_insert_string(&input->buffer, const_string("test"));
+    pop_context();
+    state->text_input = input;
     //layout->interactive = id;
   }
-  state->panel.scroll = v2_zero();
+  ui_Text_Input_State *input = state->text_input;
+  input->scroll = v2_zero();
   
   style.flags |= ui_FOCUSABLE;
-  ui_Item *item = ui_buffer(layout, &state->panel.buffer_view,
-                            &state->panel.scroll, style);
+  ui_Item *item = ui_buffer(layout, &input->buffer_view, &input->scroll, style);
   item->id = id;
-  item->buffer_view = &state->panel.buffer_view;
+  item->buffer_view = &input->buffer_view;
   
   
   if (ui_is_clicked(layout, id)) {
@@ -604,7 +841,7 @@ void ui_flex_set_stretchy_children(ui_Item *item, i32 main_axis) {
   i32 stretch_count = 0;
   
   for (u32 child_index = 0;
-       child_index < sb_count(item->children);
+       child_index < ui_child_count(item);
        child_index++) 
   {
     ui_Item *child = item->children + child_index;
@@ -649,7 +886,7 @@ void ui_flex_set_stretchy_children(ui_Item *item, i32 main_axis) {
   V2 p = item->p;
   
   for (u32 child_index = 0;
-       child_index < sb_count(item->children);
+       child_index < ui_child_count(item);
        child_index++) 
   {
     ui_Item *child = item->children + child_index;
@@ -679,35 +916,15 @@ void ui_flex_set_stretchy_children(ui_Item *item, i32 main_axis) {
   end_profiler_function();
 }
 
-ui_Item *ui_get_item_by_id(ui_Layout *layout, ui_Id id) {
-  begin_profiler_function();
-  
-  ui_Item *root = layout->current_container;
-  while (root->parent) root = root->parent;
-  
-  ui_Item **descendents = ui_scratch_get_all_descendents(root);
-  
-  ui_Item *result = null;
-  for (u32 i = 0; i < sb_count(descendents); i++) {
-    if (ui_ids_equal(descendents[i]->id, id)) {
-      result = descendents[i];
-      break;
-    }
-  }
-  
-  end_profiler_function();
+// NOTE(lvl5): the outermost layer set above the item, or its own
+f32 ui_get_layer(ui_Item *item) {
+  f32 result = item->layer;
   return result;
 }
 
-f32 ui_get_layer(ui_Item *item) {
-  f32 layer = item->style.layer;
-  while (item->parent) {
-    item = item->parent;
-    if (item->style.layer) {
-      layer = item->style.layer;
-    }
-  }
-  return layer;
+void ui_set_hot_item(ui_Layout *layout, ui_Item *item) {
+  ui_set_hot(layout, item->id);
+  layout->next_hot_layer = ui_get_layer(item);
 }
 
 bool ui_mouse_in_rect(ui_Layout *layout, Rect2 rect) {
@@ -737,9 +954,8 @@ void ui_draw_item(ui_Layout *layout, ui_Item *item) {
   
   
   if (ui_id_valid(item->id) && ui_mouse_in_rect(layout, rect)) {
-    ui_Item *prev_hot = ui_get_item_by_id(layout, layout->next_hot);
-    if (ui_get_layer(item) >= ui_get_layer(prev_hot)) {
-      ui_set_hot(layout, item->id);
+    if (ui_get_layer(item) >= layout->next_hot_layer) {
+      ui_set_hot_item(layout, item);
     }
   }
   
@@ -769,6 +985,10 @@ void ui_draw_item(ui_Layout *layout, ui_Item *item) {
     case Item_Type_DROPDOWN_MENU: {
       ui_widget_dropdown_menu(layout, ui_Layout_Mode_DRAW, item);
     } break;
+    
+    case Item_Type_LIST: {
+      item->list->hovered = ui_mouse_in_rect(layout, rect);
+    } break;
   }
   
   
@@ -796,7 +1016,7 @@ ui_Item *ui_get_prev_focusable_item(ui_Item *item) {
     
     while (self_index == 0) {
       if (flag_is_set(cur->parent->style.flags, ui_FOCUS_TRAP)) {
-        self_index = sb_count(cur->parent->children);
+        self_index = ui_child_count(cur->parent);
       } else {
         cur = cur->parent;
         if (!cur->parent) goto end;
@@ -808,8 +1028,8 @@ ui_Item *ui_get_prev_focusable_item(ui_Item *item) {
     cur = sibling;
     
     if (!flag_is_set(cur->style.flags, ui_HIDDEN))  {
-      if (cur->children && sb_count(cur->children)) {
-        cur = cur->children + sb_count(cur->children) - 1;
+      if (ui_child_count(cur)) {
+        cur = cur->children + ui_child_count(cur) - 1;
       }
       
       if (flag_is_set(cur->style.flags, ui_FOCUSABLE)) {
@@ -830,7 +1050,7 @@ ui_Item *ui_get_next_focusable_item(ui_Item *item) {
     if (!cur->parent) goto end;
     i32 self_index = ui_get_self_index(cur);
     
-    while (self_index == (i32)sb_count(cur->parent->children) - 1) {
+    while (self_index == (i32)ui_child_count(cur->parent) - 1) {
       if (flag_is_set(cur->parent->style.flags, ui_FOCUS_TRAP)) {
         self_index = -1;
       } else {
@@ -844,7 +1064,7 @@ ui_Item *ui_get_next_focusable_item(ui_Item *item) {
     cur = sibling;
     
     if (!flag_is_set(cur->style.flags, ui_HIDDEN))  {
-      if (cur->children && sb_count(cur->children)) {
+      if (ui_child_count(cur)) {
         cur = cur->children + 0;
       }
       
@@ -862,6 +1082,8 @@ void ui_begin(ui_Layout *layout) {
   V2 ws = layout->renderer->window_size;
   layout->current_container = null;
   layout->p = v2(-ws.x*0.5f, ws.y*0.5f);
+  layout->generation++;
+  layout->item_slot_count = 0;
   
   if (v2_equal(layout->ignored_mouse_p, layout->input->mouse.p)) {
     layout->next_hot = layout->hot;
@@ -874,77 +1096,94 @@ void ui_begin(ui_Layout *layout) {
 void ui_end(ui_Layout *layout) {
   begin_profiler_function();
   
-  gl_Funcs gl = global_os.gl;
-  
-  gl.ClearColor(0, 0, 0, 1);
-  gl.Clear(GL_COLOR_BUFFER_BIT|GL_DEPTH_BUFFER_BIT);
   Renderer *renderer = layout->renderer;
   
   Rect2 window_rect = rect2_min_size(v2_mul(renderer->window_size, -0.5f),
                                      renderer->window_size);
   
   assert(layout->current_container->parent == null);
+  ui_index_item(layout, layout->current_container);
   
-  ui_Item *stack[128];
-  ui_Item *post_stack[128];
-  i32 stack_count = 0;
-  stack[stack_count++] = layout->current_container;
+  // NOTE(lvl5): with no hot item the root's layer is the one to beat
+  layout->next_hot_layer = ui_id_valid(layout->next_hot)
+    ? layout->hot_layer
+    : ui_get_layer(layout->current_container);
   
+  // NOTE(lvl5): every child of an item goes on the stack at once, so it has to grow with wide items
+  push_scratch_context();
+  ui_Item **stack = sb_new(ui_Item *, 128);
+  pop_context();
+  sb_push(stack, layout->current_container);
   
-  while (stack_count) {
-    ui_Item *item = stack[--stack_count];
+  
+  while (sb_count(stack)) {
+    ui_Item *item = stack[--sb_count(stack)];
+    bool saves_state = item->style.layer || flag_is_set(item->style.flags, ui_CLIP);
     
     if (!item->rendered) {
       if (flag_is_set(item->style.flags, ui_HIDDEN)) {
         continue;
       }
       
-      if (item->style.layer) {
+      if (saves_state) {
         render_save(layout->renderer);
-        layout->renderer->state.z = item->style.layer;
+        if (item->style.layer) {
+          layout->renderer->state.z = item->style.layer;
+        }
       }
       
       
       ui_draw_item(layout, item);
+      if (flag_is_set(item->style.flags, ui_CLIP)) {
+        render_clip(layout->renderer, ui_get_rect(layout, item));
+      }
       
       if (ui_is_hot(layout, item->id) &&
           ui_id_valid(item->id)) 
       {
         if (layout->input->keys[os_Keycode_ARROW_DOWN].pressed) {
           layout->ignored_mouse_p = layout->input->mouse.p;
-          ui_set_hot(layout, ui_get_next_focusable_item(item)->id);
+          ui_set_hot_item(layout, ui_get_next_focusable_item(item));
         } else if (layout->input->keys[os_Keycode_ARROW_UP].pressed) {
           layout->ignored_mouse_p = layout->input->mouse.p;
-          ui_set_hot(layout, ui_get_prev_focusable_item(item)->id);
+          ui_set_hot_item(layout, ui_get_prev_focusable_item(item));
         }
       }
       
       
-      if (item->children && sb_count(item->children) > 0) {
+      if (ui_child_count(item) > 0) {
         // return to the item after visiting all descendents
         item->rendered = true;
-        stack[stack_count++] = item;
+        sb_push(stack, item);
         
         bool is_horizontal = flag_is_set(item->style.flags, ui_HORIZONTAL);
         i32 main_axis = is_horizontal ? AXIS_X : AXIS_Y;
         
         ui_flex_set_stretchy_children(item, main_axis);
+        if (item->type == Item_Type_LIST) {
+          for (u32 i = 0; i < ui_child_count(item); i++) {
+            item->children[i].p.y += item->list->offset;
+          }
+        }
         
-        u32 i = sb_count(item->children);
+        u32 i = ui_child_count(item);
         while (i > 0) {
           i--;
           ui_Item *child = item->children + i;
-          stack[stack_count++] = child;
+          sb_push(stack, child);
         }
+      } else if (saves_state) {
+        render_restore(layout->renderer);
       }
     } else {
-      if (item->style.layer) {
+      if (saves_state) {
         render_restore(layout->renderer);
       }
     }
   }
   
   layout->hot = layout->next_hot;
+  layout->hot_layer = layout->next_hot_layer;
   layout->active = layout->next_active;
   layout->interactive = layout->next_interactive;
   
@@ -966,7 +1205,7 @@ void ui_menu_bar_end(ui_Layout *layout) {
   ui_State *open_menu_state = null;
   ui_State *hot_menu_state = null;
   for (u32 menu_index = 0; 
-       menu_index < sb_count(menu_bar->children);
+       menu_index < ui_child_count(menu_bar);
        menu_index++)
   {
     ui_Item *menu = menu_bar->children + menu_index;
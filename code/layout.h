@@ -13,6 +13,7 @@
 #define ui_FOCUSABLE (1 << 5)
 #define ui_FOCUS_TRAP (1 << 6)
 #define ui_TOGGLE (1 << 7)
+#define ui_CLIP (1 << 8)
 
 typedef enum {
   Unit_PIXELS,
@@ -76,6 +77,7 @@ typedef enum {
   Item_Type_DROPDOWN_MENU,
   Item_Type_MENU_BAR,
   Item_Type_LABEL,
+  Item_Type_LIST,
 } Item_Type;
 
 typedef union {
@@ -85,6 +87,21 @@ typedef union {
 
 #define INVALID_UI_ID (ui_Id){NULL}
 
+// NOTE(lvl5): a ui_list only makes items for the rows on screen, so it costs the same
+// for any number of rows. the caller keeps this between frames.
+// scroll is in rows and eases toward scroll_target, selected is -1 for none
+typedef struct {
+  i32 selected;
+  bool selection_moved;
+  f32 scroll;
+  f32 scroll_target;
+  f32 row_height;
+  // pixels the rows are moved up, for the row that is partly scrolled out
+  f32 offset;
+  // the mouse was over the list last frame
+  bool hovered;
+} ui_List;
+
 typedef struct ui_Item ui_Item;
 typedef struct ui_Item {
   V2 p;
@@ -95,8 +112,10 @@ typedef struct ui_Item {
   ui_Id id;
   
   Style style;
-  ui_Item *children;
+  ui_Item *children; // null until the first child is added
   ui_Item *parent;
+  // what ui_get_layer returns, worked out when the item is made
+  f32 layer;
   
   bool rendered;
   
@@ -104,6 +123,7 @@ typedef struct ui_Item {
   String label;
   Buffer_View *buffer_view;
   V2 *scroll;
+  ui_List *list;
 } ui_Item;
 
 
@@ -122,32 +142,75 @@ typedef struct Buffer_View {
   i32 preferred_col_pos;
   i32 visible_mark;
   
+  // NOTE(lvl5): what was on screen last frame, set by the renderer
+  i32 visible_start;
+  i32 visible_end;
+  
   bool is_single_line;
 } Buffer_View;
 
 
 
-#define LAYOUT_BUTTON_MAX 512
+// NOTE(lvl5): widget state that nobody asked for in this many frames is thrown away
+#define LAYOUT_STATE_KEEP_FRAMES 256
 
-typedef union {
+// NOTE(lvl5): widths of label text, so the same labels aren't measured every frame.
+// a string that lands on a taken slot replaces what was there
+#define LAYOUT_TEXT_WIDTH_CACHE_SIZE 1024
+
+typedef struct {
+  u64 hash; // 0 is empty
+  Font *font;
+  f32 width;
+} ui_Text_Width;
+
+// NOTE(lvl5): allocated on its own, so the buffer view can point into it
+// and the state table doesn't carry a Buffer in every slot
+typedef struct {
+  Buffer_View buffer_view;
+  Buffer buffer;
+  V2 scroll;
+} ui_Text_Input_State;
+
+typedef struct {
   bool open;
-  struct {
-    Buffer_View buffer_view;
-    Buffer buffer;
-    V2 scroll;
-  } panel;
+  // freed with the state
+  ui_Text_Input_State *text_input;
 } ui_State;
 
+// NOTE(lvl5): last_used is the generation of the last lookup, 0 is empty
+typedef struct {
+  ui_Id id;
+  u32 last_used;
+  ui_State value;
+} ui_State_Slot;
+
+// NOTE(lvl5): one frame's items by id. slots from an older generation are empty,
+// so the index is cleared by bumping ui_Layout.generation
+typedef struct {
+  ui_Id id;
+  ui_Item *item;
+  u32 generation;
+} ui_Item_Slot;
+
 typedef struct {
   V2 p;
   
-  ui_Id keys[LAYOUT_BUTTON_MAX];
-  ui_State values[LAYOUT_BUTTON_MAX];
-  bool occupancy[LAYOUT_BUTTON_MAX];
-  u32 count;
+  // state that outlives a frame, by id. slots move when the table is rebuilt
+  ui_State_Slot *states;
+  u32 state_capacity;
+  u32 state_count;
   
   ui_Item *current_container;
   
+  // items go in when their container ends, after that they don't move anymore
+  ui_Item_Slot *item_slots;
+  u32 item_slot_capacity;
+  u32 item_slot_count;
+  u32 generation;
+  
+  ui_Text_Width text_widths[LAYOUT_TEXT_WIDTH_CACHE_SIZE];
+  
   Renderer *renderer;
   os_Input *input;
   Editor *editor;
@@ -160,6 +223,10 @@ typedef struct {
   ui_Id next_active;
   ui_Id next_interactive;
   
+  // layers of the hot items, so finding them in the tree isn't needed
+  f32 hot_layer;
+  f32 next_hot_layer;
+  
   V2 ignored_mouse_p;
 } ui_Layout;
 
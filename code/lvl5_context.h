@@ -151,6 +151,13 @@ ALLOCATOR(system_allocator) {
   return result;
 }
 
+void push_system_context() {
+  Context *cur = get_context();
+  Context system_ctx = *cur;
+  system_ctx.allocator = system_allocator;
+  push_context(system_ctx);
+}
+
 
 void context_init(Mem_Size scratch_size) {
   Global_Context_Info *info = calloc(1, sizeof(Global_Context_Info));
@@ -143,6 +143,7 @@ Bitmap make_empty_bitmap(i32 width, i32 height) {
 
 // fonts
 #include "lvl5_math.h"
+#include "lvl5_stretchy_buffer.h"
 
 typedef struct {
   Bitmap bmp;
@@ -150,14 +151,73 @@ typedef struct {
   i32 count;
 } Texture_Atlas;
 
+#define FONT_ATLAS_SIZE 1024
+#define FONT_ASCII_COUNT 128
+// NOTE(lvl5): cells that never get evicted: ascii, the white pixel, and a spare one
+// that glyphs are measured in when all the others were used this frame
+#define FONT_WHITE_CELL FONT_ASCII_COUNT
+#define FONT_SPARE_CELL (FONT_ASCII_COUNT + 1)
+#define FONT_PINNED_CELL_COUNT (FONT_ASCII_COUNT + 2)
+#define FONT_CELL_PADDING 2
+
+typedef struct {
+  u32 codepoint;
+  // where it is in the atlas, only valid while cell != -1
+  Rect2i rect;
+  V2 origin;
+  i8 advance;
+  i32 cell;
+} Glyph;
+
 typedef struct {
-  Texture_Atlas atlas;
-  char first_codepoint;
-  i32 codepoint_count;
-  V2 *origins;
+  i32 glyph; // -1 when free
+  i32 prev;
+  i32 next;
+  u32 last_used;
+} Glyph_Cell;
+
+typedef struct {
+  u64 pair; // first << 32 | second, 0 is empty
+  i8 amount;
+} Kerning_Pair;
+
+// NOTE(lvl5): draws codepoint into cell and fills in the glyph's rect and metrics.
+// the rect has to stay inside the cell
+typedef void Font_Rasterize(void *data, u32 codepoint, Bitmap *atlas, Rect2i cell, Glyph *glyph);
+
+// NOTE(lvl5): glyphs are rasterized the first time they are used, into same sized
+// cells of one atlas. when it is full the least recently used cell gets reused,
+// unless that was this frame, because quads pointing into it aren't drawn yet.
+// metrics stay around after a glyph is evicted, so layout never rasterizes twice
+typedef struct {
+  Bitmap atlas;
+  // rows that changed since the last upload, min >= max when none did
+  i32 dirty_min_y;
+  i32 dirty_max_y;
+  
+  i32 cell_width;
+  i32 cell_height;
+  i32 cells_per_row;
+  Glyph_Cell *cells;
+  i32 cell_count;
+  // most recently used first
+  i32 lru_first;
+  i32 lru_last;
+  u32 frame;
+  
+  // the first FONT_ASCII_COUNT are ascii, so those need no lookup
+  Glyph *glyphs;
+  i32 *glyph_table; // glyph index + 1, 0 is empty
+  i32 glyph_table_capacity;
+  
+  Kerning_Pair *kerning;
+  i32 kerning_count;
+  i32 kerning_capacity;
+  
+  Rect2i white_rect;
+  Font_Rasterize *rasterize;
+  void *rasterizer_data;
   
-  i8 *advance;
-  i8 *kerning;
   i8 line_spacing;
   i8 line_height;
   i8 descent;
@@ -211,22 +271,267 @@ Texture_Atlas texture_atlas_make_from_bitmaps(Bitmap *bitmaps, i32 bitmap_count,
 }
 
 
-i32 font_get_char(Font *font, char c) {
-  assert(c >= font->first_codepoint && c <= font->first_codepoint + font->codepoint_count);
-  i32 result = c - font->first_codepoint;
+u32 font_hash(u64 key) {
+  u32 result = (u32)((key*0x9E3779B97F4A7C15ull) >> 32);
   return result;
 }
 
-i8 font_get_advance(Font *font, char a, char b) {
-  i32 a_index = font_get_char(font, a);
+Rect2i font_get_cell_rect(Font *font, i32 cell_index) {
+  i32 x = (cell_index % font->cells_per_row)*(font->cell_width + FONT_CELL_PADDING);
+  i32 y = (cell_index / font->cells_per_row)*(font->cell_height + FONT_CELL_PADDING);
+  Rect2i result = rect2i_min_size(v2i(x, y), v2i(font->cell_width, font->cell_height));
+  return result;
+}
+
+void font_lru_unlink(Font *font, i32 cell_index) {
+  Glyph_Cell *cell = font->cells + cell_index;
+  if (cell->prev >= 0) {
+    font->cells[cell->prev].next = cell->next;
+  } else {
+    font->lru_first = cell->next;
+  }
+  if (cell->next >= 0) {
+    font->cells[cell->next].prev = cell->prev;
+  } else {
+    font->lru_last = cell->prev;
+  }
+}
+
+void font_lru_push_first(Font *font, i32 cell_index) {
+  Glyph_Cell *cell = font->cells + cell_index;
+  cell->prev = -1;
+  cell->next = font->lru_first;
+  if (font->lru_first >= 0) {
+    font->cells[font->lru_first].prev = cell_index;
+  } else {
+    font->lru_last = cell_index;
+  }
+  font->lru_first = cell_index;
+}
+
+void font_touch_cell(Font *font, i32 cell_index) {
+  font->cells[cell_index].last_used = font->frame;
+  if (cell_index >= FONT_PINNED_CELL_COUNT && font->lru_first != cell_index) {
+    font_lru_unlink(font, cell_index);
+    font_lru_push_first(font, cell_index);
+  }
+}
+
+void font_rasterize_into_cell(Font *font, i32 glyph_index, i32 cell_index) {
+  Rect2i cell = font_get_cell_rect(font, cell_index);
+  Bitmap *atlas = &font->atlas;
+  for (i32 y = cell.min.y; y < cell.max.y; y++) {
+    zero_memory_slow(atlas->data + y*atlas->width + cell.min.x,
+                     font->cell_width*sizeof(u32));
+  }
+  
+  Glyph *glyph = font->glyphs + glyph_index;
+  font->rasterize(font->rasterizer_data, glyph->codepoint, atlas, cell, glyph);
   
-  i8 result = font->advance[a_index];
-  if (b >= font->first_codepoint && b <= font->first_codepoint + font->codepoint_count)
-  {
-    i32 b_index = font_get_char(font, b);
-    result += font->kerning[a_index*font->codepoint_count + b_index];
+  font->dirty_min_y = min(font->dirty_min_y, cell.min.y);
+  font->dirty_max_y = max(font->dirty_max_y, cell.max.y);
+}
+
+// NOTE(lvl5): false when every cell that could be evicted was used this frame
+bool font_load_glyph(Font *font, i32 glyph_index) {
+  i32 cell_index = font->lru_last;
+  bool result = cell_index >= 0 &&
+    (font->cells[cell_index].glyph < 0 || font->cells[cell_index].last_used != font->frame);
+  
+  if (result) {
+    Glyph_Cell *cell = font->cells + cell_index;
+    if (cell->glyph >= 0) {
+      font->glyphs[cell->glyph].cell = -1;
+    }
+    cell->glyph = glyph_index;
+    font->glyphs[glyph_index].cell = cell_index;
+    font_rasterize_into_cell(font, glyph_index, cell_index);
+    font_touch_cell(font, cell_index);
+  }
+  return result;
+}
+
+void font_grow_glyph_table(Font *font) {
+  i32 *old_table = font->glyph_table;
+  i32 old_capacity = font->glyph_table_capacity;
+  
+  push_system_context();
+  font->glyph_table_capacity = old_capacity ? old_capacity*2 : 256;
+  font->glyph_table = alloc_array(i32, font->glyph_table_capacity);
+  zero_memory_slow(font->glyph_table, sizeof(i32)*font->glyph_table_capacity);
+  
+  u32 mask = font->glyph_table_capacity - 1;
+  for (i32 i = 0; i < old_capacity; i++) {
+    if (old_table[i]) {
+      u32 slot = font_hash(font->glyphs[old_table[i] - 1].codepoint) & mask;
+      while (font->glyph_table[slot]) {
+        slot = (slot + 1) & mask;
+      }
+      font->glyph_table[slot] = old_table[i];
+    }
   }
   
+  if (old_table) {
+    free_memory(old_table);
+  }
+  pop_context();
+}
+
+// NOTE(lvl5): index into font->glyphs. the metrics are ready right away,
+// the glyph itself may have to wait for font_use_glyph to get a cell
+i32 font_get_glyph(Font *font, u32 codepoint) {
+  i32 result = (i32)codepoint;
+  if (codepoint >= FONT_ASCII_COUNT) {
+    if ((sb_count(font->glyphs) + 1)*2 > font->glyph_table_capacity) {
+      font_grow_glyph_table(font);
+    }
+    
+    u32 mask = font->glyph_table_capacity - 1;
+    u32 slot = font_hash(codepoint) & mask;
+    while (font->glyph_table[slot] &&
+           font->glyphs[font->glyph_table[slot] - 1].codepoint != codepoint) {
+      slot = (slot + 1) & mask;
+    }
+    
+    if (font->glyph_table[slot]) {
+      result = font->glyph_table[slot] - 1;
+    } else {
+      Glyph glyph = {
+        .codepoint = codepoint,
+        .cell = -1,
+      };
+      sb_push(font->glyphs, glyph);
+      result = sb_count(font->glyphs) - 1;
+      font->glyph_table[slot] = result + 1;
+      
+      if (!font_load_glyph(font, result)) {
+        font_rasterize_into_cell(font, result, FONT_SPARE_CELL);
+      }
+    }
+  }
+  return result;
+}
+
+// NOTE(lvl5): the glyph to draw this frame, which is ? when there's no cell left for it.
+// the pointer is only good until the next glyph gets added
+Glyph *font_use_glyph(Font *font, i32 glyph_index) {
+  Glyph *result = font->glyphs + glyph_index;
+  if (result->cell < 0 && !font_load_glyph(font, glyph_index)) {
+    result = font->glyphs + '?';
+  }
+  font_touch_cell(font, result->cell);
+  return result;
+}
+
+void font_add_kerning(Font *font, u32 a, u32 b, i8 amount) {
+  u64 pair = ((u64)a << 32) | b;
+  if (pair) {
+    if ((font->kerning_count + 1)*2 > font->kerning_capacity) {
+      Kerning_Pair *old_kerning = font->kerning;
+      i32 old_capacity = font->kerning_capacity;
+      
+      push_system_context();
+      font->kerning_capacity = old_capacity ? old_capacity*2 : 256;
+      font->kerning = alloc_array(Kerning_Pair, font->kerning_capacity);
+      zero_memory_slow(font->kerning, sizeof(Kerning_Pair)*font->kerning_capacity);
+      font->kerning_count = 0;
+      for (i32 i = 0; i < old_capacity; i++) {
+        Kerning_Pair old = old_kerning[i];
+        if (old.pair) {
+          font_add_kerning(font, (u32)(old.pair >> 32), (u32)old.pair, old.amount);
+        }
+      }
+      if (old_kerning) {
+        free_memory(old_kerning);
+      }
+      pop_context();
+    }
+    
+    u32 mask = font->kerning_capacity - 1;
+    u32 slot = font_hash(pair) & mask;
+    while (font->kerning[slot].pair && font->kerning[slot].pair != pair) {
+      slot = (slot + 1) & mask;
+    }
+    if (!font->kerning[slot].pair) {
+      font->kerning[slot].pair = pair;
+      font->kerning_count++;
+    }
+    font->kerning[slot].amount += amount;
+  }
+}
+
+i8 font_get_kerning(Font *font, u32 a, u32 b) {
+  i8 result = 0;
+  if (font->kerning_count) {
+    u64 pair = ((u64)a << 32) | b;
+    u32 mask = font->kerning_capacity - 1;
+    u32 slot = font_hash(pair) & mask;
+    while (font->kerning[slot].pair && font->kerning[slot].pair != pair) {
+      slot = (slot + 1) & mask;
+    }
+    result = font->kerning[slot].amount;
+  }
+  return result;
+}
+
+// NOTE(lvl5): the os layer sets rasterize, rasterizer_data and the line metrics first
+void font_init_cache(Font *font, i32 cell_width, i32 cell_height) {
+  push_system_context();
+  font->atlas = make_empty_bitmap(FONT_ATLAS_SIZE, FONT_ATLAS_SIZE);
+  font->cell_width = cell_width;
+  font->cell_height = cell_height;
+  font->cells_per_row = FONT_ATLAS_SIZE/(cell_width + FONT_CELL_PADDING);
+  font->cell_count = font->cells_per_row*(FONT_ATLAS_SIZE/(cell_height + FONT_CELL_PADDING));
+  assert(font->cell_count > FONT_PINNED_CELL_COUNT);
+  font->cells = alloc_array(Glyph_Cell, font->cell_count);
+  font->glyphs = sb_new(Glyph, 256);
+  pop_context();
+  font_grow_glyph_table(font);
+  
+  font->lru_first = -1;
+  font->lru_last = -1;
+  for (i32 cell_index = 0; cell_index < font->cell_count; cell_index++) {
+    font->cells[cell_index] = (Glyph_Cell){
+      .glyph = -1,
+      .prev = -1,
+      .next = -1,
+    };
+    if (cell_index >= FONT_PINNED_CELL_COUNT) {
+      font_lru_push_first(font, cell_index);
+    }
+  }
+  
+  font->dirty_min_y = font->atlas.height;
+  font->dirty_max_y = 0;
+  for (u32 codepoint = 0; codepoint < FONT_ASCII_COUNT; codepoint++) {
+    Glyph glyph = {
+      .codepoint = codepoint,
+      .cell = (i32)codepoint,
+    };
+    sb_push(font->glyphs, glyph);
+    font->cells[codepoint].glyph = codepoint;
+    font_rasterize_into_cell(font, codepoint, codepoint);
+  }
+  // NOTE(lvl5): the 0 at the end of a buffer is where the cursor sits after the last char
+  font->glyphs[0].advance = font->glyphs[' '].advance;
+  
+  Rect2i white_cell = font_get_cell_rect(font, FONT_WHITE_CELL);
+  font->white_rect = rect2i_min_size(white_cell.min, v2i(2, 2));
+  for (i32 y = 0; y < 2; y++) {
+    for (i32 x = 0; x < 2; x++) {
+      font->atlas.data[(white_cell.min.y + y)*font->atlas.width + white_cell.min.x + x] = 0xFFFFFFFF;
+    }
+  }
+}
+
+i8 font_get_codepoint_advance(Font *font, u32 a, u32 b) {
+  i32 glyph_index = font_get_glyph(font, a);
+  i8 result = font->glyphs[glyph_index].advance + font_get_kerning(font, a, b);
+  return result;
+}
+
+i8 font_get_advance(Font *font, char a, char b) {
+  i8 result = font_get_codepoint_advance(font, (u8)a, (u8)b);
   return result;
 }
 
@@ -13,5 +13,16 @@ u8 get_thread_id() {
   return result;
 }
 
+u32 find_least_significant_set_bit(u32 value) {
+  unsigned long result = 0;
+  _BitScanForward(&result, value);
+  return (u32)result;
+}
+
+u32 count_set_bits(u32 value) {
+  u32 result = __popcnt(value);
+  return result;
+}
+
 #define LVL5_INTRINSICS_H
 #endif
\ No newline at end of file
@@ -37,6 +37,15 @@ typedef void FNGLTEXIMAGE2D(GLenum target,
                             GLenum format,
                             GLenum type,
                             const GLvoid *data);
+typedef void FNGLTEXSUBIMAGE2D(GLenum target,
+                               GLint level,
+                               GLint xoffset,
+                               GLint yoffset,
+                               GLsizei width,
+                               GLsizei height,
+                               GLenum format,
+                               GLenum type,
+                               const GLvoid *data);
 
 typedef void FNGLGENERATEMIPMAPPROC(GLenum thing);
 typedef void FNGLENABLEPROC(GLenum thing);
@@ -76,6 +85,15 @@ typedef struct {
   PFNGLDELETEVERTEXARRAYSPROC DeleteVertexArrays;
   PFNGLVERTEXATTRIBDIVISORPROC VertexAttribDivisor;
   PFNGLDRAWARRAYSINSTANCEDPROC DrawArraysInstanced;
+  PFNGLBUFFERSUBDATAPROC BufferSubData;
+  PFNGLGETSTRINGIPROC GetStringi;
+  
+  // NOTE(lvl5): GL_ARB_buffer_storage, check gl_has_extension before using it
+  PFNGLBUFFERSTORAGEPROC BufferStorage;
+  PFNGLMAPBUFFERRANGEPROC MapBufferRange;
+  PFNGLFENCESYNCPROC FenceSync;
+  PFNGLCLIENTWAITSYNCPROC ClientWaitSync;
+  PFNGLDELETESYNCPROC DeleteSync;
   
   PFNGLUNIFORM4FPROC Uniform4f;
   PFNGLUNIFORM3FPROC Uniform3f;
@@ -94,6 +112,7 @@ typedef struct {
   FNGLGENTEXTURES *GenTextures;
   FNGLBINDTEXTURE *BindTexture;
   FNGLTEXIMAGE2D *TexImage2D;
+  FNGLTEXSUBIMAGE2D *TexSubImage2D;
   FNGLTEXPARAMETERFV *TexParameterfv;
   FNGLGENERATEMIPMAPPROC *GenerateMipmap;
   FNGLENABLEPROC *Enable;
@@ -107,6 +126,17 @@ typedef struct {
   String fragment;
 } gl_Parse_Result;
 
+bool gl_has_extension(gl_Funcs gl, char *name) {
+  GLint count = 0;
+  glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+  
+  bool result = false;
+  for (GLint i = 0; i < count && !result; i++) {
+    result = c_string_compare((char *)gl.GetStringi(GL_EXTENSIONS, i), name);
+  }
+  return result;
+}
+
 gl_Parse_Result gl_parse_glsl(String src) {
   String vertex_header = const_string("#shader vertex");
   i64 vertex_index = find_index(src, vertex_header, 0);
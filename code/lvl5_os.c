@@ -4,6 +4,7 @@
 #include "lvl5_os.h"
 #include "lvl5_opengl.h"
 #include "lvl5_stretchy_buffer.h"
+#include "lvl5_utf8.h"
 
 #ifdef _MSC_VER
 #define os_WIN32 1
@@ -228,6 +229,14 @@ gl_Funcs gl_load_functions() {
   load_opengl_proc(DeleteVertexArrays);
   load_opengl_proc(VertexAttribDivisor);
   load_opengl_proc(DrawArraysInstanced);
+  load_opengl_proc(BufferSubData);
+  load_opengl_proc(GetStringi);
+  
+  load_opengl_proc(BufferStorage);
+  load_opengl_proc(MapBufferRange);
+  load_opengl_proc(FenceSync);
+  load_opengl_proc(ClientWaitSync);
+  load_opengl_proc(DeleteSync);
   
   load_opengl_proc(Uniform4f);
   load_opengl_proc(Uniform3f);
@@ -246,6 +255,7 @@ gl_Funcs gl_load_functions() {
   load_opengl_proc(GenTextures);
   load_opengl_proc(BindTexture);
   load_opengl_proc(TexImage2D);
+  load_opengl_proc(TexSubImage2D);
   load_opengl_proc(GenerateMipmap);
   load_opengl_proc(BlendFunc);
   load_opengl_proc(Enable);
@@ -426,10 +436,14 @@ HWND win32_init_opengl(gl_Funcs *gl, HINSTANCE instance, WNDPROC WindowProc, i32
 
 // TODO(lvl5): make an event stack per each window
 #define os_MAX_EVENT_COUNT 256
+#define OS_WM_WAKE (WM_APP + 1)
 typedef struct os_State {
   os_Event events[os_MAX_EVENT_COUNT];
   i32 event_count;
   HDC device_context;
+  HWND window;
+  // set while a wake message is on its way, so workers don't flood the queue
+  volatile LONG wake_pending;
 } os_State;
 
 os_State __os_global_state = {0};
@@ -451,6 +465,151 @@ b32 os_pop_event(os_Event *event) {
 
 #if os_WIN32
 
+// returns null if the file does not exist or is empty
+void *os_map_file(String file_name, u64 *size) {
+  void *result = null;
+  *size = 0;
+  
+  HANDLE file = CreateFileA(to_c_string(file_name),
+                            GENERIC_READ,
+                            FILE_SHARE_READ,
+                            0,
+                            OPEN_EXISTING,
+                            FILE_ATTRIBUTE_NORMAL,
+                            0);
+  
+  if (file != INVALID_HANDLE_VALUE) {
+    LARGE_INTEGER file_size_li;
+    GetFileSizeEx(file, &file_size_li);
+    
+    if (file_size_li.QuadPart) {
+      HANDLE mapping = CreateFileMappingA(file, 0, PAGE_READONLY, 0, 0, 0);
+      if (mapping) {
+        result = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+        if (result) {
+          *size = file_size_li.QuadPart;
+        }
+        // NOTE(lvl5): the view keeps the mapping alive
+        CloseHandle(mapping);
+      }
+    }
+    CloseHandle(file);
+  }
+  
+  return result;
+}
+
+void os_unmap_file(void *data) {
+  UnmapViewOfFile(data);
+}
+
+bool os_write_entire_file(String file_name, void *data, u64 size) {
+  HANDLE file = CreateFileA(to_c_string(file_name),
+                            GENERIC_WRITE,
+                            0,
+                            0,
+                            CREATE_ALWAYS,
+                            FILE_ATTRIBUTE_NORMAL,
+                            0);
+  
+  bool result = false;
+  if (file != INVALID_HANDLE_VALUE) {
+    DWORD bytes_written;
+    BOOL written = WriteFile(file, data, (u32)size, &bytes_written, null);
+    result = written && bytes_written == size;
+    CloseHandle(file);
+  }
+  
+  return result;
+}
+
+// NOTE(lvl5): changes every time anyone puts something on the clipboard
+u32 os_get_clipboard_sequence() {
+  u32 result = GetClipboardSequenceNumber();
+  return result;
+}
+
+// NOTE(lvl5): the clipboard wants utf-16 with \r\n line endings, the text is utf-8
+bool os_set_clipboard(String text) {
+  i32 wide_count = 0;
+  if (text.count) {
+    wide_count = MultiByteToWideChar(CP_UTF8, 0, text.data, (i32)text.count, null, 0);
+  }
+  u64 newline_count = 0;
+  for (u64 i = 0; i < text.count; i++) {
+    newline_count += text.data[i] == '\n';
+  }
+  
+  bool result = false;
+  u64 total_count = wide_count + newline_count;
+  HGLOBAL memory = GlobalAlloc(GMEM_MOVEABLE, (total_count + 1)*sizeof(wchar_t));
+  if (memory) {
+    wchar_t *dst = (wchar_t *)GlobalLock(memory);
+    if (wide_count) {
+      MultiByteToWideChar(CP_UTF8, 0, text.data, (i32)text.count, dst, wide_count);
+    }
+    // spread it out from the back to make room for the \r
+    u64 write = total_count;
+    for (i32 i = wide_count - 1; i >= 0; i--) {
+      dst[--write] = dst[i];
+      if (dst[i] == L'\n') {
+        dst[--write] = L'\r';
+      }
+    }
+    dst[total_count] = L'\0';
+    GlobalUnlock(memory);
+    
+    if (OpenClipboard(__os_global_state.window)) {
+      EmptyClipboard();
+      // NOTE(lvl5): the clipboard owns the memory now
+      result = SetClipboardData(CF_UNICODETEXT, memory) != null;
+      CloseClipboard();
+    }
+    if (!result) {
+      GlobalFree(memory);
+    }
+  }
+  
+  return result;
+}
+
+// NOTE(lvl5): uses the current allocator, comes back as utf-8 and \r is dropped.
+// empty if there is no text
+String os_get_clipboard() {
+  String result = {0};
+  
+  if (IsClipboardFormatAvailable(CF_UNICODETEXT) &&
+      OpenClipboard(__os_global_state.window)) {
+    HANDLE memory = GetClipboardData(CF_UNICODETEXT);
+    wchar_t *src = memory ? (wchar_t *)GlobalLock(memory) : null;
+    if (src) {
+      u64 size = GlobalSize(memory)/sizeof(wchar_t);
+      i32 wide_count = 0;
+      while ((u64)wide_count < size && src[wide_count]) {
+        wide_count++;
+      }
+      
+      i32 count = 0;
+      if (wide_count) {
+        count = WideCharToMultiByte(CP_UTF8, 0, src, wide_count, null, 0, null, null);
+      }
+      if (count) {
+        result.data = alloc_array(char, count);
+        WideCharToMultiByte(CP_UTF8, 0, src, wide_count, result.data, count, null, null);
+        for (i32 i = 0; i < count; i++) {
+          if (result.data[i] != '\r') {
+            result.data[result.count++] = result.data[i];
+          }
+        }
+      }
+      GlobalUnlock(memory);
+    }
+    CloseClipboard();
+  }
+  
+  return result;
+}
+
 os_File_Info os_get_file_info(String file_name) {
   WIN32_FIND_DATAA find_data;
   HANDLE file_handle = FindFirstFileA(
@@ -461,10 +620,11 @@ os_File_Info os_get_file_info(String file_name) {
   
   if (file_handle != INVALID_HANDLE_VALUE) {
     info.exists = true;
+    info.is_directory = (find_data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0;
     FindClose(file_handle);
     FILETIME write_time = find_data.ftLastWriteTime;
     
-    info.write_time = ((u64)write_time.dwLowDateTime << 32) |
+    info.write_time = ((u64)write_time.dwHighDateTime << 32) |
       write_time.dwLowDateTime;
   }
   
@@ -554,6 +714,11 @@ LRESULT CALLBACK os_window_proc(HWND   window,
       os_push_event((os_Event) { .type = os_Event_Type_FOCUS });
     } break;
     
+    case WM_PAINT: {
+      os_push_event((os_Event){ .type = os_Event_Type_PAINT });
+      result = DefWindowProc(window, message, w_param, l_param);
+    } break;
+    
     default: result = DefWindowProc(window, message, w_param, l_param);
   }
   
@@ -566,6 +731,7 @@ os_Window os_create_window(gl_Funcs *gl, i32 width, i32 height) {
   HINSTANCE instance = GetModuleHandle(null);
   window->window = win32_init_opengl(gl, instance, os_window_proc, width, height);
   __os_global_state.device_context = GetDC(window->window);
+  __os_global_state.window = window->window;
   return (os_Window *)window;
 }
 
@@ -603,6 +769,7 @@ void os_collect_messages(os_Window _window, os_Input *input) {
   }
   
   input->char_count = 0;
+  input->mouse.wheel = 0;
   win32_Window *window = (win32_Window *)_window;
   
   MSG message;
@@ -639,6 +806,11 @@ void os_collect_messages(os_Window _window, os_Input *input) {
         }
       } break;
       
+      case WM_MOUSEWHEEL: {
+        // in notches, positive is away from the user
+        input->mouse.wheel += (f32)GET_WHEEL_DELTA_WPARAM(message.wParam)/WHEEL_DELTA;
+      } break;
+      
       case WM_MOUSEMOVE: {
         i32 x = GET_X_LPARAM(message.lParam);
         i32 y = GET_Y_LPARAM(message.lParam);
@@ -672,15 +844,25 @@ void os_collect_messages(os_Window _window, os_Input *input) {
           u32 scan_code = message.lParam & SCAN_CODE_MASK;
           byte keyboard_state[256];
           GetKeyboardState(keyboard_state);
-          u16 char_code_u16[2];
-          i32 got_keycode = ToAscii((UINT)keycode, scan_code,
-                                    keyboard_state, char_code_u16, 0);
+          wchar_t utf16[4];
+          i32 unit_count = ToUnicode((UINT)keycode, scan_code,
+                                     keyboard_state, utf16, array_count(utf16), 0);
           
           // TODO: multiple presses on same frame not handled
-          // TODO: unicode
-          if (got_keycode > 0) {
-            assert(input->char_count < MAX_CHARS_PER_FRAME);
-            input->chars[input->char_count++] = (char)char_code_u16[0];
+          // NOTE(lvl5): chars reach the editor as utf-8, surrogate pairs get joined here
+          for (i32 unit_index = 0; unit_index < unit_count; unit_index++) {
+            u32 codepoint = utf16[unit_index];
+            if (codepoint >= 0xD800 && codepoint < 0xDC00 && unit_index + 1 < unit_count) {
+              u32 low = utf16[++unit_index];
+              codepoint = 0x10000 + ((codepoint - 0xD800) << 10) + (low - 0xDC00);
+            }
+            
+            char encoded[4];
+            i32 encoded_count = utf8_encode(codepoint, encoded);
+            if (input->char_count + encoded_count <= MAX_CHARS_PER_FRAME) {
+              memcpy(input->chars + input->char_count, encoded, encoded_count);
+              input->char_count += encoded_count;
+            }
           }
         }
         
@@ -722,6 +904,11 @@ void os_collect_messages(os_Window _window, os_Input *input) {
         }
       } break;
       
+      case OS_WM_WAKE: {
+        __os_global_state.wake_pending = 0;
+        os_push_event((os_Event){ .type = os_Event_Type_WAKE });
+      } break;
+      
       default: {
         os_window_proc(window->window,
                        message.message,
@@ -732,6 +919,19 @@ void os_collect_messages(os_Window _window, os_Input *input) {
   }
 }
 
+// NOTE(lvl5): safe to call from any thread. the main thread sees an
+// os_Event_Type_WAKE, so it knows to draw whatever was published before this
+void os_wake_main_thread() {
+  if (InterlockedExchange(&__os_global_state.wake_pending, 1) == 0) {
+    PostMessage(__os_global_state.window, OS_WM_WAKE, 0, 0);
+  }
+}
+
+// NOTE(lvl5): sleeps until there is a message, or timeout_ms have passed
+void os_wait_for_messages(u32 timeout_ms) {
+  MsgWaitForMultipleObjectsEx(0, null, timeout_ms, QS_ALLINPUT, MWMO_INPUTAVAILABLE);
+}
+
 void os_blit_to_screen() {
   SwapBuffers(__os_global_state.device_context);
 }
@@ -748,6 +948,84 @@ void os_log(String str) {
 
 
 
+typedef struct {
+  HDC device_context;
+  u32 *pixels;
+  i32 width;
+  i32 height;
+} os_Font_Rasterizer;
+
+void os_rasterize_glyph(void *data, u32 codepoint, Bitmap *atlas, Rect2i cell, Glyph *glyph) {
+  os_Font_Rasterizer *rasterizer = (os_Font_Rasterizer *)data;
+  HDC device_context = rasterizer->device_context;
+  
+  wchar_t utf16[2];
+  i32 utf16_count = 1;
+  if (codepoint >= 0x10000) {
+    utf16[0] = (wchar_t)(0xD800 + ((codepoint - 0x10000) >> 10));
+    utf16[1] = (wchar_t)(0xDC00 + ((codepoint - 0x10000) & 0x3FF));
+    utf16_count = 2;
+  } else {
+    utf16[0] = (wchar_t)codepoint;
+  }
+  
+  b32 bg_blitted = PatBlt(device_context, 
+                          0, 0, rasterizer->width, rasterizer->height, BLACKNESS);
+  assert(bg_blitted);
+  SetTextColor(device_context, RGB(255, 255, 255));
+  TextOutW(device_context, 0, 0, utf16, utf16_count);
+  
+  i32 min_x = 10000;
+  i32 min_y = 10000;
+  i32 max_x = -10000;
+  i32 max_y = -10000;
+  
+  u32 *pixel = rasterizer->pixels;
+  for (i32 y = 0; y < rasterizer->height; y++) {
+    for (i32 x = 0; x < rasterizer->width; x++) {
+      u32 color_ref = *(pixel++);
+      if (color_ref != 0) {
+        if (x < min_x) min_x = x;
+        if (x > max_x) max_x = x;
+        if (y < min_y) min_y = y;
+        if (y > max_y) max_y = y;
+      }
+    }
+  }
+  
+  if (min_x == 10000) {
+    min_x = 0;
+    min_y = 0;
+    max_x = 0;
+    max_y = 0;
+  } else {
+    min_x--;
+    min_y--;
+    max_x++;
+    max_y++;
+  }
+  
+  // NOTE(lvl5): anything that doesn't fit the cell gets cut off
+  i32 width = min(max_x - min_x, cell.max.x - cell.min.x);
+  i32 height = min(max_y - min_y, cell.max.y - cell.min.y);
+  
+  for (i32 y = 0; y < height; y++) {
+    for (i32 x = 0; x < width; x++) {
+      u32 src_pixel = rasterizer->pixels[(min_y + y)*rasterizer->width + min_x + x];
+      u8 intensity = (u8)((src_pixel & 0x00FF0000) >> 16);
+      u32 new_pixel = color_u32(0xFF, 0xFF, 0xFF, intensity);
+      atlas->data[(cell.min.y + y)*atlas->width + cell.min.x + x] = new_pixel;
+    }
+  }
+  
+  SIZE extent;
+  GetTextExtentPoint32W(device_context, utf16, utf16_count, &extent);
+  
+  glyph->rect = rect2i_min_size(cell.min, v2i(width, height));
+  glyph->origin = v2((f32)min_x, (f32)min_y - rasterizer->height);
+  glyph->advance = (i8)extent.cx;
+}
+
 Font os_load_font(String file_name, String font_name_str, i32 font_size) {
   Font font = {0};
   
@@ -807,105 +1085,24 @@ Font os_load_font(String file_name, String font_name_str, i32 font_size) {
     
     SetBkColor(device_context, RGB(0, 0, 0));
     
-    char first_codepoint = 0;
-    char last_codepoint = '~';
-    
-    i32 codepoint_count = last_codepoint - first_codepoint + 1;
-    Bitmap *codepoint_bitmaps = scratch_push_array(Bitmap, codepoint_count + 1);
-    // 1 extra bitmap for white pixel
-    
-    font = (Font){
-      .first_codepoint = first_codepoint,
-      .advance = alloc_array(i8, codepoint_count),
-      .kerning = alloc_array(i8, codepoint_count*codepoint_count),
-      .origins = alloc_array(V2, codepoint_count),
-      .codepoint_count = codepoint_count,
+    // NOTE(lvl5): the device context stays alive, glyphs get rasterized as they show up
+    os_Font_Rasterizer *rasterizer = alloc_struct(os_Font_Rasterizer);
+    *rasterizer = (os_Font_Rasterizer){
+      .device_context = device_context,
+      .pixels = font_buffer_pixels,
+      .width = font_buffer_width,
+      .height = font_buffer_height,
     };
-    zero_memory_slow(font.advance, sizeof(i8)*codepoint_count);
-    zero_memory_slow(font.kerning, sizeof(i8)*codepoint_count*codepoint_count);
-    
-    ABC *abcs = scratch_push_array(ABC, font.codepoint_count);
-    GetCharABCWidthsW(device_context, font.first_codepoint,
-                      font.first_codepoint + codepoint_count, abcs);
-    
-    for (char codepoint_index = 0;
-         codepoint_index < codepoint_count;
-         codepoint_index++)
-    {
-      wchar_t codepoint = first_codepoint + codepoint_index;
-      
-      b32 bg_blitted = PatBlt(device_context, 
-                              0, 0, font_buffer_width, font_buffer_height, BLACKNESS);
-      assert(bg_blitted);
-      SetTextColor(device_context, RGB(255, 255, 255));
-      b32 written_text = TextOutW(device_context, 0, 0, &codepoint, 1);
-      
-      i32 min_x = 10000;
-      i32 min_y = 10000;
-      i32 max_x = -10000;
-      i32 max_y = -10000;
-      
-      
-      u32 *pixel = font_buffer_pixels;
-      for (i32 y = 0; y < font_buffer_height; y++) {
-        for (i32 x = 0; x < font_buffer_width; x++) {
-          u32 color_ref = *(pixel++);
-          if (color_ref != 0) {
-            if (x < min_x) min_x = x;
-            if (x > max_x) max_x = x;
-            if (y < min_y) min_y = y;
-            if (y > max_y) max_y = y;
-          }
-        }
-      }
-      
-      if (min_x == 10000) {
-        min_x = 0;
-        min_y = 0;
-        max_x = 0;
-        max_y = 0;
-      } else {
-        min_x--;
-        min_y--;
-        max_x++;
-        max_y++;
-      }
-      
-      
-      Bitmap bmp = make_empty_bitmap(max_x - min_x, max_y - min_y);
-      
-      for (i32 y = 0; y < bmp.height; y++) {
-        for (i32 x = 0; x < bmp.width; x++) {
-          u32 src_pixel = font_buffer_pixels[(min_y + y)*font_buffer_width + min_x + x];
-          u8 intensity = (u8)((src_pixel & 0x00FF0000) >> 16);
-          u32 new_pixel = color_u32(0xFF, 0xFF, 0xFF, intensity);
-          bmp.data[y*bmp.width + x] = new_pixel;
-        }
-      }
-      
-      codepoint_bitmaps[codepoint_index] = bmp;
-      
-      ABC abc = abcs[codepoint_index];
-      i8 total_width = (i8)(abc.abcA + abc.abcB + abc.abcC);
-      font.advance[codepoint_index] = total_width;
-      font.origins[codepoint_index] = v2((f32)min_x, (f32)min_y - font_buffer_height);
-    }
-    
-    font.advance[first_codepoint] = font.advance[' ' - first_codepoint];
-    
-    Bitmap white_bitmap = make_empty_bitmap(2, 2);
-    white_bitmap.data[0] = 0xFFFFFFFF;
-    white_bitmap.data[1] = 0xFFFFFFFF;
-    white_bitmap.data[2] = 0xFFFFFFFF;
-    white_bitmap.data[3] = 0xFFFFFFFF;
-    codepoint_bitmaps[codepoint_count] = white_bitmap;
     
+    font.rasterize = os_rasterize_glyph;
+    font.rasterizer_data = rasterizer;
     font.line_spacing = (i8)(metric->otmLineGap + metric->otmAscent - metric->otmDescent);
     font.line_height = (i8)metric->otmTextMetrics.tmHeight;
     font.descent = (i8)metric->otmTextMetrics.tmDescent;
-    font.atlas = texture_atlas_make_from_bitmaps(codepoint_bitmaps,
-                                                 codepoint_count+1,
-                                                 512);
+    
+    // cells are square so wide cjk glyphs fit, plus the border added around each glyph
+    i32 cell_size = metric->otmTextMetrics.tmHeight + 2;
+    font_init_cache(&font, cell_size, cell_size);
     
     DWORD kerning_pair_count = GetKerningPairs(device_context, I32_MAX, null);
     KERNINGPAIR *kerning_pairs = scratch_push_array(KERNINGPAIR, 
@@ -913,13 +1110,9 @@ Font os_load_font(String file_name, String font_name_str, i32 font_size) {
     GetKerningPairs(device_context, kerning_pair_count, kerning_pairs);
     for (DWORD i = 0; i < kerning_pair_count; i++) {
       KERNINGPAIR pair = kerning_pairs[i];
-      assert(pair.wFirst >= font.first_codepoint);
-      
-      char first = (char)pair.wFirst - font.first_codepoint;
-      char second = (char)pair.wSecond - font.first_codepoint;
       assert(pair.iKernAmount < I8_MAX);
       assert(pair.iKernAmount > I8_MIN);
-      font.kerning[first*codepoint_count + second] += (i8)pair.iKernAmount;
+      font_add_kerning(&font, pair.wFirst, pair.wSecond, (i8)pair.iKernAmount);
     }
   }
   
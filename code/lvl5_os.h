@@ -30,8 +30,8 @@ typedef enum {
   os_Keycode_F8 = 0x77,
   os_Keycode_F9 = 0x78,
   os_Keycode_F10 = 0x79,
-  os_Keycode_F11 = 0x80,
-  os_Keycode_F12 = 0x81,
+  os_Keycode_F11 = 0x7A,
+  os_Keycode_F12 = 0x7B,
   os_Keycode_DELETE = 0x2E,
   os_Keycode_SHIFT = 0x10,
   os_Keycode_CTRL = 0x11,
@@ -49,6 +49,9 @@ typedef enum {
   os_Event_Type_RESIZE = 0x101,
   os_Event_Type_BUTTON = 0x102,
   os_Event_Type_FOCUS = 0x103,
+  // a worker published something, see os_wake_main_thread
+  os_Event_Type_WAKE = 0x104,
+  os_Event_Type_PAINT = 0x105,
 } os_Event_Type;
 
 typedef void *os_Window;
@@ -109,6 +112,7 @@ typedef struct os_Event {
 
 typedef struct {
   bool exists;
+  bool is_directory;
   u64 write_time;
 } os_File_Info;
 
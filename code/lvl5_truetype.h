@@ -0,0 +1,624 @@
+#ifndef LVL5_TRUETYPE_H
+
+#include "lvl5_types.h"
+#include "lvl5_math.h"
+#include "lvl5_context.h"
+#include "lvl5_stretchy_buffer.h"
+#include "lvl5_files.h"
+
+// NOTE(lvl5): reads glyph outlines straight out of a .ttf and rasterizes them by
+// accumulating signed area per pixel, so it works the same on every platform.
+// supports cmap formats 4 and 12, simple and compound glyphs and the kern table.
+// there is no hinting
+#define TTF_MAX_COMPOUND_DEPTH 8
+// how far a flattened curve may be from the real one, in pixels
+#define TTF_FLATNESS 0.1f
+
+typedef struct {
+  byte *data;
+  u64 size;
+  
+  u32 cmap; // the unicode subtable
+  u32 loca;
+  u32 glyf;
+  u32 hmtx;
+  u32 kern;
+  bool long_loca;
+  i32 glyph_count;
+  i32 hmetric_count;
+  
+  i32 ascent;
+  i32 descent;
+  i32 line_gap;
+  
+  // pixels per font unit
+  f32 scale;
+  i32 ascent_px;
+} Ttf_Font;
+
+// NOTE(lvl5): every offset comes out of the file itself, so all reads are checked
+// against its size. reading past the end gives 0, which the callers treat as a
+// missing table or an empty glyph
+bool ttf_has(Ttf_Font *ttf, u64 offset, u64 count) {
+  bool result = offset + count <= ttf->size;
+  return result;
+}
+
+u8 ttf_u8(Ttf_Font *ttf, u32 offset) {
+  u8 result = ttf_has(ttf, offset, 1) ? ttf->data[offset] : 0;
+  return result;
+}
+
+u16 ttf_u16(Ttf_Font *ttf, u32 offset) {
+  u16 result = 0;
+  if (ttf_has(ttf, offset, 2)) {
+    byte *p = ttf->data + offset;
+    result = (u16)((p[0] << 8) | p[1]);
+  }
+  return result;
+}
+
+i16 ttf_i16(Ttf_Font *ttf, u32 offset) {
+  i16 result = (i16)ttf_u16(ttf, offset);
+  return result;
+}
+
+u32 ttf_u32(Ttf_Font *ttf, u32 offset) {
+  u32 result = 0;
+  if (ttf_has(ttf, offset, 4)) {
+    byte *p = ttf->data + offset;
+    result = ((u32)p[0] << 24) | ((u32)p[1] << 16) | ((u32)p[2] << 8) | p[3];
+  }
+  return result;
+}
+
+// NOTE(lvl5): 0 when the table is missing, nothing starts at offset 0
+u32 ttf_find_table(Ttf_Font *ttf, char *tag) {
+  u32 result = 0;
+  u16 table_count = ttf_u16(ttf, 4);
+  for (u16 i = 0; i < table_count; i++) {
+    u32 record = 12 + 16*i;
+    if (record + 16 <= ttf->size &&
+        memcmp(ttf->data + record, tag, 4) == 0)
+    {
+      result = ttf_u32(ttf, record + 8);
+      break;
+    }
+  }
+  return result;
+}
+
+bool ttf_init(Ttf_Font *ttf, byte *data, u64 size, i32 pixel_height) {
+  *ttf = (Ttf_Font){
+    .data = data,
+    .size = size,
+  };
+  
+  bool result = false;
+  if (size >= 12) {
+    u32 cmap = ttf_find_table(ttf, "cmap");
+    u32 head = ttf_find_table(ttf, "head");
+    u32 hhea = ttf_find_table(ttf, "hhea");
+    u32 maxp = ttf_find_table(ttf, "maxp");
+    ttf->loca = ttf_find_table(ttf, "loca");
+    ttf->glyf = ttf_find_table(ttf, "glyf");
+    ttf->hmtx = ttf_find_table(ttf, "hmtx");
+    ttf->kern = ttf_find_table(ttf, "kern");
+    
+    bool tables_fit = cmap && head && hhea && maxp && ttf->loca && ttf->glyf && ttf->hmtx &&
+      ttf_has(ttf, cmap, 4) && ttf_has(ttf, head, 54) &&
+      ttf_has(ttf, hhea, 36) && ttf_has(ttf, maxp, 6);
+    
+    if (tables_fit) {
+      ttf->long_loca = ttf_i16(ttf, head + 50) != 0;
+      ttf->glyph_count = ttf_u16(ttf, maxp + 4);
+      ttf->ascent = ttf_i16(ttf, hhea + 4);
+      ttf->descent = ttf_i16(ttf, hhea + 6);
+      ttf->line_gap = ttf_i16(ttf, hhea + 8);
+      ttf->hmetric_count = ttf_u16(ttf, hhea + 34);
+      
+      // prefer the full unicode table, the bmp one otherwise
+      u16 subtable_count = ttf_u16(ttf, cmap + 2);
+      for (u16 i = 0; i < subtable_count; i++) {
+        u32 record = cmap + 4 + 8*i;
+        u16 platform = ttf_u16(ttf, record);
+        u16 encoding = ttf_u16(ttf, record + 2);
+        u32 subtable = cmap + ttf_u32(ttf, record + 4);
+        u16 format = ttf_u16(ttf, subtable);
+        bool is_unicode = platform == 0 || (platform == 3 && (encoding == 1 || encoding == 10));
+        if (is_unicode && format == 12) {
+          ttf->cmap = subtable;
+        } else if (is_unicode && format == 4 && !ttf->cmap) {
+          ttf->cmap = subtable;
+        }
+      }
+      
+      // NOTE(lvl5): the same as a gdi font with a positive height, the whole
+      // ascent to descent fits into pixel_height
+      u32 loca_size = (ttf->glyph_count + 1)*(ttf->long_loca ? 4 : 2);
+      result = ttf->cmap != 0 &&
+        ttf->glyph_count > 0 &&
+        ttf->hmetric_count > 0 &&
+        ttf->ascent > ttf->descent &&
+        ttf_has(ttf, ttf->loca, loca_size) &&
+        ttf_has(ttf, ttf->hmtx, 4*ttf->hmetric_count);
+      
+      if (result) {
+        ttf->scale = (f32)pixel_height/(f32)(ttf->ascent - ttf->descent);
+        ttf->ascent_px = round_f32_i32(ttf->ascent*ttf->scale);
+      }
+    }
+  }
+  return result;
+}
+
+i32 ttf_get_glyph_index(Ttf_Font *ttf, u32 codepoint) {
+  i32 result = 0;
+  u32 cmap = ttf->cmap;
+  u16 format = ttf_u16(ttf, cmap);
+  
+  if (format == 4 && codepoint <= 0xFFFF) {
+    u16 segment_count = ttf_u16(ttf, cmap + 6)/2;
+    u32 end_codes = cmap + 14;
+    u32 start_codes = end_codes + 2*segment_count + 2;
+    u32 deltas = start_codes + 2*segment_count;
+    u32 range_offsets = deltas + 2*segment_count;
+    
+    // first segment that ends at or after codepoint
+    i32 low = 0;
+    i32 high = segment_count;
+    while (low < high) {
+      i32 mid = low + (high - low)/2;
+      if (ttf_u16(ttf, end_codes + 2*mid) < codepoint) {
+        low = mid + 1;
+      } else {
+        high = mid;
+      }
+    }
+    
+    if (low < segment_count) {
+      u16 start = ttf_u16(ttf, start_codes + 2*low);
+      u16 delta = ttf_u16(ttf, deltas + 2*low);
+      u16 range_offset = ttf_u16(ttf, range_offsets + 2*low);
+      if (start <= codepoint) {
+        if (range_offset == 0) {
+          result = (u16)(codepoint + delta);
+        } else {
+          u32 glyph_offset = range_offsets + 2*low + range_offset + 2*(codepoint - start);
+          u16 glyph = ttf_u16(ttf, glyph_offset);
+          if (glyph) {
+            result = (u16)(glyph + delta);
+          }
+        }
+      }
+    }
+  } else if (format == 12) {
+    u32 group_count = ttf_u32(ttf, cmap + 12);
+    u32 low = 0;
+    u32 high = group_count;
+    while (low < high) {
+      u32 mid = low + (high - low)/2;
+      u32 group = cmap + 16 + 12*mid;
+      if (codepoint < ttf_u32(ttf, group)) {
+        high = mid;
+      } else if (codepoint > ttf_u32(ttf, group + 4)) {
+        low = mid + 1;
+      } else {
+        result = ttf_u32(ttf, group + 8) + (codepoint - ttf_u32(ttf, group));
+        break;
+      }
+    }
+  }
+  
+  // a format 12 group can map to anything
+  if (result < 0 || result >= ttf->glyph_count) {
+    result = 0;
+  }
+  return result;
+}
+
+i32 ttf_get_advance(Ttf_Font *ttf, i32 glyph_index) {
+  i32 metric = min(glyph_index, ttf->hmetric_count - 1);
+  i32 result = ttf_u16(ttf, ttf->hmtx + 4*metric);
+  return result;
+}
+
+// NOTE(lvl5): 0 for glyphs without an outline, like space
+u32 ttf_get_glyph_offset(Ttf_Font *ttf, i32 glyph_index) {
+  u32 start;
+  u32 end;
+  if (ttf->long_loca) {
+    start = ttf_u32(ttf, ttf->loca + 4*glyph_index);
+    end = ttf_u32(ttf, ttf->loca + 4*glyph_index + 4);
+  } else {
+    start = 2*ttf_u16(ttf, ttf->loca + 2*glyph_index);
+    end = 2*ttf_u16(ttf, ttf->loca + 2*glyph_index + 2);
+  }
+  u32 result = start < end ? ttf->glyf + start : 0;
+  return result;
+}
+
+// NOTE(lvl5): lines are pushed as pairs of points
+void ttf_add_quad(V2 **lines, V2 p0, V2 p1, V2 p2) {
+  V2 curvature = v2_add(v2_sub(p0, v2_mul(p1, 2.0f)), p2);
+  i32 steps = 1 + (i32)sqrt_f32(v2_length(curvature)/(4.0f*TTF_FLATNESS));
+  steps = min(steps, 32);
+  
+  V2 prev = p0;
+  for (i32 i = 1; i <= steps; i++) {
+    f32 t = (f32)i/(f32)steps;
+    f32 s = 1.0f - t;
+    V2 p = v2_add(v2_add(v2_mul(p0, s*s), v2_mul(p1, 2.0f*s*t)), v2_mul(p2, t*t));
+    sb_push(*lines, prev);
+    sb_push(*lines, p);
+    prev = p;
+  }
+}
+
+// NOTE(lvl5): off curve points are quadratic controls, two in a row have an
+// implied on curve point between them
+void ttf_add_contour(V2 **lines, V2 *points, u8 *flags, i32 start, i32 end) {
+  bool start_on = flags[start] & 1;
+  bool end_on = flags[end] & 1;
+  
+  V2 first;
+  i32 first_index = start;
+  if (start_on) {
+    first = points[start];
+    first_index = start + 1;
+  } else if (end_on) {
+    first = points[end];
+    end--;
+  } else {
+    first = v2_mul(v2_add(points[start], points[end]), 0.5f);
+  }
+  
+  V2 pen = first;
+  V2 control = first;
+  bool has_control = false;
+  for (i32 i = first_index; i <= end; i++) {
+    V2 p = points[i];
+    if (flags[i] & 1) {
+      if (has_control) {
+        ttf_add_quad(lines, pen, control, p);
+      } else {
+        sb_push(*lines, pen);
+        sb_push(*lines, p);
+      }
+      pen = p;
+      has_control = false;
+    } else {
+      if (has_control) {
+        V2 mid = v2_mul(v2_add(control, p), 0.5f);
+        ttf_add_quad(lines, pen, control, mid);
+        pen = mid;
+      }
+      control = p;
+      has_control = true;
+    }
+  }
+  
+  if (has_control) {
+    ttf_add_quad(lines, pen, control, first);
+  } else {
+    sb_push(*lines, pen);
+    sb_push(*lines, first);
+  }
+}
+
+// NOTE(lvl5): m maps font units to pixels, x' = m0*x + m2*y + m4, y' = m1*x + m3*y + m5
+void ttf_add_glyph_lines(Ttf_Font *ttf, i32 glyph_index, f32 *m, V2 **lines, i32 depth) {
+  u32 glyph = ttf_get_glyph_offset(ttf, glyph_index);
+  if (glyph) {
+    i16 contour_count = ttf_i16(ttf, glyph);
+    
+    if (contour_count > 0) {
+      u32 end_points = glyph + 10;
+      i32 point_count = ttf_u16(ttf, end_points + 2*(contour_count - 1)) + 1;
+      u16 instruction_count = ttf_u16(ttf, end_points + 2*contour_count);
+      u32 p = end_points + 2*contour_count + 2 + instruction_count;
+      
+      u8 *flags = scratch_push_array(u8, point_count);
+      V2 *points = scratch_push_array(V2, point_count);
+      
+      for (i32 i = 0; i < point_count;) {
+        u8 flag = ttf_u8(ttf, p++);
+        flags[i++] = flag;
+        if (flag & 8) {
+          u8 repeat = ttf_u8(ttf, p++);
+          while (repeat-- && i < point_count) {
+            flags[i++] = flag;
+          }
+        }
+      }
+      
+      i32 x = 0;
+      for (i32 i = 0; i < point_count; i++) {
+        u8 flag = flags[i];
+        if (flag & 2) {
+          u8 dx = ttf_u8(ttf, p++);
+          x += (flag & 0x10) ? dx : -dx;
+        } else if (!(flag & 0x10)) {
+          x += ttf_i16(ttf, p);
+          p += 2;
+        }
+        points[i].x = (f32)x;
+      }
+      
+      i32 y = 0;
+      for (i32 i = 0; i < point_count; i++) {
+        u8 flag = flags[i];
+        if (flag & 4) {
+          u8 dy = ttf_u8(ttf, p++);
+          y += (flag & 0x20) ? dy : -dy;
+        } else if (!(flag & 0x20)) {
+          y += ttf_i16(ttf, p);
+          p += 2;
+        }
+        points[i].y = (f32)y;
+      }
+      
+      for (i32 i = 0; i < point_count; i++) {
+        V2 point = points[i];
+        points[i] = v2(m[0]*point.x + m[2]*point.y + m[4],
+                       m[1]*point.x + m[3]*point.y + m[5]);
+      }
+      
+      i32 start = 0;
+      for (i32 contour = 0; contour < contour_count; contour++) {
+        i32 end = ttf_u16(ttf, end_points + 2*contour);
+        if (end >= start && end < point_count) {
+          ttf_add_contour(lines, points, flags, start, end);
+        }
+        start = end + 1;
+      }
+    } else if (contour_count < 0 && depth < TTF_MAX_COMPOUND_DEPTH) {
+      u32 component = glyph + 10;
+      u16 component_flags;
+      do {
+        component_flags = ttf_u16(ttf, component);
+        i32 component_glyph = ttf_u16(ttf, component + 2);
+        component += 4;
+        
+        f32 dx = 0;
+        f32 dy = 0;
+        // args that are point numbers instead of offsets are not supported
+        if (component_flags & 1) {
+          if (component_flags & 2) {
+            dx = ttf_i16(ttf, component);
+            dy = ttf_i16(ttf, component + 2);
+          }
+          component += 4;
+        } else {
+          if (component_flags & 2) {
+            dx = (i8)ttf_u8(ttf, component);
+            dy = (i8)ttf_u8(ttf, component + 1);
+          }
+          component += 2;
+        }
+        
+        f32 a = 1;
+        f32 b = 0;
+        f32 c = 0;
+        f32 d = 1;
+        if (component_flags & 8) {
+          a = d = ttf_i16(ttf, component)/16384.0f;
+          component += 2;
+        } else if (component_flags & 0x40) {
+          a = ttf_i16(ttf, component)/16384.0f;
+          d = ttf_i16(ttf, component + 2)/16384.0f;
+          component += 4;
+        } else if (component_flags & 0x80) {
+          a = ttf_i16(ttf, component)/16384.0f;
+          b = ttf_i16(ttf, component + 2)/16384.0f;
+          c = ttf_i16(ttf, component + 4)/16384.0f;
+          d = ttf_i16(ttf, component + 6)/16384.0f;
+          component += 8;
+        }
+        
+        f32 component_m[6] = {
+          m[0]*a + m[2]*b,
+          m[1]*a + m[3]*b,
+          m[0]*c + m[2]*d,
+          m[1]*c + m[3]*d,
+          m[0]*dx + m[2]*dy + m[4],
+          m[1]*dx + m[3]*dy + m[5],
+        };
+        ttf_add_glyph_lines(ttf, component_glyph, component_m, lines, depth + 1);
+      } while (component_flags & 0x20);
+    }
+  }
+}
+
+// NOTE(lvl5): each line adds the area it covers to the pixel it crosses and the
+// rest of its height to the one after it, so a prefix sum over a row gives coverage.
+// accum rows have 2 extra floats at the end for that
+void ttf_accumulate_line(f32 *accum, i32 stride, i32 height, V2 p0, V2 p1) {
+  if (p0.y == p1.y) {
+    return;
+  }
+  
+  f32 dir = 1.0f;
+  if (p0.y > p1.y) {
+    V2 temp = p0;
+    p0 = p1;
+    p1 = temp;
+    dir = -1.0f;
+  }
+  
+  f32 dxdy = (p1.x - p0.x)/(p1.y - p0.y);
+  f32 x = p0.x;
+  if (p0.y < 0) {
+    x -= p0.y*dxdy;
+  }
+  i32 y_start = max(floor_f32_i32(p0.y), 0);
+  i32 y_end = min(ceil_f32_i32(p1.y), height);
+  
+  for (i32 y = y_start; y < y_end; y++) {
+    f32 *row = accum + y*stride;
+    f32 dy = min_f32((f32)(y + 1), p1.y) - max_f32((f32)y, p0.y);
+    f32 x_next = x + dxdy*dy;
+    f32 d = dy*dir;
+    
+    f32 x0 = max_f32(min_f32(x, x_next), 0);
+    f32 x1 = max_f32(max_f32(x, x_next), 0);
+    f32 x0_floor = floorf(x0);
+    i32 x0i = (i32)x0_floor;
+    f32 x1_ceil = ceil_f32(x1);
+    i32 x1i = (i32)x1_ceil;
+    
+    if (x1i <= x0i + 1) {
+      f32 x_mid = 0.5f*(x0 + x1) - x0_floor;
+      row[x0i] += d - d*x_mid;
+      row[x0i + 1] += d*x_mid;
+    } else {
+      f32 s = 1.0f/(x1 - x0);
+      f32 x0_fract = x0 - x0_floor;
+      f32 a0 = 0.5f*s*(1.0f - x0_fract)*(1.0f - x0_fract);
+      f32 x1_fract = x1 - x1_ceil + 1.0f;
+      f32 a_end = 0.5f*s*x1_fract*x1_fract;
+      
+      row[x0i] += d*a0;
+      if (x1i == x0i + 2) {
+        row[x0i + 1] += d*(1.0f - a0 - a_end);
+      } else {
+        f32 a1 = s*(1.5f - x0_fract);
+        row[x0i + 1] += d*(a1 - a0);
+        for (i32 xi = x0i + 2; xi < x1i - 1; xi++) {
+          row[xi] += d*s;
+        }
+        f32 a2 = a1 + (f32)(x1i - x0i - 3)*s;
+        row[x1i - 1] += d*(1.0f - a2 - a_end);
+      }
+      row[x1i] += d*a_end;
+    }
+    x = x_next;
+  }
+}
+
+// NOTE(lvl5): a Font_Rasterize. outlines aren't snapped to the pixel grid,
+// each glyph keeps its exact fractional position inside its bitmap
+void ttf_rasterize_glyph(void *data, u32 codepoint, Bitmap *atlas, Rect2i cell, Glyph *glyph) {
+  Ttf_Font *ttf = (Ttf_Font *)data;
+  Mem_Size mark = scratch_get_mark();
+  
+  i32 glyph_index = ttf_get_glyph_index(ttf, codepoint);
+  
+  push_scratch_context();
+  V2 *lines = sb_new(V2, 256);
+  f32 m[6] = {ttf->scale, 0, 0, ttf->scale, 0, 0};
+  ttf_add_glyph_lines(ttf, glyph_index, m, &lines, 0);
+  pop_context();
+  
+  i32 line_point_count = sb_count(lines);
+  i32 left = 0;
+  i32 bottom = 0;
+  i32 width = 0;
+  i32 height = 0;
+  
+  if (line_point_count) {
+    V2 min_p = lines[0];
+    V2 max_p = lines[0];
+    for (i32 i = 1; i < line_point_count; i++) {
+      min_p = v2(min_f32(min_p.x, lines[i].x), min_f32(min_p.y, lines[i].y));
+      max_p = v2(max_f32(max_p.x, lines[i].x), max_f32(max_p.y, lines[i].y));
+    }
+    
+    // 1 pixel of border, like the glyphs gdi gives
+    left = floor_f32_i32(min_p.x) - 1;
+    bottom = floor_f32_i32(min_p.y) - 1;
+    i32 full_width = ceil_f32_i32(max_p.x) + 1 - left;
+    i32 full_height = ceil_f32_i32(max_p.y) + 1 - bottom;
+    
+    i32 stride = full_width + 2;
+    f32 *accum = scratch_push_array(f32, stride*full_height);
+    zero_memory_slow(accum, sizeof(f32)*stride*full_height);
+    
+    V2 offset = v2((f32)-left, (f32)-bottom);
+    for (i32 i = 0; i < line_point_count; i += 2) {
+      ttf_accumulate_line(accum, stride, full_height,
+                          v2_add(lines[i], offset), v2_add(lines[i + 1], offset));
+    }
+    
+    // NOTE(lvl5): anything that doesn't fit the cell gets cut off
+    width = min(full_width, cell.max.x - cell.min.x);
+    height = min(full_height, cell.max.y - cell.min.y);
+    for (i32 y = 0; y < height; y++) {
+      f32 *row = accum + y*stride;
+      u32 *dst = atlas->data + (cell.min.y + y)*atlas->width + cell.min.x;
+      f32 coverage = 0;
+      for (i32 x = 0; x < width; x++) {
+        coverage += row[x];
+        u8 intensity = (u8)(min_f32(abs_f32(coverage), 1.0f)*255.0f + 0.5f);
+        dst[x] = color_u32(0xFF, 0xFF, 0xFF, intensity);
+      }
+    }
+  }
+  
+  // NOTE(lvl5): origins are relative to the top of the line, baseline is ascent below it
+  glyph->rect = rect2i_min_size(cell.min, v2i(width, height));
+  glyph->origin = v2((f32)left, (f32)(bottom - ttf->ascent_px));
+  glyph->advance = (i8)round_f32_i32(ttf_get_advance(ttf, glyph_index)*ttf->scale);
+  
+  scratch_set_mark(mark);
+}
+
+// NOTE(lvl5): kern pairs are by glyph index, only the ones between ascii glyphs are
+// turned back into codepoints
+void ttf_add_kerning(Ttf_Font *ttf, Font *font) {
+  if (ttf->kern) {
+    Mem_Size mark = scratch_get_mark();
+    u8 *glyph_codepoints = scratch_push_array(u8, ttf->glyph_count);
+    zero_memory_slow(glyph_codepoints, ttf->glyph_count);
+    for (u8 codepoint = ' '; codepoint < FONT_ASCII_COUNT; codepoint++) {
+      glyph_codepoints[ttf_get_glyph_index(ttf, codepoint)] = codepoint;
+    }
+    glyph_codepoints[0] = 0;
+    
+    u16 table_count = ttf_u16(ttf, ttf->kern + 2);
+    u32 subtable = ttf->kern + 4;
+    for (u16 table_index = 0; table_index < table_count; table_index++) {
+      u16 length = ttf_u16(ttf, subtable + 2);
+      u16 coverage = ttf_u16(ttf, subtable + 4);
+      bool is_horizontal_pairs = (coverage >> 8) == 0 && (coverage & 1);
+      
+      if (is_horizontal_pairs) {
+        u16 pair_count = ttf_u16(ttf, subtable + 6);
+        for (u16 i = 0; i < pair_count; i++) {
+          u32 pair = subtable + 14 + 6*i;
+          u8 left = glyph_codepoints[ttf_u16(ttf, pair) % ttf->glyph_count];
+          u8 right = glyph_codepoints[ttf_u16(ttf, pair + 2) % ttf->glyph_count];
+          i32 amount = round_f32_i32(ttf_i16(ttf, pair + 4)*ttf->scale);
+          if (left && right && amount) {
+            font_add_kerning(font, left, right, (i8)amount);
+          }
+        }
+      }
+      subtable += length;
+    }
+    scratch_set_mark(mark);
+  }
+}
+
+// NOTE(lvl5): ttf has to live as long as the font, glyphs keep being rasterized from it.
+// the ascii glyphs come from pinned_rasterize when it's given, which is how a cache
+// of them gets loaded
+Font font_from_ttf(Ttf_Font *ttf, Font_Rasterize *pinned_rasterize, void *pinned_data) {
+  Font font = {0};
+  font.line_height = (i8)round_f32_i32((ttf->ascent - ttf->descent)*ttf->scale);
+  font.line_spacing = (i8)round_f32_i32((ttf->ascent - ttf->descent + ttf->line_gap)*ttf->scale);
+  font.descent = (i8)round_f32_i32(-ttf->descent*ttf->scale);
+  
+  font.rasterize = pinned_rasterize ? pinned_rasterize : ttf_rasterize_glyph;
+  font.rasterizer_data = pinned_rasterize ? pinned_data : ttf;
+  i32 cell_size = font.line_height + 2;
+  font_init_cache(&font, cell_size, cell_size);
+  
+  font.rasterize = ttf_rasterize_glyph;
+  font.rasterizer_data = ttf;
+  ttf_add_kerning(ttf, &font);
+  return font;
+}
+
+#define LVL5_TRUETYPE_H
+#endif
@@ -0,0 +1,134 @@
+#ifndef LVL5_UTF8_H
+
+#include "lvl5_types.h"
+#include "lvl5_intrinsics.h"
+
+#define UTF8_REPLACEMENT_CHAR 0xFFFD
+
+bool utf8_is_continuation(char c) {
+  bool result = ((u8)c & 0xC0) == 0x80;
+  return result;
+}
+
+// NOTE(lvl5): how long the sequence starting with lead would be,
+// 1 for ascii and for bytes that can't start a sequence
+i32 utf8_sequence_length(char lead) {
+  u8 c = (u8)lead;
+  i32 result = 1;
+  if (c >= 0xF0 && c <= 0xF4) {
+    result = 4;
+  } else if (c >= 0xE0 && c < 0xF0) {
+    result = 3;
+  } else if (c >= 0xC2 && c < 0xE0) {
+    result = 2;
+  }
+  return result;
+}
+
+// NOTE(lvl5): length of the valid sequence at s, 0 if it is not one.
+// overlong encodings, surrogates and anything past 0x10FFFF are invalid
+i32 utf8_decode_valid(char *s, i32 count, u32 *codepoint) {
+  u8 c = (u8)s[0];
+  i32 length = utf8_sequence_length(s[0]);
+  i32 result = 0;
+  
+  if (c < 0x80) {
+    *codepoint = c;
+    result = 1;
+  } else if (length > 1 && length <= count) {
+    u32 value = c & (0xFF >> (length + 1));
+    bool valid = true;
+    for (i32 i = 1; i < length; i++) {
+      valid = valid && utf8_is_continuation(s[i]);
+      value = (value << 6) | ((u8)s[i] & 0x3F);
+    }
+    
+    valid = valid &&
+      !(length == 3 && value < 0x800) &&
+      !(length == 4 && (value < 0x10000 || value > 0x10FFFF)) &&
+      !(value >= 0xD800 && value <= 0xDFFF);
+    if (valid) {
+      *codepoint = value;
+      result = length;
+    }
+  }
+  return result;
+}
+
+// NOTE(lvl5): invalid bytes decode to UTF8_REPLACEMENT_CHAR one at a time,
+// so every byte stays reachable and nothing gets lost on save
+u32 utf8_decode(char *s, i32 count, i32 *length) {
+  u32 result = UTF8_REPLACEMENT_CHAR;
+  *length = utf8_decode_valid(s, count, &result);
+  if (*length == 0) {
+    result = UTF8_REPLACEMENT_CHAR;
+    *length = 1;
+  }
+  return result;
+}
+
+// NOTE(lvl5): dst needs room for 4 bytes, returns how many were written
+i32 utf8_encode(u32 codepoint, char *dst) {
+  i32 result = 0;
+  if (codepoint < 0x80) {
+    dst[result++] = (char)codepoint;
+  } else if (codepoint < 0x800) {
+    dst[result++] = (char)(0xC0 | (codepoint >> 6));
+    dst[result++] = (char)(0x80 | (codepoint & 0x3F));
+  } else if (codepoint < 0x10000) {
+    dst[result++] = (char)(0xE0 | (codepoint >> 12));
+    dst[result++] = (char)(0x80 | ((codepoint >> 6) & 0x3F));
+    dst[result++] = (char)(0x80 | (codepoint & 0x3F));
+  } else {
+    dst[result++] = (char)(0xF0 | (codepoint >> 18));
+    dst[result++] = (char)(0x80 | ((codepoint >> 12) & 0x3F));
+    dst[result++] = (char)(0x80 | ((codepoint >> 6) & 0x3F));
+    dst[result++] = (char)(0x80 | (codepoint & 0x3F));
+  }
+  return result;
+}
+
+// NOTE(lvl5): source files are almost all ascii, so 16 bytes get checked at once
+// and only blocks with a high bit set go through the decoder
+bool utf8_validate(char *data, u64 count) {
+  bool result = true;
+  u64 i = 0;
+  while (result && i < count) {
+    if (i + 16 <= count) {
+      __m128i block = _mm_loadu_si128((__m128i *)(data + i));
+      if (_mm_movemask_epi8(block) == 0) {
+        i += 16;
+        continue;
+      }
+    }
+    
+    u32 codepoint;
+    i32 left = count - i < 4 ? (i32)(count - i) : 4;
+    i32 length = utf8_decode_valid(data + i, left, &codepoint);
+    if (length == 0) {
+      result = false;
+    }
+    i += length;
+  }
+  return result;
+}
+
+// NOTE(lvl5): counts the bytes that start a codepoint
+i32 utf8_count_codepoints(char *data, i32 count) {
+  i32 result = 0;
+  i32 i = 0;
+  // continuation bytes are 0x80-0xBF, which is below -64 as signed
+  __m128i continuation_limit = _mm_set1_epi8(-64);
+  for (; i + 16 <= count; i += 16) {
+    __m128i block = _mm_loadu_si128((__m128i *)(data + i));
+    u32 continuation = _mm_movemask_epi8(_mm_cmplt_epi8(block, continuation_limit));
+    result += 16 - count_set_bits(continuation);
+  }
+  for (; i < count; i++) {
+    result += !utf8_is_continuation(data[i]);
+  }
+  return result;
+}
+
+#define LVL5_UTF8_H
+#endif
@@ -139,10 +139,19 @@ os_entry_point() {
     .close_file = os_close_file,
     .read_file = os_read_file,
     .get_file_size = os_get_file_size,
+    .get_file_info = os_get_file_info,
+    .map_file = os_map_file,
+    .unmap_file = os_unmap_file,
+    .write_entire_file = os_write_entire_file,
+    .set_clipboard = os_set_clipboard,
+    .get_clipboard = os_get_clipboard,
+    .get_clipboard_sequence = os_get_clipboard_sequence,
+    .wake_main_thread = os_wake_main_thread,
     .debug_pring = OutputDebugStringA,
     
     .thread_queue = thread_queue,
     .queue_add = queue_add,
+    .thread_count = THREAD_COUNT,
     
     .context_info = global_context_info,
     .profiler_event_capacity = profiler_event_capacity,
@@ -204,9 +213,16 @@ os_entry_point() {
     }
     
     
+    // NOTE(lvl5): the timeout is only there so a rebuilt dll still gets picked up
+    if (!memory.busy && !memory.reloaded) {
+      os_wait_for_messages(250);
+    }
+    
     editor_update(os, &memory, &input);
     
-    os_blit_to_screen();
+    if (memory.drawn) {
+      os_blit_to_screen();
+    }
   }
   
   return 0;
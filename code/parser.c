@@ -24,13 +24,176 @@ b32 is_whitespace(char c) {
 }
 
 
+// NOTE(lvl5): SSE2 fast paths for the lexer.
+// each of these scans one contiguous side of the gap and returns how many
+// bytes from the start belong to the run, so they never have to know about
+// the gap themselves. the tails shorter than 16 bytes are done one char at a time
+// so we never read past the end of the segment.
 
-void set_color(Parser *p, Token *t, Syntax color) {
-  begin_profiler_function();
-  for (i32 i = t->start; i < t->end; i++) {
-    p->buffer->cache.colors[i] = color;
+i32 lex_count_whitespace(char *data, i32 count) {
+  i32 result = 0;
+  __m128i space = _mm_set1_epi8(' ');
+  __m128i newline = _mm_set1_epi8('\n');
+  __m128i carriage = _mm_set1_epi8('\r');
+  
+  while (result + 16 <= count) {
+    __m128i chunk = _mm_loadu_si128((__m128i *)(data + result));
+    __m128i is_space = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(chunk, space),
+                                                 _mm_cmpeq_epi8(chunk, newline)),
+                                    _mm_cmpeq_epi8(chunk, carriage));
+    u32 not_space = (u32)_mm_movemask_epi8(is_space) ^ 0xFFFF;
+    if (not_space) {
+      result += find_least_significant_set_bit(not_space);
+      return result;
+    }
+    result += 16;
   }
-  end_profiler_function();
+  
+  while (result < count &&
+         (data[result] == ' ' || data[result] == '\n' || data[result] == '\r'))
+  {
+    result++;
+  }
+  return result;
+}
+
+i32 lex_count_identifier(char *data, i32 count) {
+  i32 result = 0;
+  // NOTE(lvl5): signed compares, so bytes >= 0x80 are negative and never match
+  __m128i digit_min = _mm_set1_epi8('0' - 1);
+  __m128i digit_max = _mm_set1_epi8('9' + 1);
+  __m128i lower_min = _mm_set1_epi8('a' - 1);
+  __m128i lower_max = _mm_set1_epi8('z' + 1);
+  __m128i upper_min = _mm_set1_epi8('A' - 1);
+  __m128i upper_max = _mm_set1_epi8('Z' + 1);
+  __m128i underscore = _mm_set1_epi8('_');
+  
+  while (result + 16 <= count) {
+    __m128i chunk = _mm_loadu_si128((__m128i *)(data + result));
+    __m128i is_digit_mask = _mm_and_si128(_mm_cmpgt_epi8(chunk, digit_min),
+                                          _mm_cmplt_epi8(chunk, digit_max));
+    __m128i is_lower_mask = _mm_and_si128(_mm_cmpgt_epi8(chunk, lower_min),
+                                          _mm_cmplt_epi8(chunk, lower_max));
+    __m128i is_upper_mask = _mm_and_si128(_mm_cmpgt_epi8(chunk, upper_min),
+                                          _mm_cmplt_epi8(chunk, upper_max));
+    __m128i is_ident = _mm_or_si128(_mm_or_si128(is_digit_mask, is_lower_mask),
+                                    _mm_or_si128(is_upper_mask,
+                                                 _mm_cmpeq_epi8(chunk, underscore)));
+    u32 not_ident = (u32)_mm_movemask_epi8(is_ident) ^ 0xFFFF;
+    if (not_ident) {
+      result += find_least_significant_set_bit(not_ident);
+      return result;
+    }
+    result += 16;
+  }
+  
+  while (result < count && (is_digit(data[result]) || is_alpha(data[result]))) {
+    result++;
+  }
+  return result;
+}
+
+// returns the index of the first char equal to any of a, b, c, d
+// or count if there is none. pass the same char several times if you need less than 4
+i32 lex_find_any(char *data, i32 count, char a, char b, char c, char d) {
+  i32 result = 0;
+  __m128i wide_a = _mm_set1_epi8(a);
+  __m128i wide_b = _mm_set1_epi8(b);
+  __m128i wide_c = _mm_set1_epi8(c);
+  __m128i wide_d = _mm_set1_epi8(d);
+  
+  while (result + 16 <= count) {
+    __m128i chunk = _mm_loadu_si128((__m128i *)(data + result));
+    __m128i found = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(chunk, wide_a),
+                                              _mm_cmpeq_epi8(chunk, wide_b)),
+                                 _mm_or_si128(_mm_cmpeq_epi8(chunk, wide_c),
+                                              _mm_cmpeq_epi8(chunk, wide_d)));
+    u32 mask = (u32)_mm_movemask_epi8(found);
+    if (mask) {
+      result += find_least_significant_set_bit(mask);
+      return result;
+    }
+    result += 16;
+  }
+  
+  while (result < count) {
+    char ch = data[result];
+    if (ch == a || ch == b || ch == c || ch == d) {
+      break;
+    }
+    result++;
+  }
+  return result;
+}
+
+bool memory_equal(char *a, char *b, i64 count) {
+  bool result = memcmp(a, b, count) == 0;
+  return result;
+}
+
+// NOTE(lvl5): compares the first and the last byte of the needle at 16 positions
+// at once, and only does the full compare where both of them match.
+// returns -1 if there is no match
+i64 find_literal(char *data, i64 count, String needle) {
+  i64 needle_count = (i64)needle.count;
+  i64 result = -1;
+  
+  if (needle_count > 0 && needle_count <= count) {
+    __m128i first = _mm_set1_epi8(needle.data[0]);
+    __m128i last = _mm_set1_epi8(needle.data[needle_count - 1]);
+    
+    i64 i = 0;
+    for (; i + needle_count - 1 + 16 <= count; i += 16) {
+      __m128i block_first = _mm_loadu_si128((__m128i *)(data + i));
+      __m128i block_last = _mm_loadu_si128((__m128i *)(data + i + needle_count - 1));
+      __m128i eq = _mm_and_si128(_mm_cmpeq_epi8(first, block_first),
+                                 _mm_cmpeq_epi8(last, block_last));
+      u32 mask = (u32)_mm_movemask_epi8(eq);
+      
+      while (mask) {
+        u32 bit = find_least_significant_set_bit(mask);
+        if (needle_count <= 2 ||
+            memory_equal(data + i + bit + 1, needle.data + 1, needle_count - 2))
+        {
+          result = i + bit;
+          break;
+        }
+        mask &= mask - 1;
+      }
+      if (result >= 0) break;
+    }
+    
+    for (; result < 0 && i + needle_count <= count; i++) {
+      if (memory_equal(data + i, needle.data, needle_count)) {
+        result = i;
+      }
+    }
+  }
+  
+  return result;
+}
+
+i64 count_newlines(char *data, i64 count) {
+  i64 result = 0;
+  __m128i newline = _mm_set1_epi8('\n');
+  
+  i64 i = 0;
+  for (; i + 16 <= count; i += 16) {
+    __m128i chunk = _mm_loadu_si128((__m128i *)(data + i));
+    u32 mask = (u32)_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, newline));
+    result += count_set_bits(mask);
+  }
+  for (; i < count; i++) {
+    if (data[i] == '\n') result++;
+  }
+  
+  return result;
+}
+
+
+
+void set_color(Parser *p, Token *t, Syntax color) {
+  t->color = color;
 }
 
 void set_color_by_type(Parser *p, Token *t) {
@@ -70,6 +233,23 @@ u32 hash_string(String key) {
   return hash;
 }
 
+#define HASH_BYTES_64_SEED 14695981039346656037ull
+
+// NOTE(lvl5): hashing two pieces one after the other is the same as hashing them together
+u64 hash_bytes_64_continue(u64 hash, void *data, u64 size) {
+  byte *bytes = (byte *)data;
+  for (u64 i = 0; i < size; i++) {
+    hash ^= bytes[i];
+    hash *= 1099511628211ull;
+  }
+  return hash;
+}
+
+u64 hash_bytes_64(void *data, u64 size) {
+  u64 result = hash_bytes_64_continue(HASH_BYTES_64_SEED, data, size);
+  return result;
+}
+
 u32 keyword_map_get_index(Keyword_Map *map, String name) {
   u32 hash = hash_string(name);
   u32 result = 0;
@@ -126,14 +306,37 @@ void buffer_tokenize(Parser *p) {
     i++; \
     if (i == gap_start) add = gap_count;\
   }
-#define skip_syntax(syntax) { \
-    p->buffer->cache.colors[i] = syntax; \
+#define skip() { \
     next(); \
     t.start++; \
   }
 #define eat() { \
     next(); \
   }
+  
+  // NOTE(lvl5): the run helpers work on the contiguous part of the buffer
+  // that i is in, and keep calling the scanner until it stops short of
+  // the segment end, so runs that straddle the gap are handled too
+#define segment_count() ((i < gap_start ? gap_start : b->count) - i)
+#define advance(n) { \
+    i += (n); \
+    if (i == gap_start) add = gap_count; \
+  }
+#define eat_run(scan) { \
+    for (i32 _run = (scan); _run > 0; _run = (scan)) { \
+      advance(_run); \
+    } \
+  }
+#define skip_run(scan) { \
+    for (i32 _run = (scan); _run > 0; _run = (scan)) { \
+      t.start += _run; \
+      advance(_run); \
+    } \
+  }
+#define end_comment(comment_start) { \
+    Color_Span span = { .start = comment_start, .end = i, .color = Syntax_COMMENT }; \
+    sb_push(p->buffer->cache.comments, span); \
+  }
 #define end_no_continue(tok_type) { \
     t.type = tok_type; \
     t.end = i; \
@@ -173,9 +376,7 @@ void buffer_tokenize(Parser *p) {
   } break;
   
   while (true) {
-    while (get(0) == ' ' || get(0) == '\n' || get(0) == '\r') {
-      skip_syntax(Syntax_DEFAULT);
-    }
+    skip_run(lex_count_whitespace(&get(0), segment_count()));
     
     switch (get(0)) {
       case 0: {
@@ -183,17 +384,18 @@ void buffer_tokenize(Parser *p) {
       } break;
       
       case '\r': {
-        skip_syntax(Syntax_DEFAULT);
+        skip();
       } break;
       case ' ': {
-        skip_syntax(Syntax_DEFAULT);
+        skip();
       } break;
       case '\n': {
-        skip_syntax(Syntax_DEFAULT);
+        skip();
       } break;
       case '"': {
         eat();
         while (true) {
+          eat_run(lex_find_any(&get(0), segment_count(), '"', '\\', '\n', '\0'));
           if (get(0) == '\\') {
             eat();
             eat();
@@ -215,6 +417,7 @@ void buffer_tokenize(Parser *p) {
         eat();
         
         while (true) {
+          eat_run(lex_find_any(&get(0), segment_count(), '\'', '\\', '\n', '\0'));
           if (get(0) == '\\') {
             eat();
             eat();
@@ -274,7 +477,7 @@ void buffer_tokenize(Parser *p) {
       
       case '_': {
         eat();
-        while (is_digit(get(0)) || is_alpha(get(0))) eat();
+        eat_run(lex_count_identifier(&get(0), segment_count()));
         
         
         String token_string = buffer_part_to_string(b, t.start, i);
@@ -288,24 +491,29 @@ void buffer_tokenize(Parser *p) {
       } break;
       
       case '/': {
+        i32 comment_start = i;
         if (get(1) == '/') {
-          skip_syntax(Syntax_COMMENT);
-          skip_syntax(Syntax_COMMENT);
-          while (get(0) != '\n') {
-            skip_syntax(Syntax_COMMENT);
-          }
+          skip();
+          skip();
+          skip_run(lex_find_any(&get(0), segment_count(), '\n', '\0', '\0', '\0'));
+          end_comment(comment_start);
         } else if (get(1) == '*') {
-          skip_syntax(Syntax_COMMENT);
-          skip_syntax(Syntax_COMMENT);
-          while (!(get(0) == '*' && get(1) == '/')) {
+          skip();
+          skip();
+          while (true) {
+            skip_run(lex_find_any(&get(0), segment_count(), '*', '\0', '\0', '\0'));
             if (get(0) == '\0') {
+              end_comment(comment_start);
               goto end;
+            } else if (get(1) == '/') {
+              break;
             } else {
-              skip_syntax(Syntax_COMMENT);
+              skip();
             }
           }
-          skip_syntax(Syntax_COMMENT);
-          skip_syntax(Syntax_COMMENT);
+          skip();
+          skip();
+          end_comment(comment_start);
         } else {
           eat();
           if (get(0) == '=') {
@@ -322,15 +530,19 @@ void buffer_tokenize(Parser *p) {
         end_no_continue(T_POUND);
         
         while (get(0) == ' ') {
-          skip_syntax(Syntax_DEFAULT);
+          skip();
         }
         
+        // NOTE(lvl5): <foo/bar.h> is one string token, which is all the parser
+        // looks for after #include
         i32 saved = i;
         if (get(0) == '<') {
-          while (get(0) != '>') {
+          while (get(0) != '>' && get(0) != '\n' && get(0) != '\0') {
+            eat();
+          }
+          if (get(0) == '>') {
             eat();
           }
-          eat();
           end(T_STRING_LITERAL);
         } else {
           i = saved;
@@ -373,7 +585,6 @@ void buffer_tokenize(Parser *p) {
   
   end:
   
-  b->cache.colors[b->count-1] = Syntax_DEFAULT;
   end_no_continue(T_END_OF_FILE);
   
   end_profiler_function();
@@ -411,10 +622,10 @@ void scope_insert_symbol(Scope *scope, String name, Symbol s) {
   assert(scope->count <= scope->capacity);
 }
 
-void add_symbol(Scope *scope, String name, Syntax type) {
+void add_symbol(Scope *scope, String name, Token *token, Syntax type) {
   begin_profiler_function();
   
-  Symbol s = (Symbol){ .type = type };
+  Symbol s = (Symbol){ .type = type, .token = token };
   s.name = make_string(alloc_array(char, name.count), name.count);
   copy_memory_slow(s.name.data, name.data, name.count);
   scope_insert_symbol(scope, name, s);
@@ -422,8 +633,8 @@ void add_symbol(Scope *scope, String name, Syntax type) {
   end_profiler_function();
 }
 
-void add_symbol_buffer(Parser *p, String name, Syntax type) {
-  add_symbol(p->scope, name, type);
+void add_symbol_buffer(Parser *p, Token *token, Syntax type) {
+  add_symbol(p->scope, token_to_string(p->buffer, token), token, type);
 }
 
 Symbol *get_symbol_in_scope(Scope *scope, String symbol_name) {
@@ -513,10 +724,10 @@ Token *parse_direct_declarator(Parser *p, bool is_typedef, bool is_arg) {
     
     if (is_typedef) {
       // token_to_string is scratch
-      add_symbol_buffer(p, token_to_string(p->buffer, result), Syntax_TYPE);
+      add_symbol_buffer(p, result, Syntax_TYPE);
       set_color(p, result, Syntax_TYPE);
     } else if (is_arg) {
-      add_symbol_buffer(p, token_to_string(p->buffer, result), Syntax_ARG);
+      add_symbol_buffer(p, result, Syntax_ARG);
       set_color(p, result, Syntax_ARG);
     }
   } else if (accept_token(p, T_LPAREN)) {
@@ -532,7 +743,7 @@ Token *parse_direct_declarator(Parser *p, bool is_typedef, bool is_arg) {
   } else if (accept_token(p, T_LPAREN)) {
     // function decl
     if (!is_typedef) {
-      add_symbol_buffer(p, token_to_string(p->buffer, result), Syntax_FUNCTION);
+      add_symbol_buffer(p, result, Syntax_FUNCTION);
       set_color(p, result, Syntax_FUNCTION);
     }
     
@@ -600,7 +811,7 @@ bool parse_struct_specifier(Parser *p) {
       Token *struct_name = peek_token(p, -1);
       set_color(p, struct_name, Syntax_TYPE);
       // token_to_string is scratch
-      add_symbol_buffer(p, token_to_string(p->buffer, struct_name), Syntax_TYPE);
+      add_symbol_buffer(p, struct_name, Syntax_TYPE);
       has_name = true;
     }
     
@@ -654,7 +865,7 @@ bool parse_enum_specifier(Parser *p) {
       Token *struct_name = peek_token(p, -1);
       set_color(p, struct_name, Syntax_TYPE);
       // token_to_string is scratch
-      add_symbol_buffer(p, token_to_string(p->buffer, struct_name), Syntax_TYPE);
+      add_symbol_buffer(p, struct_name, Syntax_TYPE);
       has_name = true;
     }
     
@@ -666,7 +877,7 @@ bool parse_enum_specifier(Parser *p) {
         if (accept_token(p, T_NAME)) {
           Token *name = peek_token(p, -1);
           set_color(p, name, Syntax_ENUM_MEMBER);
-          add_symbol_buffer(p, token_to_string(p->buffer, name), Syntax_ENUM_MEMBER);
+          add_symbol_buffer(p, name, Syntax_ENUM_MEMBER);
           if (accept_token(p, T_ASSIGN)) {
             while (!accept_token(p, T_COMMA)) {
               next_token(p);
@@ -879,24 +1090,23 @@ void parse_any(Parser *p) {
         next_token(p);
         Token *macro = peek_token(p, 0);
         set_color(p, macro, Syntax_MACRO);
-        add_symbol_buffer(p, token_to_string(p->buffer, macro), Syntax_MACRO);
+        add_symbol_buffer(p, macro, Syntax_MACRO);
         next_token(p);
       } else if (string_compare(token_string, const_string("#include"))) {
         next_token(p);
         
-        Token *dependency = peek_token(p, 0);
+        Token *path_token = peek_token(p, 0);
         if (accept_token(p, T_STRING_LITERAL)) {
-          String dep_string = token_to_string(p->buffer, dependency);
-          if (dep_string.count >= 2) {
-            // trimming the quotes
-            dep_string.data++;
-            dep_string.count -= 2;
-            
-            sb_push(p->buffer->cache.dependencies, 
-                    alloc_string(dep_string.data, dep_string.count));
+          String include = buffer_part_to_string(p->buffer, path_token->start,
+                                                 path_token->end);
+          String dep_path = resolve_include_path(p->buffer->editor,
+                                                 p->buffer->path,
+                                                 include);
+          if (dep_path.count) {
+            sb_push(p->buffer->cache.dependencies, dep_path);
             
             Buffer *dep_buffer = get_existing_buffer(p->buffer->editor, 
-                                                     dep_string);
+                                                     dep_path);
             if (dep_buffer) {
               Scope *dep_scope = dep_buffer->cache.scope;
               for (u32 symbol_index = 0;
@@ -250,6 +250,7 @@ enum {
   Syntax_NUMBER,
   Syntax_STRING,
   Syntax_ENUM_MEMBER,
+  Syntax_FIND_MATCH,
   
   Syntax_count,
 };
@@ -279,9 +280,17 @@ typedef struct Token {
   Token_Type type;
   i32 start;
   i32 end;
+  Syntax color;
   Symbol declaration;
 } Token;
 
+// NOTE(lvl5): text that is colored but is not a token (comments)
+typedef struct {
+  i32 start;
+  i32 end;
+  Syntax color;
+} Color_Span;
+
 typedef struct Buffer Buffer;
 
 
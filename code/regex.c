@@ -0,0 +1,668 @@
+#include "regex.h"
+
+bool regex_class_has(Regex_Class *c, u8 ch) {
+  bool result = (c->bits[ch >> 5] >> (ch & 31)) & 1;
+  return result;
+}
+
+void regex_class_set(Regex_Class *c, u8 ch) {
+  c->bits[ch >> 5] |= 1u << (ch & 31);
+}
+
+void regex_class_set_range(Regex_Class *c, u8 first, u8 last) {
+  for (i32 ch = first; ch <= last; ch++) {
+    regex_class_set(c, (u8)ch);
+  }
+}
+
+void regex_class_add(Regex_Class *dst, Regex_Class *src) {
+  for (i32 i = 0; i < array_count(dst->bits); i++) {
+    dst->bits[i] |= src->bits[i];
+  }
+}
+
+void regex_class_negate(Regex_Class *c) {
+  for (i32 i = 0; i < array_count(c->bits); i++) {
+    c->bits[i] = ~c->bits[i];
+  }
+}
+
+// NOTE(lvl5): the char after a backslash
+Regex_Class regex_escape_class(char ch) {
+  Regex_Class result = {0};
+  switch (ch) {
+    case 'd': case 'D': {
+      regex_class_set_range(&result, '0', '9');
+    } break;
+    case 'w': case 'W': {
+      regex_class_set_range(&result, 'a', 'z');
+      regex_class_set_range(&result, 'A', 'Z');
+      regex_class_set_range(&result, '0', '9');
+      regex_class_set(&result, '_');
+    } break;
+    case 's': case 'S': {
+      regex_class_set(&result, ' ');
+      regex_class_set(&result, '\t');
+      regex_class_set(&result, '\n');
+      regex_class_set(&result, '\r');
+      regex_class_set(&result, '\v');
+      regex_class_set(&result, '\f');
+    } break;
+    case 'n': {
+      regex_class_set(&result, '\n');
+    } break;
+    case 't': {
+      regex_class_set(&result, '\t');
+    } break;
+    case 'r': {
+      regex_class_set(&result, '\r');
+    } break;
+    default: {
+      regex_class_set(&result, (u8)ch);
+    } break;
+  }
+  
+  if (ch == 'D' || ch == 'W' || ch == 'S') {
+    regex_class_negate(&result);
+  }
+  return result;
+}
+
+i32 regex_add_state(Regex *re, Regex_Op op, i32 class_index, i32 out, i32 out1) {
+  Regex_State state = {
+    .op = op,
+    .class_index = class_index,
+    .out = out,
+    .out1 = out1,
+  };
+  sb_push(re->states, state);
+  i32 result = sb_count(re->states) - 1;
+  return result;
+}
+
+Regex_Fragment regex_fragment(Regex *re, Regex_Op op, i32 class_index) {
+  Regex_Fragment result;
+  result.end = regex_add_state(re, Regex_Op_EMPTY, -1, -1, -1);
+  result.start = regex_add_state(re, op, class_index, result.end, -1);
+  return result;
+}
+
+Regex_Fragment regex_class_fragment(Regex *re, Regex_Class c) {
+  sb_push(re->classes, c);
+  Regex_Fragment result = regex_fragment(re, Regex_Op_CLASS, sb_count(re->classes) - 1);
+  return result;
+}
+
+Regex_Fragment regex_concat(Regex *re, Regex_Fragment a, Regex_Fragment b) {
+  re->states[a.end].out = b.start;
+  Regex_Fragment result = {a.start, b.end};
+  return result;
+}
+
+Regex_Fragment regex_alternate(Regex *re, Regex_Fragment a, Regex_Fragment b) {
+  Regex_Fragment result;
+  result.end = regex_add_state(re, Regex_Op_EMPTY, -1, -1, -1);
+  result.start = regex_add_state(re, Regex_Op_SPLIT, -1, a.start, b.start);
+  re->states[a.end].out = result.end;
+  re->states[b.end].out = result.end;
+  return result;
+}
+
+Regex_Fragment regex_repeat(Regex *re, Regex_Fragment a, char op) {
+  Regex_Fragment result;
+  result.end = regex_add_state(re, Regex_Op_EMPTY, -1, -1, -1);
+  i32 split = regex_add_state(re, Regex_Op_SPLIT, -1, a.start, result.end);
+  
+  switch (op) {
+    case '*': {
+      re->states[a.end].out = split;
+      result.start = split;
+    } break;
+    case '+': {
+      re->states[a.end].out = split;
+      result.start = a.start;
+    } break;
+    case '?': {
+      re->states[a.end].out = result.end;
+      result.start = split;
+    } break;
+    invalid_default_case;
+  }
+  return result;
+}
+
+bool regex_parser_has(Regex_Parser *p) {
+  bool result = p->pos < (i32)p->pattern.count;
+  return result;
+}
+
+char regex_parser_peek(Regex_Parser *p) {
+  char result = regex_parser_has(p) ? p->pattern.data[p->pos] : 0;
+  return result;
+}
+
+Regex_Fragment regex_parse_alternation(Regex_Parser *p);
+
+Regex_Fragment regex_parse_class(Regex_Parser *p) {
+  Regex_Class result = {0};
+  
+  bool negate = false;
+  if (regex_parser_peek(p) == '^') {
+    negate = true;
+    p->pos++;
+  }
+  
+  bool first = true;
+  while (regex_parser_has(p) && (first || regex_parser_peek(p) != ']')) {
+    first = false;
+    char ch = p->pattern.data[p->pos++];
+    
+    if (ch == '\\') {
+      if (!regex_parser_has(p)) break;
+      Regex_Class escaped = regex_escape_class(p->pattern.data[p->pos++]);
+      regex_class_add(&result, &escaped);
+    } else if (regex_parser_peek(p) == '-' &&
+               p->pos + 1 < (i32)p->pattern.count &&
+               p->pattern.data[p->pos + 1] != ']') {
+      char last = p->pattern.data[p->pos + 1];
+      p->pos += 2;
+      if ((u8)last < (u8)ch) {
+        p->error = true;
+      }
+      regex_class_set_range(&result, (u8)ch, (u8)last);
+    } else {
+      regex_class_set(&result, (u8)ch);
+    }
+  }
+  
+  if (regex_parser_peek(p) == ']') {
+    p->pos++;
+  } else {
+    p->error = true;
+  }
+  
+  if (negate) {
+    regex_class_negate(&result);
+  }
+  return regex_class_fragment(p->re, result);
+}
+
+Regex_Fragment regex_parse_atom(Regex_Parser *p) {
+  Regex *re = p->re;
+  Regex_Fragment result = {0};
+  
+  char ch = p->pattern.data[p->pos++];
+  switch (ch) {
+    case '(': {
+      result = regex_parse_alternation(p);
+      if (regex_parser_peek(p) == ')') {
+        p->pos++;
+      } else {
+        p->error = true;
+      }
+    } break;
+    case '[': {
+      result = regex_parse_class(p);
+    } break;
+    case '.': {
+      Regex_Class any = {0};
+      regex_class_set(&any, '\n');
+      regex_class_negate(&any);
+      result = regex_class_fragment(re, any);
+    } break;
+    case '^': {
+      result = regex_fragment(re, Regex_Op_LINE_START, -1);
+    } break;
+    case '$': {
+      result = regex_fragment(re, Regex_Op_LINE_END, -1);
+    } break;
+    case '\\': {
+      if (regex_parser_has(p)) {
+        result = regex_class_fragment(re, regex_escape_class(p->pattern.data[p->pos++]));
+      } else {
+        p->error = true;
+        result = regex_fragment(re, Regex_Op_EMPTY, -1);
+      }
+    } break;
+    case '*': case '+': case '?': {
+      p->error = true;
+      result = regex_fragment(re, Regex_Op_EMPTY, -1);
+    } break;
+    default: {
+      Regex_Class literal = {0};
+      regex_class_set(&literal, (u8)ch);
+      result = regex_class_fragment(re, literal);
+    } break;
+  }
+  return result;
+}
+
+Regex_Fragment regex_parse_repeat(Regex_Parser *p) {
+  Regex_Fragment result = regex_parse_atom(p);
+  
+  char op = regex_parser_peek(p);
+  while (op == '*' || op == '+' || op == '?') {
+    p->pos++;
+    result = regex_repeat(p->re, result, op);
+    op = regex_parser_peek(p);
+  }
+  return result;
+}
+
+Regex_Fragment regex_parse_concat(Regex_Parser *p) {
+  i32 empty = regex_add_state(p->re, Regex_Op_EMPTY, -1, -1, -1);
+  Regex_Fragment result = {empty, empty};
+  
+  while (regex_parser_has(p) &&
+         regex_parser_peek(p) != '|' &&
+         regex_parser_peek(p) != ')') {
+    result = regex_concat(p->re, result, regex_parse_repeat(p));
+  }
+  return result;
+}
+
+Regex_Fragment regex_parse_alternation(Regex_Parser *p) {
+  Regex_Fragment result = regex_parse_concat(p);
+  
+  while (regex_parser_peek(p) == '|') {
+    p->pos++;
+    result = regex_alternate(p->re, result, regex_parse_concat(p));
+  }
+  return result;
+}
+
+// NOTE(lvl5): fills re->closure with the sorted set of states reachable from seeds
+// without consuming a char. only states that consume or assert something are kept
+void regex_closure(Regex *re, i32 *seeds, i32 seed_count, bool at_line_start) {
+  sb_count(re->closure) = 0;
+  sb_count(re->stack) = 0;
+  re->visit_generation++;
+  
+  for (i32 i = 0; i < seed_count; i++) {
+    sb_push(re->stack, seeds[i]);
+  }
+  
+  while (sb_count(re->stack)) {
+    i32 index = re->stack[--sb_count(re->stack)];
+    if (index < 0 || re->visited[index] == re->visit_generation) continue;
+    re->visited[index] = re->visit_generation;
+    
+    Regex_State *state = re->states + index;
+    switch (state->op) {
+      case Regex_Op_EMPTY: {
+        sb_push(re->stack, state->out);
+      } break;
+      case Regex_Op_SPLIT: {
+        sb_push(re->stack, state->out1);
+        sb_push(re->stack, state->out);
+      } break;
+      case Regex_Op_LINE_START: {
+        if (at_line_start) {
+          sb_push(re->stack, state->out);
+        }
+      } break;
+      case Regex_Op_CLASS:
+      case Regex_Op_LINE_END:
+      case Regex_Op_MATCH: {
+        sb_push(re->closure, index);
+      } break;
+    }
+  }
+  
+  i32 *set = re->closure;
+  for (i32 i = 1; i < (i32)sb_count(set); i++) {
+    i32 value = set[i];
+    i32 j = i - 1;
+    while (j >= 0 && set[j] > value) {
+      set[j + 1] = set[j];
+      j--;
+    }
+    set[j + 1] = value;
+  }
+}
+
+bool regex_reaches_match(Regex *re, i32 from) {
+  sb_count(re->stack) = 0;
+  re->visit_generation++;
+  sb_push(re->stack, from);
+  
+  bool result = false;
+  while (!result && sb_count(re->stack)) {
+    i32 index = re->stack[--sb_count(re->stack)];
+    if (index < 0 || re->visited[index] == re->visit_generation) continue;
+    re->visited[index] = re->visit_generation;
+    
+    Regex_State *state = re->states + index;
+    switch (state->op) {
+      case Regex_Op_MATCH: {
+        result = true;
+      } break;
+      case Regex_Op_SPLIT: {
+        sb_push(re->stack, state->out1);
+        sb_push(re->stack, state->out);
+      } break;
+      case Regex_Op_EMPTY:
+      case Regex_Op_LINE_END: {
+        sb_push(re->stack, state->out);
+      } break;
+      default: break;
+    }
+  }
+  return result;
+}
+
+// NOTE(lvl5): index of the dfa state for this set, -1 if the cache is full
+i32 regex_dfa_add(Regex *re, i32 *set, i32 count) {
+  u32 hash = 2166136261;
+  for (i32 i = 0; i < count; i++) {
+    hash = (hash ^ (u32)set[i])*16777619;
+  }
+  
+  u32 mask = (u32)re->table_capacity - 1;
+  u32 slot = hash & mask;
+  while (re->table[slot]) {
+    i32 index = re->table[slot] - 1;
+    Regex_Dfa_State *existing = re->dfa + index;
+    if (existing->hash == hash && existing->state_count == count &&
+        memory_equal((char *)(re->sets + existing->set_offset), (char *)set,
+                     count*sizeof(i32))) {
+      return index;
+    }
+    slot = (slot + 1) & mask;
+  }
+  
+  if (sb_count(re->dfa) >= REGEX_MAX_DFA_STATES) {
+    return -1;
+  }
+  
+  Regex_Dfa_State state = {
+    .set_offset = sb_count(re->sets),
+    .state_count = count,
+    .hash = hash,
+  };
+  for (i32 i = 0; i < count; i++) {
+    sb_push(re->sets, set[i]);
+    Regex_State *nfa = re->states + set[i];
+    if (nfa->op == Regex_Op_MATCH) {
+      state.accepting = true;
+    }
+  }
+  for (i32 i = 0; i < count; i++) {
+    Regex_State *nfa = re->states + re->sets[state.set_offset + i];
+    if (nfa->op == Regex_Op_LINE_END && regex_reaches_match(re, nfa->out)) {
+      state.accepting_at_line_end = true;
+    }
+  }
+  
+  sb_push(re->dfa, state);
+  i32 result = sb_count(re->dfa) - 1;
+  re->table[slot] = result + 1;
+  
+  i32 unknown = result == REGEX_DEAD_STATE ? REGEX_DEAD_STATE : REGEX_UNKNOWN_STATE;
+  i32 *transitions = re->transitions + result*256;
+  for (i32 i = 0; i < 256; i++) {
+    transitions[i] = unknown;
+  }
+  return result;
+}
+
+void regex_flush(Regex *re) {
+  sb_count(re->dfa) = 0;
+  sb_count(re->sets) = 0;
+  for (i32 i = 0; i < re->table_capacity; i++) {
+    re->table[i] = 0;
+  }
+  re->start_states[0][0] = 0;
+  re->start_states[0][1] = 0;
+  re->start_states[1][0] = 0;
+  re->start_states[1][1] = 0;
+  
+  i32 dead = regex_dfa_add(re, null, 0);
+  assert(dead == REGEX_DEAD_STATE);
+}
+
+// NOTE(lvl5): adds the set in re->closure, flushing the cache if it is full
+i32 regex_dfa_add_closure(Regex *re) {
+  i32 result = regex_dfa_add(re, re->closure, sb_count(re->closure));
+  if (result < 0) {
+    regex_flush(re);
+    result = regex_dfa_add(re, re->closure, sb_count(re->closure));
+  }
+  return result;
+}
+
+i32 regex_compute_next(Regex *re, i32 from, u8 c) {
+  begin_profiler_function();
+  Mem_Size mark = scratch_get_mark();
+  
+  i32 *seeds = null;
+  push_scratch_context();
+  seeds = sb_new(i32, 16);
+  pop_context();
+  
+  Regex_Dfa_State *state = re->dfa + from;
+  for (i32 i = 0; i < state->state_count; i++) {
+    Regex_State *nfa = re->states + re->sets[state->set_offset + i];
+    if (nfa->op == Regex_Op_CLASS) {
+      if (regex_class_has(re->classes + nfa->class_index, c)) {
+        sb_push(seeds, nfa->out);
+      }
+    } else if (nfa->op == Regex_Op_LINE_END && c == '\n') {
+      // the newline satisfies $, so whatever follows it can eat the newline
+      regex_closure(re, &nfa->out, 1, false);
+      for (u32 j = 0; j < sb_count(re->closure); j++) {
+        Regex_State *after = re->states + re->closure[j];
+        if (after->op == Regex_Op_CLASS &&
+            regex_class_has(re->classes + after->class_index, c)) {
+          sb_push(seeds, after->out);
+        }
+      }
+    }
+  }
+  
+  regex_closure(re, seeds, sb_count(seeds), c == '\n');
+  i32 result = regex_dfa_add(re, re->closure, sb_count(re->closure));
+  if (result < 0) {
+    // the cache is full, start over from here. from is gone, so there is nothing to link
+    regex_flush(re);
+    result = regex_dfa_add(re, re->closure, sb_count(re->closure));
+  } else {
+    re->transitions[from*256 + c] = result;
+  }
+  
+  scratch_set_mark(mark);
+  end_profiler_function();
+  return result;
+}
+
+i32 regex_next(Regex *re, i32 state, u8 c) {
+  i32 result = re->transitions[state*256 + c];
+  if (result == REGEX_UNKNOWN_STATE) {
+    result = regex_compute_next(re, state, c);
+  }
+  return result;
+}
+
+i32 regex_start_state(Regex *re, bool unanchored, bool at_line_start) {
+  i32 result = re->start_states[unanchored][at_line_start] - 1;
+  if (result < 0) {
+    i32 *start = unanchored ? &re->unanchored_start : &re->start;
+    regex_closure(re, start, 1, at_line_start);
+    result = regex_dfa_add_closure(re);
+    re->start_states[unanchored][at_line_start] = result + 1;
+  }
+  return result;
+}
+
+// NOTE(lvl5): the dfa state for the same set without one nfa state
+i32 regex_drop_state(Regex *re, i32 from, i32 nfa_index) {
+  sb_count(re->closure) = 0;
+  Regex_Dfa_State *state = re->dfa + from;
+  for (i32 i = 0; i < state->state_count; i++) {
+    i32 index = re->sets[state->set_offset + i];
+    if (index != nfa_index) {
+      sb_push(re->closure, index);
+    }
+  }
+  i32 result = regex_dfa_add_closure(re);
+  return result;
+}
+
+inline char regex_input_char(Regex_Input *input, i32 pos) {
+  char result = pos < input->first_count ? input->first[pos] : input->second[pos];
+  return result;
+}
+
+// NOTE(lvl5): length of the longest match starting at pos, -1 if there is none
+i32 regex_match_at(Regex *re, Regex_Input *input, i32 pos) {
+  bool at_line_start = pos == 0 || regex_input_char(input, pos - 1) == '\n';
+  i32 state = regex_start_state(re, false, at_line_start);
+  
+  i32 result = -1;
+  i32 p = pos;
+  for (;;) {
+    Regex_Dfa_State *dfa = re->dfa + state;
+    if (dfa->accepting) {
+      result = p - pos;
+    } else if (dfa->accepting_at_line_end &&
+               (p == input->count || regex_input_char(input, p) == '\n')) {
+      result = p - pos;
+    }
+    
+    if (p >= input->count) break;
+    state = regex_next(re, state, (u8)regex_input_char(input, p));
+    if (state == REGEX_DEAD_STATE) break;
+    p++;
+  }
+  return result;
+}
+
+// NOTE(lvl5): first non-empty match that starts in [start, end), -1 if there is none.
+// the match itself can run past end
+i32 regex_find(Regex *re, Regex_Input *input, i32 start, i32 end, i32 *match_end) {
+  begin_profiler_function();
+  
+  // NOTE(lvl5): restarting the dfa at every position is quadratic when nothing
+  // matches, so first run it once with the .* prefix to find where the first
+  // match ends. no match can start after that. the prefix stops eating chars at
+  // end, so the pass only goes on while a match that started before end is alive.
+  // an empty match would end the pass right away, those patterns skip it
+  i32 last_start = end;
+  if (!re->matches_empty && start < end) {
+    bool at_line_start = start == 0 || regex_input_char(input, start - 1) == '\n';
+    i32 state = regex_start_state(re, true, at_line_start);
+    
+    i32 first_end = -1;
+    i32 p = start;
+    for (;;) {
+      Regex_Dfa_State *dfa = re->dfa + state;
+      if (dfa->accepting ||
+          (dfa->accepting_at_line_end &&
+           (p == input->count || regex_input_char(input, p) == '\n'))) {
+        first_end = p;
+        break;
+      }
+      
+      if (p >= input->count) break;
+      if (p == end - 1) {
+        state = regex_drop_state(re, state, re->prefix_any);
+      }
+      state = regex_next(re, state, (u8)regex_input_char(input, p));
+      if (state == REGEX_DEAD_STATE) break;
+      p++;
+    }
+    last_start = min(end, first_end);
+  }
+  
+  i32 result = -1;
+  for (i32 pos = start; pos < last_start; pos++) {
+    if (regex_class_has(&re->first_bytes, (u8)regex_input_char(input, pos))) {
+      i32 count = regex_match_at(re, input, pos);
+      if (count > 0) {
+        result = pos;
+        *match_end = pos + count;
+        break;
+      }
+    }
+  }
+  
+  end_profiler_function();
+  return result;
+}
+
+// NOTE(lvl5): uses the current allocator, check valid before matching
+Regex regex_compile(String pattern) {
+  begin_profiler_function();
+  
+  Regex re = {0};
+  re.states = sb_new(Regex_State, 64);
+  re.classes = sb_new(Regex_Class, 16);
+  
+  Regex_Parser parser = {
+    .pattern = pattern,
+    .re = &re,
+  };
+  Regex_Fragment fragment = regex_parse_alternation(&parser);
+  if (regex_parser_has(&parser)) {
+    // unbalanced )
+    parser.error = true;
+  }
+  i32 match = regex_add_state(&re, Regex_Op_MATCH, -1, -1, -1);
+  re.states[fragment.end].out = match;
+  re.start = fragment.start;
+  
+  Regex_Class any = {0};
+  regex_class_negate(&any);
+  sb_push(re.classes, any);
+  re.prefix_any = regex_add_state(&re, Regex_Op_CLASS, sb_count(re.classes) - 1, -1, -1);
+  re.unanchored_start = regex_add_state(&re, Regex_Op_SPLIT, -1, re.start, re.prefix_any);
+  re.states[re.prefix_any].out = re.unanchored_start;
+  re.valid = !parser.error && pattern.count > 0;
+  
+  re.dfa = sb_new(Regex_Dfa_State, 64);
+  re.sets = sb_new(i32, 256);
+  re.closure = sb_new(i32, 64);
+  re.stack = sb_new(i32, 64);
+  re.transitions = alloc_array(i32, REGEX_MAX_DFA_STATES*256);
+  re.table_capacity = REGEX_MAX_DFA_STATES*2;
+  re.table = alloc_array(i32, re.table_capacity);
+  re.visited = alloc_array(u32, sb_count(re.states));
+  for (u32 i = 0; i < sb_count(re.states); i++) {
+    re.visited[i] = 0;
+  }
+  regex_flush(&re);
+  
+  // a match at a line start is the superset, ^ is only followed there
+  regex_closure(&re, &re.start, 1, true);
+  for (u32 i = 0; i < sb_count(re.closure); i++) {
+    Regex_State *state = re.states + re.closure[i];
+    if (state->op == Regex_Op_CLASS) {
+      regex_class_add(&re.first_bytes, re.classes + state->class_index);
+    } else if (state->op == Regex_Op_LINE_END) {
+      regex_class_set(&re.first_bytes, '\n');
+      if (regex_reaches_match(&re, state->out)) {
+        re.matches_empty = true;
+      }
+    } else if (state->op == Regex_Op_MATCH) {
+      re.matches_empty = true;
+    }
+  }
+  
+  end_profiler_function();
+  return re;
+}
+
+void regex_free(Regex *re) {
+  if (re->states) {
+    free_memory(__get_header(re->states));
+    free_memory(__get_header(re->classes));
+    free_memory(__get_header(re->dfa));
+    free_memory(__get_header(re->sets));
+    free_memory(__get_header(re->closure));
+    free_memory(__get_header(re->stack));
+    free_memory(re->transitions);
+    free_memory(re->table);
+    free_memory(re->visited);
+  }
+  *re = (Regex){0};
+}
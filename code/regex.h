@@ -0,0 +1,98 @@
+#ifndef REGEX_H
+#include "lvl5_types.h"
+#include "lvl5_string.h"
+
+// NOTE(lvl5): supported syntax is literals, . [abc] [^a-z] \d \w \s (and their
+// uppercase negations), * + ? | ( ). ^ and $ only work at the ends of a branch.
+// matching is leftmost-longest, there are no captures
+#define REGEX_MAX_DFA_STATES 2048
+#define REGEX_DEAD_STATE 0
+#define REGEX_UNKNOWN_STATE -1
+
+typedef enum {
+  Regex_Op_CLASS,
+  Regex_Op_SPLIT,
+  Regex_Op_EMPTY,
+  Regex_Op_LINE_START,
+  Regex_Op_LINE_END,
+  Regex_Op_MATCH,
+} Regex_Op;
+
+typedef struct {
+  u32 bits[8];
+} Regex_Class;
+
+typedef struct {
+  Regex_Op op;
+  i32 class_index;
+  i32 out;
+  i32 out1;
+} Regex_State;
+
+typedef struct {
+  i32 start;
+  // an EMPTY state whose out is patched when the fragment is used
+  i32 end;
+} Regex_Fragment;
+
+typedef struct {
+  // offset into Regex.sets, the nfa states are sorted
+  i32 set_offset;
+  i32 state_count;
+  u32 hash;
+  bool accepting;
+  // accepting, but only before a newline or the end of the buffer
+  bool accepting_at_line_end;
+} Regex_Dfa_State;
+
+typedef struct {
+  bool valid;
+  
+  Regex_State *states;
+  Regex_Class *classes;
+  i32 start;
+  // NOTE(lvl5): start with an implicit .* in front, so one pass finds where the
+  // first match ends. prefix_any is the state that eats the .* chars
+  i32 unanchored_start;
+  i32 prefix_any;
+  // the pattern can match without eating anything
+  bool matches_empty;
+  
+  // NOTE(lvl5): built lazily while matching. when it fills up it is thrown
+  // away and rebuilt from the state we were in, so memory stays bounded
+  // even for patterns whose dfa would explode
+  Regex_Dfa_State *dfa;
+  i32 *sets;
+  i32 *transitions; // 256 per dfa state
+  i32 *table;       // hash -> dfa index + 1, 0 is empty
+  i32 table_capacity;
+  
+  // dfa index + 1 of the start states, [unanchored][at line start]
+  i32 start_states[2][2];
+  // bytes a match can start with
+  Regex_Class first_bytes;
+  
+  // scratch for building closures
+  i32 *closure;
+  i32 *stack;
+  u32 *visited;
+  u32 visit_generation;
+} Regex;
+
+typedef struct {
+  String pattern;
+  i32 pos;
+  bool error;
+  Regex *re;
+} Regex_Parser;
+
+// NOTE(lvl5): the two halves of a gap buffer, matched without copying them together
+typedef struct {
+  char *first;
+  i32 first_count;
+  char *second;
+  i32 count;
+} Regex_Input;
+
+#define REGEX_H
+#endif
@@ -1,8 +1,240 @@
 #include "renderer.h"
 #include "lvl5_random.h"
+#include "lvl5_truetype.h"
 #include "buffer.c"
 
-void init_renderer(gl_Funcs gl, Renderer *r, GLuint shader, Font *font, V2 window_size) {
+// NOTE(lvl5): a Font_Rasterize that copies the glyph out of a font cache
+void font_cache_rasterize(void *data, u32 codepoint, Bitmap *atlas, Rect2i cell, Glyph *glyph) {
+  Font_Cache_Header *header = (Font_Cache_Header *)data;
+  Font_Cache_Glyph *cached = (Font_Cache_Glyph *)(header + 1) + codepoint;
+  u8 *coverage = (u8 *)header + cached->coverage_offset;
+  
+  for (i32 y = 0; y < cached->height; y++) {
+    for (i32 x = 0; x < cached->width; x++) {
+      atlas->data[(cell.min.y + y)*atlas->width + cell.min.x + x] =
+        color_u32(0xFF, 0xFF, 0xFF, coverage[y*cached->width + x]);
+    }
+  }
+  
+  glyph->rect = rect2i_min_size(cell.min, v2i(cached->width, cached->height));
+  glyph->origin = cached->origin;
+  glyph->advance = cached->advance;
+}
+
+// NOTE(lvl5): every glyph is checked too, font_cache_rasterize copies them
+// into atlas cells without looking
+Font_Cache_Header *font_cache_validate(byte *data, u64 size, u64 ttf_hash, i32 pixel_height,
+                                       i32 cell_size)
+{
+  Font_Cache_Header *result = null;
+  Font_Cache_Header *header = (Font_Cache_Header *)data;
+  bool valid = data &&
+    size >= sizeof(Font_Cache_Header) + sizeof(Font_Cache_Glyph)*FONT_ASCII_COUNT &&
+    header->magic == FONT_CACHE_MAGIC &&
+    header->version == FONT_CACHE_VERSION &&
+    header->total_size == size &&
+    header->ttf_hash == ttf_hash &&
+    header->pixel_height == pixel_height &&
+    header->cell_width == cell_size &&
+    header->cell_height == cell_size;
+  
+  if (valid) {
+    Font_Cache_Glyph *cached_glyphs = (Font_Cache_Glyph *)(header + 1);
+    for (i32 codepoint = 0; valid && codepoint < FONT_ASCII_COUNT; codepoint++) {
+      Font_Cache_Glyph *cached = cached_glyphs + codepoint;
+      valid = cached->width <= header->cell_width &&
+        cached->height <= header->cell_height &&
+        (u64)cached->coverage_offset + (u64)cached->width*cached->height <= size;
+    }
+  }
+  
+  if (valid) {
+    result = header;
+  }
+  return result;
+}
+
+void font_cache_write(Font *font, String file_name, u64 ttf_hash, i32 pixel_height) {
+  push_scratch_context();
+  Mem_Size mark = scratch_get_mark();
+  
+  u32 coverage_offset = sizeof(Font_Cache_Header) + sizeof(Font_Cache_Glyph)*FONT_ASCII_COUNT;
+  u32 total_size = coverage_offset + font->cell_width*font->cell_height*FONT_ASCII_COUNT;
+  byte *data = alloc_array(byte, total_size);
+  
+  Font_Cache_Header *header = (Font_Cache_Header *)data;
+  *header = (Font_Cache_Header){
+    .magic = FONT_CACHE_MAGIC,
+    .version = FONT_CACHE_VERSION,
+    .pixel_height = pixel_height,
+    .ttf_hash = ttf_hash,
+    .cell_width = font->cell_width,
+    .cell_height = font->cell_height,
+  };
+  
+  Font_Cache_Glyph *cached_glyphs = (Font_Cache_Glyph *)(header + 1);
+  for (i32 codepoint = 0; codepoint < FONT_ASCII_COUNT; codepoint++) {
+    Glyph *glyph = font->glyphs + codepoint;
+    V2i size = v2i(glyph->rect.max.x - glyph->rect.min.x, glyph->rect.max.y - glyph->rect.min.y);
+    cached_glyphs[codepoint] = (Font_Cache_Glyph){
+      .origin = glyph->origin,
+      .coverage_offset = coverage_offset,
+      .advance = glyph->advance,
+      .width = (u8)size.x,
+      .height = (u8)size.y,
+    };
+    
+    for (i32 y = 0; y < size.y; y++) {
+      for (i32 x = 0; x < size.x; x++) {
+        u32 pixel = font->atlas.data[(glyph->rect.min.y + y)*font->atlas.width + glyph->rect.min.x + x];
+        data[coverage_offset++] = (u8)(pixel >> 24);
+      }
+    }
+  }
+  header->total_size = coverage_offset;
+  
+  global_os.write_entire_file(file_name, data, coverage_offset);
+  
+  scratch_set_mark(mark);
+  pop_context();
+}
+
+// NOTE(lvl5): rasterizes from the ttf itself, so it works the same everywhere.
+// the ascii glyphs come from a cache file keyed by the ttf's hash and the size,
+// written next to the symbol index the first time the font is loaded
+Font renderer_load_font(String file_name, i32 pixel_height) {
+  begin_profiler_function();
+  
+  String file = global_os.read_entire_file(file_name);
+  push_system_context();
+  Ttf_Font *ttf = alloc_struct(Ttf_Font);
+  pop_context();
+  bool valid = ttf_init(ttf, (byte *)file.data, file.count, pixel_height);
+  assert(valid);
+  
+  u64 ttf_hash = hash_bytes_64(file.data, file.count);
+  char cache_name[64];
+  sprintf_s(cache_name, 64, "font_%016llx_%d.cache", ttf_hash, pixel_height);
+  String cache_file_name = from_c_string(cache_name);
+  
+  u64 cache_size = 0;
+  byte *cache_data = (byte *)global_os.map_file(cache_file_name, &cache_size);
+  i32 cell_size = round_f32_i32((ttf->ascent - ttf->descent)*ttf->scale) + 2;
+  Font_Cache_Header *cache = font_cache_validate(cache_data, cache_size, ttf_hash,
+                                                 pixel_height, cell_size);
+  
+  Font result;
+  if (cache) {
+    result = font_from_ttf(ttf, font_cache_rasterize, cache);
+  } else {
+    result = font_from_ttf(ttf, null, null);
+    font_cache_write(&result, cache_file_name, ttf_hash, pixel_height);
+  }
+  
+  if (cache_data) {
+    global_os.unmap_file(cache_data);
+  }
+  
+  end_profiler_function();
+  return result;
+}
+
+Render_Transform render_transform_identity() {
+  Render_Transform result = {
+    .x_axis = v2(1, 0),
+    .y_axis = v2(0, 1),
+  };
+  return result;
+}
+
+bool render_transform_is_translation(Render_Transform t) {
+  bool result = t.x_axis.x == 1 && t.x_axis.y == 0 &&
+    t.y_axis.x == 0 && t.y_axis.y == 1;
+  return result;
+}
+
+bool render_transforms_are_equal(Render_Transform a, Render_Transform b) {
+  bool result = a.x_axis.x == b.x_axis.x && a.x_axis.y == b.x_axis.y &&
+    a.y_axis.x == b.y_axis.x && a.y_axis.y == b.y_axis.y &&
+    a.origin.x == b.origin.x && a.origin.y == b.origin.y;
+  return result;
+}
+
+// NOTE(lvl5): instances are read from offset on, every batch points the attributes
+// at where its instances start in the ring
+void renderer_bind_instances(gl_Funcs gl, GLintptr offset) {
+  gl.VertexAttribPointer(
+    1, 4, GL_SHORT, GL_FALSE, sizeof(Quad_Instance),
+    (void *)(offset + offsetof(Quad_Instance, texture_x)));
+  gl.VertexAttribPointer(
+    2, 2, GL_FLOAT, GL_FALSE, sizeof(Quad_Instance),
+    (void *)(offset + offsetof(Quad_Instance, position)));
+  gl.VertexAttribPointer(
+    3, 2, GL_FLOAT, GL_FALSE, sizeof(Quad_Instance),
+    (void *)(offset + offsetof(Quad_Instance, size)));
+  gl.VertexAttribPointer(
+    4, 4, GL_UNSIGNED_BYTE, GL_FALSE, sizeof(Quad_Instance),
+    (void *)(offset + offsetof(Quad_Instance, color)));
+}
+
+// NOTE(lvl5): replaces the old ring, if there is one. that only happens
+// when a frame has more instances than a segment holds
+void renderer_create_instance_ring(gl_Funcs gl, Renderer *r, i32 capacity) {
+  if (r->vertex_vbo) {
+    gl.DeleteBuffers(1, &r->vertex_vbo);
+  }
+  for (i32 i = 0; i < INSTANCE_RING_FRAMES; i++) {
+    if (r->instance_ring_fences[i]) {
+      gl.DeleteSync(r->instance_ring_fences[i]);
+      r->instance_ring_fences[i] = null;
+    }
+  }
+  
+  gl.GenBuffers(1, &r->vertex_vbo);
+  gl.BindBuffer(GL_ARRAY_BUFFER, r->vertex_vbo);
+  GLsizeiptr size = sizeof(Quad_Instance)*capacity*INSTANCE_RING_FRAMES;
+  if (r->has_buffer_storage) {
+    GLbitfield flags = GL_MAP_WRITE_BIT|GL_MAP_PERSISTENT_BIT|GL_MAP_COHERENT_BIT;
+    gl.BufferStorage(GL_ARRAY_BUFFER, size, null, flags);
+    r->instance_ring_memory = (Quad_Instance *)gl.MapBufferRange(GL_ARRAY_BUFFER, 0, size, flags);
+  } else {
+    gl.BufferData(GL_ARRAY_BUFFER, size, null, GL_STREAM_DRAW);
+    r->instance_ring_memory = null;
+  }
+  r->instance_ring_capacity = capacity;
+  r->instance_ring_segment = 0;
+}
+
+// the first clip is empty and the first transform is the identity
+void renderer_reset_side_tables(Renderer *r) {
+  sb_count(r->clips) = 0;
+  sb_push(r->clips, rect2_min_size(v2_zero(), v2_zero()));
+  r->state.clip_index = 0;
+  sb_count(r->transforms) = 0;
+  sb_push(r->transforms, render_transform_identity());
+}
+
+void init_renderer(gl_Funcs gl, Renderer *r, Render_Backend backend,
+                   GLuint shader, Font *font, V2 window_size)
+{
+  r->backend = backend;
+  r->state.transform = render_transform_identity();
+  r->state.font = font;
+  r->window_size = window_size;
+  r->items = sb_new(Render_Item, 1024);
+  r->clips = sb_new(Rect2, 64);
+  r->transforms = sb_new(Render_Transform, 16);
+  renderer_reset_side_tables(r);
+  r->instances = sb_new(Quad_Instance, INSTANCE_RING_MIN_CAPACITY);
+  r->batches = sb_new(Quad_Batch, 64);
+  r->run_copies = sb_new(Glyph_Run_Copy, 256);
+  r->run_fixups = sb_new(Glyph_Run_Fixup, 64);
+  
+  if (backend == Render_Backend_SOFTWARE) {
+    // the target is made on the first frame, when the size is known to be final
+    return;
+  }
+  
   glEnable(GL_BLEND);
   glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
   glEnable(GL_MULTISAMPLE);
@@ -17,7 +249,9 @@ void init_renderer(gl_Funcs gl, Renderer *r, GLuint shader, Font *font, V2 windo
   gl.TexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
   gl.TexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
   
-  gl.TexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, font->atlas.bmp.width, font->atlas.bmp.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, font->atlas.bmp.data);
+  gl.TexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, font->atlas.width, font->atlas.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, font->atlas.data);
+  font->dirty_min_y = font->atlas.height;
+  font->dirty_max_y = 0;
   
   f32 quad_vertices[] = {
     0.0f, 0.0f,
@@ -31,10 +265,6 @@ void init_renderer(gl_Funcs gl, Renderer *r, GLuint shader, Font *font, V2 windo
   u32 quad_vbo;
   gl.GenBuffers(1, &quad_vbo);
   
-  u32 vertex_vbo;
-  gl.GenBuffers(1, &vertex_vbo);
-  
-  
   GLuint vao;
   gl.GenVertexArrays(1, &vao);
   gl.BindVertexArray(vao);
@@ -45,73 +275,67 @@ void init_renderer(gl_Funcs gl, Renderer *r, GLuint shader, Font *font, V2 windo
   
   gl.BufferData(GL_ARRAY_BUFFER, sizeof(quad_vertices), quad_vertices, GL_STATIC_DRAW);
   
-  gl.BindBuffer(GL_ARRAY_BUFFER, vertex_vbo);
+  r->has_buffer_storage = gl_has_extension(gl, "GL_ARB_buffer_storage");
+  renderer_create_instance_ring(gl, r, INSTANCE_RING_MIN_CAPACITY);
+  
   gl.EnableVertexAttribArray(1);
   gl.EnableVertexAttribArray(2);
   gl.EnableVertexAttribArray(3);
   gl.EnableVertexAttribArray(4);
-  gl.EnableVertexAttribArray(5);
-  gl.EnableVertexAttribArray(6);
   
   gl.VertexAttribDivisor(1, 1);
   gl.VertexAttribDivisor(2, 1);
   gl.VertexAttribDivisor(3, 1);
   gl.VertexAttribDivisor(4, 1);
-  gl.VertexAttribDivisor(5, 1);
-  gl.VertexAttribDivisor(6, 1);
-  
-  gl.VertexAttribPointer(
-    1, 4, GL_SHORT, GL_FALSE, sizeof(Quad_Instance), (void *)offsetof(Quad_Instance, texture_x));
-  
-  gl.VertexAttribPointer(
-    2, 4, GL_FLOAT, GL_FALSE, sizeof(Quad_Instance),
-    (void *)offsetof(Quad_Instance, matrix));
-  gl.VertexAttribPointer(
-    3, 4, GL_FLOAT, GL_FALSE, sizeof(Quad_Instance),
-    (void *)(offsetof(Quad_Instance, matrix) + sizeof(f32)*4));
-  gl.VertexAttribPointer(
-    4, 4, GL_FLOAT, GL_FALSE, sizeof(Quad_Instance),
-    (void *)(offsetof(Quad_Instance, matrix) + sizeof(f32)*8));
-  gl.VertexAttribPointer(
-    5, 4, GL_FLOAT, GL_FALSE, sizeof(Quad_Instance),
-    (void *)(offsetof(Quad_Instance, matrix) + sizeof(f32)*12));
-  gl.VertexAttribPointer(
-    6, 4, GL_UNSIGNED_BYTE, GL_FALSE, sizeof(Quad_Instance),
-    (void *)offsetof(Quad_Instance, color));
-  
-  
   
-  r->state.matrix = m4_identity();
-  r->state.font = font;
-  r->window_size = window_size;
-  r->items = sb_new(Render_Item, 1024);
-  
-  r->vertex_vbo = vertex_vbo;
+  r->view_location = gl.GetUniformLocation(shader, "view");
+  r->model_location = gl.GetUniformLocation(shader, "model");
   r->shader = shader;
 }
 
 void renderer_begin_render(Renderer *r) {
-  V2 ws = r->window_size;
-  r->state.matrix = m4_transpose(m4_orthographic(-ws.x*0.5f, ws.x*0.5f, 
-                                                 -ws.y*0.5f, ws.y*0.5f,
-                                                 1, -1));
+  r->state.transform = render_transform_identity();
   sb_count(r->items) = 0;
+  renderer_reset_side_tables(r);
+  r->frame++;
+  r->animating = false;
+  r->state.font->frame++;
 }
 
 void render_scale(Renderer *r, V2 scale) {
-  r->state.matrix = m4_unscale(r->state.matrix, v2_to_v3(scale, 1.0f));
+  Render_Transform *t = &r->state.transform;
+  t->x_axis = v2_mul(t->x_axis, scale.x);
+  t->y_axis = v2_mul(t->y_axis, scale.y);
 }
 
 void render_translate(Renderer *r, V2 p) {
-  r->state.matrix = m4_untranslate(r->state.matrix, v2_to_v3(p, 0.0f));
+  Render_Transform *t = &r->state.transform;
+  t->origin = v2_add(t->origin, v2_add(v2_mul(t->x_axis, p.x), v2_mul(t->y_axis, p.y)));
 }
 
 void render_rotate(Renderer *r, f32 angle) {
-  r->state.matrix = m4_unrotate(r->state.matrix, angle);
+  Render_Transform *t = &r->state.transform;
+  f32 cos = cos_f32(angle);
+  f32 sin = sin_f32(angle);
+  V2 x_axis = v2_add(v2_mul(t->x_axis, cos), v2_mul(t->y_axis, sin));
+  V2 y_axis = v2_add(v2_mul(t->x_axis, -sin), v2_mul(t->y_axis, cos));
+  t->x_axis = x_axis;
+  t->y_axis = y_axis;
+}
+
+// NOTE(lvl5): a clip that differs from the last one gets a new index, even if it
+// was used before. that's what keeps indices in drawing order for the sort
+void render_use_clip(Renderer *r, Rect2 rect) {
+  i32 last = sb_count(r->clips) - 1;
+  if (!rect2_are_equal(r->clips[last], rect)) {
+    sb_push(r->clips, rect);
+    last++;
+  }
+  r->state.clip_index = last;
 }
 
 void render_clip(Renderer *r, Rect2 rect) {
-  r->state.clip = rect;
+  render_use_clip(r, rect);
 }
 
 void render_save(Renderer *r) {
@@ -122,42 +346,75 @@ void render_save(Renderer *r) {
 void render_restore(Renderer *r) {
   assert(r->stack_count > 0);
   r->state = r->stack[--r->stack_count];
+  render_use_clip(r, r->clips[r->state.clip_index]);
+}
+
+u32 render_item_key(Renderer *r) {
+  u32 layer = (u32)clamp_i32((i32)r->state.z, 0, 255);
+  u32 result = (layer << RENDER_KEY_LAYER_SHIFT) |
+    ((u32)r->state.clip_index & RENDER_KEY_CLIP_MASK);
+  return result;
+}
+
+// NOTE(lvl5): 0 for translated items, their geometry gets moved by origin instead.
+// consecutive items with the same transform share an entry and a draw
+i32 render_item_transform_index(Renderer *r) {
+  Render_Transform t = r->state.transform;
+  i32 result = 0;
+  if (!render_transform_is_translation(t)) {
+    result = sb_count(r->transforms) - 1;
+    if (result == 0 || !render_transforms_are_equal(r->transforms[result], t)) {
+      sb_push(r->transforms, t);
+      result++;
+    }
+  }
+  return result;
+}
+
+void render_push_item(Renderer *r, Render_Item item) {
+  item.key = render_item_key(r);
+  item.transform_index = render_item_transform_index(r);
+  sb_push(r->items, item);
 }
 
 f32 measure_string_width(Renderer *r, String s) {
   Font *font = r->state.font;
   f32 result = 0;
-  for (u32 char_index = 0; char_index < s.count - 1; char_index++) {
-    result += font_get_advance(font, s.data[char_index], s.data[char_index+1]);
+  u32 char_index = 0;
+  while (char_index < s.count) {
+    i32 codepoint_length;
+    u32 codepoint = utf8_decode(s.data + char_index, (i32)(s.count - char_index), &codepoint_length);
+    char_index += codepoint_length;
+    if (char_index < s.count) {
+      result += font_get_codepoint_advance(font, codepoint, (u8)s.data[char_index]);
+    } else {
+      result += font->glyphs[font_get_glyph(font, codepoint)].advance;
+    }
   }
-  result += font->advance[s.data[s.count - 1] - font->first_codepoint];
   
   return result;
 }
 
 // strings drawn with this MUST have an extra char of padding AFTER count
 void draw_string(Renderer *r, String s, V2 p, u32 color) {
-  render_translate(r, p);
-  
+  Render_Transform t = r->state.transform;
   Render_Item item = {
     .type = Render_Type_STRING,
-    .state = r->state,
+    .color = color,
   };
-  item.state.color = color;
   item.string = s;
-  sb_push(r->items, item);
-  
-  render_translate(r, v2_negate(p));
+  item.p = render_transform_is_translation(t) ? v2_add(p, t.origin) : p;
+  render_push_item(r, item);
 }
 
 void draw_rect(Renderer *r, Rect2 rect, u32 color) {
+  Render_Transform t = r->state.transform;
   Render_Item item = {
     .type = Render_Type_RECT,
-    .state = r->state,
-    .rect = rect,
+    .color = color,
   };
-  item.state.color = color;
-  sb_push(r->items, item);
+  item.rect = render_transform_is_translation(t) ? rect2_translate(rect, t.origin) : rect;
+  render_push_item(r, item);
 }
 
 void draw_rect_outline(Renderer *r, Rect2 rect, f32 thick, u32 color) {
@@ -202,146 +459,658 @@ void draw_buffer_view(Renderer *r, Rect2 rect, Buffer_View *view, Color_Theme *t
   render_save(r);
   render_clip(r, rect);
   
+  Render_Transform t = r->state.transform;
   Render_Item item = {
     .type = Render_Type_BUFFER,
-    .state = r->state,
   };
   item.buffer.theme = theme;
-  item.buffer.rect = rect;
+  item.buffer.rect = render_transform_is_translation(t) ? rect2_translate(rect, t.origin) : rect;
   item.buffer.scroll = scroll;
   item.buffer.view = view;
   
-  sb_push(r->items, item);
+  render_push_item(r, item);
   render_restore(r);
 }
 
 
-void queue_rect(Quad_Instance *instances, Rect2 rect, Renderer_State state) {
-  V2 size = rect2_get_size(rect);
-  M4 m = state.matrix;
-  m = m4_mul_m4(m, m4_translated(v3(rect.min.x,
-                                    rect.min.y, 
-                                    0)));
-  m = m4_mul_m4(m, m4_scaled(v3(size.x, size.y, 1)));
-  Rect2i sprite_rect = state.font->atlas.rects[state.font->atlas.count-1];
+void queue_rect(Quad_Instance **instances, Font *font, Rect2 rect, u32 color) {
+  Rect2i sprite_rect = font->white_rect;
   
   Quad_Instance inst = {
-    .matrix = m,
+    .position = rect.min,
+    .size = rect2_get_size(rect),
     .texture_x = (u16)sprite_rect.min.x,
     .texture_y = (u16)sprite_rect.min.y,
     .texture_w = 1,
     .texture_h = 1,
-    .color = state.color,
+    .color = color,
   };
-  sb_push(instances, inst);
+  sb_push(*instances, inst);
 }
 
-Quad_Instance *renderer_dump_quads(gl_Funcs gl, Renderer *r, 
-                                   Quad_Instance *instances, Rect2 clip) 
-{
-  if (instances && sb_count(instances)) {
-    gl.UseProgram(r->shader);
-    gl.BindBuffer(GL_ARRAY_BUFFER, r->vertex_vbo);
-    gl.BufferData(GL_ARRAY_BUFFER, sizeof(Quad_Instance)*sb_count(instances), instances, GL_DYNAMIC_DRAW);
-    gl.DrawArraysInstanced(GL_TRIANGLES, 0, 6, sb_count(instances));
+Quad_Instance glyph_instance(Glyph *glyph, V2 p, u32 color) {
+  Rect2i rect = glyph->rect;
+  u16 width = (u16)(rect.max.x - rect.min.x);
+  u16 height = (u16)(rect.max.y - rect.min.y);
+  
+  Quad_Instance result = {
+    .position = v2_add(p, glyph->origin),
+    .size = v2(width, height),
+    .texture_x = (u16)rect.min.x,
+    .texture_y = (u16)rect.min.y,
+    .texture_w = width,
+    .texture_h = height,
+    .color = color,
+  };
+  return result;
+}
+
+void queue_glyph(Quad_Instance **instances, Glyph *glyph, V2 p, u32 color) {
+  Quad_Instance inst = glyph_instance(glyph, p, color);
+  sb_push(*instances, inst);
+}
+
+// NOTE(lvl5): the run with key, or the empty slot it would go in
+Glyph_Run *renderer_find_glyph_run(Renderer *r, u64 key) {
+  u32 mask = r->glyph_run_capacity - 1;
+  u32 slot = (u32)key & mask;
+  while (r->glyph_runs[slot].key && r->glyph_runs[slot].key != key) {
+    slot = (slot + 1) & mask;
+  }
+  Glyph_Run *result = r->glyph_runs + slot;
+  return result;
+}
+
+// NOTE(lvl5): rebuilds the table with only the runs that were drawn recently,
+// and makes it bigger when those alone would fill it up
+void renderer_sweep_glyph_runs(Renderer *r) {
+  Glyph_Run *old_runs = r->glyph_runs;
+  i32 old_capacity = r->glyph_run_capacity;
+  
+  i32 live_count = 0;
+  for (i32 i = 0; i < old_capacity; i++) {
+    Glyph_Run *run = old_runs + i;
+    if (run->key) {
+      if (r->frame - run->last_used < GLYPH_RUN_KEEP_FRAMES) {
+        live_count++;
+      } else {
+        sb_free(run->instances);
+        sb_free(run->patches);
+        run->key = 0;
+      }
+    }
+  }
+  
+  i32 capacity = old_capacity ? old_capacity : 1024;
+  while ((live_count + 1)*4 > capacity) {
+    capacity *= 2;
+  }
+  
+  push_system_context();
+  r->glyph_runs = alloc_array(Glyph_Run, capacity);
+  zero_memory_slow(r->glyph_runs, sizeof(Glyph_Run)*capacity);
+  r->glyph_run_capacity = capacity;
+  r->glyph_run_count = live_count;
+  
+  for (i32 i = 0; i < old_capacity; i++) {
+    if (old_runs[i].key) {
+      *renderer_find_glyph_run(r, old_runs[i].key) = old_runs[i];
+    }
+  }
+  
+  if (old_runs) {
+    free_memory(old_runs);
+  }
+  pop_context();
+}
+
+// NOTE(lvl5): the pointer is good until the next run gets added
+Glyph_Run *renderer_add_glyph_run(Renderer *r, u64 key) {
+  if ((r->glyph_run_count + 1)*2 > r->glyph_run_capacity) {
+    renderer_sweep_glyph_runs(r);
+  }
+  
+  Glyph_Run *result = renderer_find_glyph_run(r, key);
+  assert(!result->key);
+  
+  push_system_context();
+  *result = (Glyph_Run){
+    .key = key,
+    .last_used = r->frame,
+    .instances = sb_new(Quad_Instance, 64),
+    .patches = sb_new(Glyph_Run_Patch, 4),
+  };
+  pop_context();
+  r->glyph_run_count++;
+  return result;
+}
+
+u64 glyph_run_key(Buffer *buffer, Line_Hash *hash, Font *font, Color_Theme *theme) {
+  u64 parts[5] = {
+    hash->text_hash,
+    hash->color_hash,
+    (u64)font,
+    (u64)theme,
+    buffer->is_utf8,
+  };
+  u64 result = hash_bytes_64(parts, sizeof(parts));
+  if (!result) {
+    result = 1;
+  }
+  return result;
+}
+
+// makes room for count more instances and returns the index of the first one
+i32 reserve_instances(Quad_Instance **instances, i32 count) {
+  while (sb_count(*instances) + count > sb_capacity(*instances)) {
+    __grow(instances, sizeof(Quad_Instance));
+  }
+  i32 result = sb_count(*instances);
+  sb_count(*instances) += count;
+  return result;
+}
+
+// NOTE(lvl5): the instances get copied in renderer_copy_glyph_runs,
+// the patches need the atlas, so they are resolved right here
+void queue_glyph_run(Renderer *r, Quad_Instance **instances, Font *font, Glyph_Run *run, V2 p) {
+  Glyph_Run_Copy copy = {
+    .source = run->instances,
+    .count = sb_count(run->instances),
+    .p = p,
+  };
+  copy.first = reserve_instances(instances, copy.count);
+  sb_push(r->run_copies, copy);
+  
+  for (i32 i = 0; i < (i32)sb_count(run->patches); i++) {
+    Glyph_Run_Patch patch = run->patches[i];
+    Glyph *glyph = font_use_glyph(font, patch.glyph);
+    Glyph_Run_Fixup fixup = {
+      .index = copy.first + patch.instance,
+      .instance = glyph_instance(glyph, v2_add(patch.p, p), run->instances[patch.instance].color),
+    };
+    sb_push(r->run_fixups, fixup);
+  }
+}
+
+// NOTE(lvl5): whoever gets here claims chunks of the copies until none are left,
+// the copies are split by count since lines are about the same length
+void renderer_do_glyph_run_copies(Glyph_Run_Copy_Work *work) {
+  while (true) {
+    i32 chunk = _InterlockedIncrement(&work->next_chunk) - 1;
+    if (chunk >= work->chunk_count) break;
     
-    gl.Disable(GL_SCISSOR_TEST);
+    i32 first = (i32)((i64)work->copy_count*chunk/work->chunk_count);
+    i32 end = (i32)((i64)work->copy_count*(chunk + 1)/work->chunk_count);
+    for (i32 copy_index = first; copy_index < end; copy_index++) {
+      Glyph_Run_Copy copy = work->copies[copy_index];
+      Quad_Instance *dst = work->instances + copy.first;
+      for (i32 i = 0; i < copy.count; i++) {
+        Quad_Instance inst = copy.source[i];
+        inst.position = v2_add(inst.position, copy.p);
+        dst[i] = inst;
+      }
+    }
+    _InterlockedIncrement(&work->done_chunks);
+  }
+}
+
+void renderer_release_glyph_run_copy_work(Glyph_Run_Copy_Work *work) {
+  if (_InterlockedDecrement(&work->ref_count) == 0) {
+    push_system_context();
+    free_memory(work);
+    pop_context();
+  }
+}
+
+// NOTE(lvl5): the queue is shared with long jobs like search indexing, so a copy job
+// can start late, after the frame is done. by then every chunk is claimed and it only
+// lets go of the work, which is freed by whoever lets go of it last
+void glyph_run_copy_job(void *data) {
+  Glyph_Run_Copy_Work *work = (Glyph_Run_Copy_Work *)data;
+  _InterlockedDecrement(work->queued_jobs);
+  renderer_do_glyph_run_copies(work);
+  renderer_release_glyph_run_copy_work(work);
+}
+
+// NOTE(lvl5): the main thread always works on the copies too, and only waits for
+// chunks a worker is already in the middle of. new jobs are only queued for
+// workers that aren't still sitting on ones from earlier frames
+void renderer_copy_glyph_runs(Renderer *r, Quad_Instance *instances) {
+  begin_profiler_function();
+  
+  i32 copy_count = sb_count(r->run_copies);
+  if (copy_count) {
+    i32 instance_count = 0;
+    for (i32 i = 0; i < copy_count; i++) {
+      instance_count += r->run_copies[i].count;
+    }
+    
+    i32 job_count = 0;
+    if (instance_count >= GLYPH_RUN_PARALLEL_MIN_INSTANCES && global_os.queue_add) {
+      job_count = max(global_os.thread_count - (i32)r->copy_jobs_queued, 0);
+    }
+    
+    push_system_context();
+    Glyph_Run_Copy_Work *work = alloc_struct(Glyph_Run_Copy_Work);
+    pop_context();
+    *work = (Glyph_Run_Copy_Work){
+      .ref_count = 1 + job_count,
+      .chunk_count = min(copy_count, (job_count + 1)*GLYPH_RUN_CHUNKS_PER_THREAD),
+      .copies = r->run_copies,
+      .copy_count = copy_count,
+      .instances = instances,
+      .queued_jobs = &r->copy_jobs_queued,
+    };
+    
+    for (i32 i = 0; i < job_count; i++) {
+      _InterlockedIncrement(&r->copy_jobs_queued);
+      global_os.queue_add(global_os.thread_queue, glyph_run_copy_job, work);
+    }
+    
+    renderer_do_glyph_run_copies(work);
+    while (work->done_chunks < work->chunk_count) {
+      _mm_pause();
+    }
+    renderer_release_glyph_run_copy_work(work);
+  }
+  
+  for (i32 i = 0; i < (i32)sb_count(r->run_fixups); i++) {
+    Glyph_Run_Fixup fixup = r->run_fixups[i];
+    instances[fixup.index] = fixup.instance;
   }
   
+  end_profiler_function();
+}
+
+// NOTE(lvl5): the model transform only changes around items that are rotated or scaled
+void renderer_set_model(gl_Funcs gl, Renderer *r, Render_Transform t) {
+  M4 model = m4(t.x_axis.x, t.y_axis.x, 0, t.origin.x,
+                t.x_axis.y, t.y_axis.y, 0, t.origin.y,
+                0,          0,          1, 0,
+                0,          0,          0, 1);
+  gl.UniformMatrix4fv(r->model_location, 1, GL_TRUE, (f32 *)&model);
+}
+
+// NOTE(lvl5): only the rows glyphs were rasterized into since the last upload
+void renderer_upload_font_atlas(gl_Funcs gl, Font *font) {
+  if (font->dirty_min_y < font->dirty_max_y) {
+    Bitmap *atlas = &font->atlas;
+    gl.TexSubImage2D(GL_TEXTURE_2D, 0, 0, font->dirty_min_y,
+                     atlas->width, font->dirty_max_y - font->dirty_min_y,
+                     GL_RGBA, GL_UNSIGNED_BYTE,
+                     atlas->data + font->dirty_min_y*atlas->width);
+    font->dirty_min_y = atlas->height;
+    font->dirty_max_y = 0;
+  }
+}
+
+void renderer_begin_batch(Renderer *r, Quad_Instance *instances,
+                          Rect2 clip, Render_Transform transform)
+{
+  Quad_Batch batch = {
+    .first = sb_count(instances),
+    .clip = clip,
+    .transform = transform,
+  };
+  sb_push(r->batches, batch);
+}
+
+// NOTE(lvl5): one upload for the whole frame, then a draw per batch
+void renderer_draw_batches(gl_Funcs gl, Renderer *r) {
+  i32 instance_count = sb_count(r->instances);
+  if (instance_count > r->instance_ring_capacity) {
+    i32 capacity = r->instance_ring_capacity;
+    while (capacity < instance_count) {
+      capacity *= 2;
+    }
+    renderer_create_instance_ring(gl, r, capacity);
+  }
+  
+  i32 segment = r->instance_ring_segment;
+  r->instance_ring_segment = (segment + 1) % INSTANCE_RING_FRAMES;
+  GLintptr segment_offset = sizeof(Quad_Instance)*r->instance_ring_capacity*segment;
+  Mem_Size upload_size = sizeof(Quad_Instance)*instance_count;
+  
+  gl.BindBuffer(GL_ARRAY_BUFFER, r->vertex_vbo);
+  if (r->instance_ring_memory) {
+    GLsync fence = r->instance_ring_fences[segment];
+    if (fence) {
+      gl.ClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+      gl.DeleteSync(fence);
+      r->instance_ring_fences[segment] = null;
+    }
+    memcpy(r->instance_ring_memory + r->instance_ring_capacity*segment,
+           r->instances, upload_size);
+  } else if (instance_count) {
+    gl.BufferSubData(GL_ARRAY_BUFFER, segment_offset, upload_size, r->instances);
+  }
+  
+  renderer_upload_font_atlas(gl, r->state.font);
+  
   V2 ws = r->window_size;
-  V2i min = v2i((i32)(clip.min.x + ws.x*0.5f), (i32)(clip.min.y + ws.y*0.5f));
-  V2i size = v2_to_v2i(rect2_get_size(clip));
+  M4 projection = m4_orthographic(-ws.x*0.5f, ws.x*0.5f,
+                                  -ws.y*0.5f, ws.y*0.5f,
+                                  1, -1);
+  gl.ClearColor(0, 0, 0, 1);
+  gl.Clear(GL_COLOR_BUFFER_BIT|GL_DEPTH_BUFFER_BIT);
   
+  gl.UseProgram(r->shader);
+  gl.UniformMatrix4fv(r->view_location, 1, GL_FALSE, (f32 *)&projection);
   gl.Enable(GL_SCISSOR_TEST);
-  glScissor(min.x, min.y, size.x, size.y);
   
-  Quad_Instance *result = sb_new(Quad_Instance, 10000);
+  i32 batch_count = sb_count(r->batches);
+  for (i32 batch_index = 0; batch_index < batch_count; batch_index++) {
+    Quad_Batch *batch = r->batches + batch_index;
+    i32 end = batch_index + 1 < batch_count
+      ? r->batches[batch_index + 1].first
+      : instance_count;
+    i32 count = end - batch->first;
+    if (count == 0) continue;
+    
+    Rect2 clip = batch->clip;
+    V2i min = v2i((i32)(clip.min.x + ws.x*0.5f), (i32)(clip.min.y + ws.y*0.5f));
+    V2i size = v2_to_v2i(rect2_get_size(clip));
+    glScissor(min.x, min.y, size.x, size.y);
+    
+    renderer_set_model(gl, r, batch->transform);
+    renderer_bind_instances(gl, segment_offset + sizeof(Quad_Instance)*batch->first);
+    gl.DrawArraysInstanced(GL_TRIANGLES, 0, 6, count);
+  }
+  
+  gl.Disable(GL_SCISSOR_TEST);
+  if (r->instance_ring_memory) {
+    r->instance_ring_fences[segment] = gl.FenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  }
+}
+
+// NOTE(lvl5): the cpu version of the blend gl does, GL_SRC_ALPHA and GL_ONE_MINUS_SRC_ALPHA
+// on every channel, alpha included: (src*a + dst*(255 - a))/255, rounded.
+// software_blend_4 does the same math, so a pixel doesn't depend on which one drew it
+u32 software_div_255(u32 x) {
+  x += 128;
+  u32 result = (x + (x >> 8)) >> 8;
+  return result;
+}
+
+u32 software_blend(u32 dst, u32 src, u32 alpha) {
+  u32 result = 0;
+  for (u32 shift = 0; shift < 32; shift += 8) {
+    u32 x = ((src >> shift) & 0xFF)*alpha + ((dst >> shift) & 0xFF)*(255 - alpha);
+    result |= software_div_255(x) << shift;
+  }
   return result;
 }
 
+// NOTE(lvl5): two pixels at a time, as 16 bit lanes. the biggest sum is
+// 255*255 + 128 + 254, so nothing overflows
+__m128i software_blend_half(__m128i dst, __m128i src, __m128i alpha) {
+  __m128i x = _mm_add_epi16(_mm_mullo_epi16(src, alpha),
+                            _mm_mullo_epi16(dst, _mm_sub_epi16(_mm_set1_epi16(255), alpha)));
+  x = _mm_add_epi16(x, _mm_set1_epi16(128));
+  __m128i result = _mm_srli_epi16(_mm_add_epi16(x, _mm_srli_epi16(x, 8)), 8);
+  return result;
+}
+
+// alpha holds one value 0-255 per 32 bit lane
+void software_blend_4(u32 *dst, __m128i src, __m128i alpha) {
+  __m128i zero = _mm_setzero_si128();
+  __m128i d = _mm_loadu_si128((__m128i *)dst);
+  alpha = _mm_or_si128(alpha, _mm_slli_epi32(alpha, 8));
+  alpha = _mm_or_si128(alpha, _mm_slli_epi32(alpha, 16));
+  
+  __m128i lo = software_blend_half(_mm_unpacklo_epi8(d, zero), _mm_unpacklo_epi8(src, zero),
+                                   _mm_unpacklo_epi8(alpha, zero));
+  __m128i hi = software_blend_half(_mm_unpackhi_epi8(d, zero), _mm_unpackhi_epi8(src, zero),
+                                   _mm_unpackhi_epi8(alpha, zero));
+  _mm_storeu_si128((__m128i *)dst, _mm_packus_epi16(lo, hi));
+}
+
+// NOTE(lvl5): the atlas is white, coverage is in alpha, so only alpha gets sampled.
+// sampling is nearest, glyphs are drawn at atlas size anyway
+u32 software_sample_coverage(Bitmap *atlas, Quad_Instance *inst, f32 u, f32 v) {
+  i32 x = clamp_i32((i32)(u*inst->texture_w), 0, inst->texture_w - 1);
+  i32 y = clamp_i32((i32)(v*inst->texture_h), 0, inst->texture_h - 1);
+  u32 texel = atlas->data[(inst->texture_y + y)*atlas->width + inst->texture_x + x];
+  return texel >> 24;
+}
+
+// NOTE(lvl5): covers the pixels whose centers are inside the quad, like gl does.
+// offset moves instance positions into pixels
+void software_draw_quad(Bitmap *target, Bitmap *atlas, Quad_Instance *inst,
+                        Rect2i clip, V2 offset)
+{
+  V2 min = v2_add(inst->position, offset);
+  V2 size = inst->size;
+  i32 x0 = max_i32(ceil_f32_i32(min.x - 0.5f), clip.min.x);
+  i32 y0 = max_i32(ceil_f32_i32(min.y - 0.5f), clip.min.y);
+  i32 x1 = min_i32(ceil_f32_i32(min.x + size.x - 0.5f), clip.max.x);
+  i32 y1 = min_i32(ceil_f32_i32(min.y + size.y - 0.5f), clip.max.y);
+  
+  u32 color = inst->color;
+  u32 color_alpha = color >> 24;
+  for (i32 y = y0; y < y1; y++) {
+    f32 v = (y + 0.5f - min.y)/size.y;
+    u32 *row = target->data + y*target->width;
+    
+    i32 x = x0;
+    for (; x + 4 <= x1; x += 4) {
+      u32 alpha[4];
+      u32 src[4];
+      for (i32 i = 0; i < 4; i++) {
+        f32 u = (x + i + 0.5f - min.x)/size.x;
+        alpha[i] = software_div_255(software_sample_coverage(atlas, inst, u, v)*color_alpha);
+        src[i] = (color & 0x00FFFFFF) | (alpha[i] << 24);
+      }
+      software_blend_4(row + x, _mm_loadu_si128((__m128i *)src),
+                       _mm_loadu_si128((__m128i *)alpha));
+    }
+    for (; x < x1; x++) {
+      f32 u = (x + 0.5f - min.x)/size.x;
+      u32 a = software_div_255(software_sample_coverage(atlas, inst, u, v)*color_alpha);
+      row[x] = software_blend(row[x], (color & 0x00FFFFFF) | (a << 24), a);
+    }
+  }
+}
+
+// NOTE(lvl5): rotated and scaled quads. every pixel in the bounds gets mapped back
+// into the quad, these are rare enough that it doesn't need to be fast
+void software_draw_quad_transformed(Bitmap *target, Bitmap *atlas, Quad_Instance *inst,
+                                    Rect2i clip, V2 offset, Render_Transform t)
+{
+  V2 corners[4] = {
+    inst->position,
+    v2_add(inst->position, v2(inst->size.x, 0)),
+    v2_add(inst->position, v2(0, inst->size.y)),
+    v2_add(inst->position, inst->size),
+  };
+  V2 min = {0};
+  V2 max = {0};
+  for (i32 i = 0; i < 4; i++) {
+    V2 c = corners[i];
+    V2 p = v2_add(v2_add(t.origin, offset), v2_add(v2_mul(t.x_axis, c.x), v2_mul(t.y_axis, c.y)));
+    min = i ? v2(min_f32(min.x, p.x), min_f32(min.y, p.y)) : p;
+    max = i ? v2(max_f32(max.x, p.x), max_f32(max.y, p.y)) : p;
+  }
+  
+  f32 det = t.x_axis.x*t.y_axis.y - t.y_axis.x*t.x_axis.y;
+  if (det == 0) return;
+  
+  i32 x0 = max_i32(ceil_f32_i32(min.x - 0.5f), clip.min.x);
+  i32 y0 = max_i32(ceil_f32_i32(min.y - 0.5f), clip.min.y);
+  i32 x1 = min_i32(ceil_f32_i32(max.x - 0.5f), clip.max.x);
+  i32 y1 = min_i32(ceil_f32_i32(max.y - 0.5f), clip.max.y);
+  
+  u32 color = inst->color;
+  for (i32 y = y0; y < y1; y++) {
+    for (i32 x = x0; x < x1; x++) {
+      V2 d = v2_sub(v2(x + 0.5f, y + 0.5f), v2_add(t.origin, offset));
+      f32 u = ((d.x*t.y_axis.y - d.y*t.y_axis.x)/det - inst->position.x)/inst->size.x;
+      f32 v = ((t.x_axis.x*d.y - t.x_axis.y*d.x)/det - inst->position.y)/inst->size.y;
+      if (u >= 0 && u < 1 && v >= 0 && v < 1) {
+        u32 a = software_div_255(software_sample_coverage(atlas, inst, u, v)*(color >> 24));
+        u32 *pixel = target->data + y*target->width + x;
+        *pixel = software_blend(*pixel, (color & 0x00FFFFFF) | (a << 24), a);
+      }
+    }
+  }
+}
+
+// NOTE(lvl5): the cpu version of renderer_draw_batches. the target is cleared to
+// black like the gl backbuffer, and the bottom row is first, so it can go straight to bmp_save
+void renderer_rasterize_batches(Renderer *r) {
+  begin_profiler_function();
+  
+  Bitmap *target = &r->target;
+  V2i target_size = v2_to_v2i(r->window_size);
+  if (target->width != target_size.x || target->height != target_size.y) {
+    push_system_context();
+    if (target->data) {
+      free_memory(target->data);
+    }
+    *target = make_empty_bitmap(target_size.x, target_size.y);
+    pop_context();
+  }
+  for (i32 i = 0; i < target->width*target->height; i++) {
+    target->data[i] = color_u32(0, 0, 0, 0xFF);
+  }
+  
+  Bitmap *atlas = &r->state.font->atlas;
+  V2 half = v2_mul(r->window_size, 0.5f);
+  i32 instance_count = sb_count(r->instances);
+  i32 batch_count = sb_count(r->batches);
+  for (i32 batch_index = 0; batch_index < batch_count; batch_index++) {
+    Quad_Batch *batch = r->batches + batch_index;
+    i32 end = batch_index + 1 < batch_count
+      ? r->batches[batch_index + 1].first
+      : instance_count;
+    
+    // the same rounding as the scissor rect
+    Rect2 clip = batch->clip;
+    V2i min = v2i((i32)(clip.min.x + half.x), (i32)(clip.min.y + half.y));
+    V2i size = v2_to_v2i(rect2_get_size(clip));
+    Rect2i pixel_clip = rect2i_min_max(
+      v2i(max_i32(min.x, 0), max_i32(min.y, 0)),
+      v2i(min_i32(min.x + size.x, target->width), min_i32(min.y + size.y, target->height)));
+    if (pixel_clip.min.x >= pixel_clip.max.x || pixel_clip.min.y >= pixel_clip.max.y) continue;
+    
+    Render_Transform t = batch->transform;
+    bool is_translation = render_transform_is_translation(t);
+    for (i32 i = batch->first; i < end; i++) {
+      Quad_Instance *inst = r->instances + i;
+      if (is_translation) {
+        software_draw_quad(target, atlas, inst, pixel_clip, v2_add(half, t.origin));
+      } else {
+        software_draw_quad_transformed(target, atlas, inst, pixel_clip, half, t);
+      }
+    }
+  }
+  
+  end_profiler_function();
+}
+
+// NOTE(lvl5): values are key << 32 | item index, sorted by the key a byte at a time.
+// the item index breaks ties, so equal keys stay in drawing order. most frames only
+// use a couple of layers and clips, so passes where every key has the same byte get skipped
+void sort_render_items(u64 *values, u64 *temp, u32 count) {
+  u32 offsets[4][256] = {0};
+  for (u32 i = 0; i < count; i++) {
+    u32 key = (u32)(values[i] >> 32);
+    for (u32 pass = 0; pass < 4; pass++) {
+      offsets[pass][(key >> (pass*8)) & 0xFF]++;
+    }
+  }
+  
+  u64 *src = values;
+  u64 *dst = temp;
+  for (u32 pass = 0; pass < 4 && count; pass++) {
+    u32 shift = 32 + pass*8;
+    u32 *pass_offsets = offsets[pass];
+    if (pass_offsets[(src[0] >> shift) & 0xFF] == count) continue;
+    
+    u32 total = 0;
+    for (u32 i = 0; i < 256; i++) {
+      u32 c = pass_offsets[i];
+      pass_offsets[i] = total;
+      total += c;
+    }
+    for (u32 i = 0; i < count; i++) {
+      dst[pass_offsets[(src[i] >> shift) & 0xFF]++] = src[i];
+    }
+    u64 *swap = src;
+    src = dst;
+    dst = swap;
+  }
+  if (src != values) {
+    copy_memory_slow(values, src, count*sizeof(u64));
+  }
+}
+
 void renderer_end_render(gl_Funcs gl, Renderer *r) {
   begin_profiler_function();
   
   push_scratch_context();
   
-  Quad_Instance *instances = null;
+  Quad_Instance *instances = r->instances;
+  sb_count(instances) = 0;
+  sb_count(r->batches) = 0;
+  sb_count(r->run_copies) = 0;
+  sb_count(r->run_fixups) = 0;
   
   u32 item_count = sb_count(r->items);
-  {
-    u32 i = 1;
-    while (i < item_count) {
-      Render_Item x = r->items[i];
-      u32 j = i - 1;
-      while (j >= 0 && r->items[j].state.z > x.state.z) {
-        r->items[j+1] = r->items[j];
-        j--;
-      }
-      r->items[j+1] = x;
-      i++;
-    }
+  u64 *order = alloc_array(u64, item_count + 1);
+  u64 *order_temp = alloc_array(u64, item_count + 1);
+  for (u32 i = 0; i < item_count; i++) {
+    order[i] = ((u64)r->items[i].key << 32) | i;
   }
+  sort_render_items(order, order_temp, item_count);
   
-  Rect2 current_clip = rect2_min_size(v2_zero(), v2_zero());
+  if (!r->glyph_run_capacity) {
+    renderer_sweep_glyph_runs(r);
+  }
   
+  Font *font = r->state.font;
+  i32 current_clip = -1;
+  i32 current_transform = -1;
   
-  for (u32 item_index = 0; item_index < item_count; item_index++) {
-    Render_Item *item = r->items + item_index;
-    Font *font = item->state.font;
+  for (u32 order_index = 0; order_index < item_count; order_index++) {
+    Render_Item *item = r->items + (u32)order[order_index];
     
-    if (!rect2_are_equal(current_clip, item->state.clip)) {
-      current_clip = item->state.clip;
-      instances = renderer_dump_quads(gl, r, instances, current_clip);
+    // NOTE(lvl5): a new draw only when the clip or the transform changes,
+    // after sorting that's once per clip for almost every frame
+    i32 clip_index = (i32)(item->key & RENDER_KEY_CLIP_MASK);
+    if (clip_index != current_clip || item->transform_index != current_transform) {
+      current_clip = clip_index;
+      current_transform = item->transform_index;
+      renderer_begin_batch(r, instances, r->clips[current_clip],
+                           r->transforms[current_transform]);
     }
     
     switch (item->type) {
       case Render_Type_STRING: {
-        M4 matrix = item->state.matrix;
         String s = item->string;
-        V2 offset = v2_zero();
+        V2 offset = item->p;
         
-        for (u32 char_index = 0; char_index < s.count; char_index++) {
-          char first = s.data[char_index] - font->first_codepoint;
-          
-          Rect2i rect = font->atlas.rects[first];
-          V2 origin = font->origins[first];
-          
-          u16 width = (u16)(rect.max.x - rect.min.x);
-          u16 height = (u16)(rect.max.y - rect.min.y);
-          
-          
-          M4 m = matrix;
-          m = m4_mul_m4(m, m4_translated(v3(offset.x + origin.x,
-                                            offset.y + origin.y, 
-                                            0)));
-          m = m4_mul_m4(m, m4_scaled(v3(width, height, 1)));
+        u32 char_index = 0;
+        while (char_index < s.count) {
+          i32 codepoint_length;
+          u32 codepoint = utf8_decode(s.data + char_index, (i32)(s.count - char_index),
+                                      &codepoint_length);
+          Glyph *glyph = font_use_glyph(font, font_get_glyph(font, codepoint));
+          queue_glyph(&instances, glyph, offset, item->color);
           
-          
-          Quad_Instance inst = {
-            .matrix = m,
-            .texture_x = (u16)rect.min.x,
-            .texture_y = (u16)rect.min.y,
-            .texture_w = width,
-            .texture_h = height,
-            .color = item->state.color,
-          };
-          
-          sb_push(instances, inst);
-          
-          if (char_index != s.count - 1) {
-            i8 advance = font_get_advance(font, s.data[char_index], s.data[char_index+1]);
+          char_index += codepoint_length;
+          if (char_index < s.count) {
+            i8 advance = font_get_codepoint_advance(font, codepoint, (u8)s.data[char_index]);
             offset.x += advance;
           }
         }
       } break;
       
       case Render_Type_RECT: {
-        queue_rect(instances, item->rect, item->state);
+        queue_rect(&instances, font, item->rect, item->color);
       } break;
       
       case Render_Type_BUFFER: {
-        M4 matrix = item->state.matrix;
-        Font *font = item->state.font;
-        
         Buffer_View *view = item->buffer.view;
         Buffer *buffer = view->buffer;
         Color_Theme *theme = item->buffer.theme;
@@ -349,10 +1118,10 @@ void renderer_end_render(gl_Funcs gl, Renderer *r) {
         Rect2 buffer_rect = item->buffer.rect;
         V2 buffer_rect_size = rect2_get_size(buffer_rect);
         
-        V2 offset = v2(buffer_rect.min.x,
-                       buffer_rect.max.y + scroll->y*font->line_spacing);
         i32 gap_start = get_gap_start(buffer);
         i32 gap_count = get_gap_count(buffer);
+        i32 *line_starts = buffer->lines.line_starts;
+        i32 line_count = sb_count(line_starts);
         
         f32 PADDING = 4.0f;
         
@@ -362,13 +1131,62 @@ void renderer_end_render(gl_Funcs gl, Renderer *r) {
         // TODO(lvl5): something is wrong with border_bottom
         f32 border_bottom = scroll->y + lines_on_screen - PADDING;
         
+        // NOTE(lvl5): the cursor line comes from the line index, so the cursor
+        // is kept on screen without walking the text up to it
+        i32 cursor_line = view->is_single_line ? 0 : buffer_get_line(buffer, buffer->cursor);
+        {
+          f32 old_scroll = scroll->y;
+          f32 target = 0;
+          if (cursor_line > border_bottom) {
+            target = cursor_line - border_bottom;
+          } else if (cursor_line < border_top) {
+            target = cursor_line - border_top;
+          }
+          // NOTE(lvl5): snaps once it is close, otherwise it would never stop moving
+          scroll->y += abs_f32(target) > 0.01f ? target/6 : target;
+          
+          if (scroll->y < 0) {
+            scroll->y = 0;
+          }
+          if (scroll->y != old_scroll) {
+            r->animating = true;
+          }
+        }
+        
+        // NOTE(lvl5): drawing starts at the first visible line and stops after
+        // the last one, so the cost doesn't depend on the file or the scroll
         i32 line_index = 0;
-        i32 added = 0;
-        bool cursor_rendered = false;
+        if (!view->is_single_line) {
+          line_index = ceil_f32_i32(scroll->y - 1);
+          line_index = clamp_i32(line_index, 0, line_count - 1);
+        }
+        i32 first_char = line_starts[line_index];
+        
+        V2 offset = v2(buffer_rect.min.x,
+                       buffer_rect.max.y + (scroll->y - line_index)*font->line_spacing);
+        i32 added = first_char >= gap_start ? gap_count : 0;
         
-        Syntax *buffer_colors = buffer->cache.colors;
+        bool has_colors = buffer->cache.tokens != null;
+        Color_Iterator colors = buffer_colors_begin(buffer, first_char);
+        Find_Iterator matches = buffer_find_begin(buffer, first_char);
+        i32 extra_cursor_index = 0;
+        i32 extra_cursor_count = buffer_cursor_count(buffer) - 1;
+        i32 continuation_left = 0;
+        i32 visible_start = -1;
+        i32 visible_end = 0;
         
-        for (i32 char_index_relative = 0;
+        // NOTE(lvl5): lines without cursors or matches on them are copied from the glyph
+        // run cache. a line that isn't there yet is laid out as usual and recorded
+        Line_Hash *line_hashes = buffer->lines.hashes;
+        bool use_runs = !view->is_single_line && line_hashes &&
+          (i32)sb_count(line_hashes) == line_count;
+        bool at_line_start = true;
+        Glyph_Run *recording = null;
+        i32 recording_end = 0;
+        i32 recording_first = 0;
+        V2 recording_origin = v2_zero();
+        
+        for (i32 char_index_relative = first_char;
              char_index_relative < buffer->count; // last symbol is 0
              char_index_relative++) 
         {
@@ -376,14 +1194,101 @@ void renderer_end_render(gl_Funcs gl, Renderer *r) {
             added = gap_count;
           }
           i32 char_index = char_index_relative + added;
-          char first = buffer->data[char_index] - font->first_codepoint;
+          
+          // NOTE(lvl5): the rest of a utf-8 sequence was drawn with its first byte
+          if (continuation_left > 0) {
+            continuation_left--;
+            continue;
+          }
+          
+          if (recording && char_index_relative == recording_end) {
+            for (i32 i = recording_first; i < (i32)sb_count(instances); i++) {
+              Quad_Instance inst = instances[i];
+              inst.position = v2_sub(inst.position, recording_origin);
+              sb_push(recording->instances, inst);
+            }
+            recording->width = offset.x - recording_origin.x;
+            recording = null;
+          }
+          
+          if (at_line_start) {
+            at_line_start = false;
+            
+            i32 line_start = char_index_relative;
+            i32 line_end = line_index + 1 < line_count
+              ? line_starts[line_index + 1] - 1
+              : buffer->count - 1;
+            
+            if (use_runs && line_index >= scroll->y - 1 && line_start < line_end) {
+              while (extra_cursor_index < extra_cursor_count &&
+                     buffer->cursors[extra_cursor_index].pos < line_start) {
+                extra_cursor_index++;
+              }
+              bool has_cursor =
+                (buffer->cursor >= line_start && buffer->cursor <= line_end) ||
+                (buffer->mark >= line_start && buffer->mark <= line_end) ||
+                (extra_cursor_index < extra_cursor_count &&
+                 buffer->cursors[extra_cursor_index].pos <= line_end);
+              
+              if (!has_cursor && !find_iterator_any_in_range(&matches, line_start, line_end)) {
+                Line_Hash *hash = line_hashes + line_index;
+                bool text_changed = !hash->text_hash;
+                if (text_changed) {
+                  hash->text_hash = buffer_hash_text(buffer, line_start, line_end);
+                }
+                if (text_changed || hash->color_generation != buffer->cache.generation) {
+                  hash->color_hash = buffer_hash_colors(buffer, line_start, line_end);
+                  hash->color_generation = buffer->cache.generation;
+                }
+                
+                u64 key = glyph_run_key(buffer, hash, font, theme);
+                Glyph_Run *run = renderer_find_glyph_run(r, key);
+                if (run->key) {
+                  run->last_used = r->frame;
+                  queue_glyph_run(r, &instances, font, run, offset);
+                  offset.x += run->width;
+                  
+                  if (visible_start < 0) {
+                    visible_start = line_start;
+                  }
+                  visible_end = line_end;
+                  
+                  // NOTE(lvl5): on to the newline, which is handled like any other
+                  char_index_relative = line_end;
+                  if (char_index_relative >= gap_start) {
+                    added = gap_count;
+                  }
+                  char_index = char_index_relative + added;
+                } else {
+                  recording = renderer_add_glyph_run(r, key);
+                  recording_end = line_end;
+                  recording_first = sb_count(instances);
+                  recording_origin = offset;
+                }
+              }
+            }
+          }
+          
+          i32 codepoint_length = 1;
+          u32 codepoint = (u8)buffer->data[char_index];
+          if (codepoint >= 0x80) {
+            codepoint = get_buffer_codepoint(buffer, char_index_relative, &codepoint_length);
+            continuation_left = codepoint_length - 1;
+          }
+          i32 first = font_get_glyph(font, codepoint);
           
           u32 char_color = 0xFFFFFFFF;
-          if (buffer_colors) {
-            char_color = theme->colors[buffer_colors[char_index_relative]];
+          if (has_colors) {
+            char_color = theme->colors[color_iterator_get(&colors, char_index_relative)];
           }
           
-          i8 advance = font_get_advance(font, buffer->data[char_index], buffer->data[char_index+1]);
+          i8 advance = font_get_codepoint_advance(font, codepoint,
+                                                  (u8)buffer->data[char_index+1]);
+          
+          while (extra_cursor_index < extra_cursor_count &&
+                 buffer->cursors[extra_cursor_index].pos < char_index_relative) {
+            extra_cursor_index++;
+          }
           
           if (char_index_relative == buffer->cursor) {
             f32 cursor_y = offset.y-font->line_spacing - font->descent;
@@ -394,26 +1299,19 @@ void renderer_end_render(gl_Funcs gl, Renderer *r) {
               rect2_min_size(cursor_min, cursor_size);
             
             u32 cursor_color = theme->colors[Syntax_CURSOR];
-            queue_rect(instances, cursor_rect,
-                       (Renderer_State){
-                       .matrix = matrix,
-                       .font = font,
-                       .color = cursor_color,
-                       });
+            queue_rect(&instances, font, cursor_rect, cursor_color);
             char_color = color_invert(cursor_color);
+          } else if (extra_cursor_index < extra_cursor_count &&
+                     buffer->cursors[extra_cursor_index].pos == char_index_relative) {
+            V2 cursor_min = v2(offset.x,
+                               offset.y-font->line_spacing - font->descent);
+            V2 cursor_size = v2((f32)advance, font->line_height);
+            Rect2 cursor_rect = 
+              rect2_min_size(cursor_min, cursor_size);
             
-            f32 target = 0;
-            if (line_index > border_bottom) {
-              target = line_index - border_bottom;
-            } else if (line_index < border_top ) {
-              target = line_index - border_top;
-            }
-            scroll->y += target/6;
-            
-            if (scroll->y < 0) {
-              scroll->y = 0;
-            }
-            cursor_rendered = true;
+            u32 cursor_color = theme->colors[Syntax_CURSOR];
+            queue_rect(&instances, font, cursor_rect, cursor_color);
+            char_color = color_invert(cursor_color);
           } else if (char_index_relative == buffer->mark) {
             V2 cursor_min = v2(offset.x,
                                offset.y-font->line_spacing - font->descent);
@@ -423,32 +1321,29 @@ void renderer_end_render(gl_Funcs gl, Renderer *r) {
             
             u32 cursor_color = theme->colors[Syntax_CURSOR];
             
-            Renderer_State state = {
-              .matrix = matrix,
-              .font = font,
-              .color = cursor_color,
-            };
-            
             f32 thick = 1.0f;
             V2 size = rect2_get_size(cursor_rect);
             
-            queue_rect(instances,
-                       rect2_min_size(cursor_rect.min, v2(size.x, thick)), state);
-            queue_rect(instances,
-                       rect2_min_size(cursor_rect.min, v2(thick, size.y)), state);
-            queue_rect(instances, rect2_min_size(v2(cursor_rect.min.x, cursor_rect.max.y-thick), 
-                                                 v2(size.x, thick)), state);
-            queue_rect(instances, rect2_min_size(v2(cursor_rect.max.x-thick, cursor_rect.min.y),
-                                                 v2(thick, size.y)), state);
+            queue_rect(&instances, font,
+                       rect2_min_size(cursor_rect.min, v2(size.x, thick)), cursor_color);
+            queue_rect(&instances, font,
+                       rect2_min_size(cursor_rect.min, v2(thick, size.y)), cursor_color);
+            queue_rect(&instances, font,
+                       rect2_min_size(v2(cursor_rect.min.x, cursor_rect.max.y-thick), 
+                                      v2(size.x, thick)), cursor_color);
+            queue_rect(&instances, font,
+                       rect2_min_size(v2(cursor_rect.max.x-thick, cursor_rect.min.y),
+                                      v2(thick, size.y)), cursor_color);
           }
           
-          if (first == '\n') {
+          if (codepoint == '\n') {
+            at_line_start = true;
             offset.x = buffer_rect.min.x;
             if (!view->is_single_line) {
               offset.y -= font->line_spacing;
               line_index++;
             }
-            if (line_index > lines_on_screen + scroll->y && cursor_rendered) {
+            if (line_index > lines_on_screen + scroll->y) {
               goto end;
             }
             continue;
@@ -458,35 +1353,49 @@ void renderer_end_render(gl_Funcs gl, Renderer *r) {
             continue;
           }
           
-          Rect2i rect = font->atlas.rects[first];
-          V2 origin = font->origins[first];
-          
-          u16 width = (u16)(rect.max.x - rect.min.x);
-          u16 height = (u16)(rect.max.y - rect.min.y);
+          if (visible_start < 0) {
+            visible_start = char_index_relative;
+          }
+          visible_end = char_index_relative + 1;
           
-          M4 m = matrix;
-          m = m4_untranslate(m, v2_to_v3(v2_add(offset, origin), 0));
-          m = m4_unscale(m, v3(width, height, 1));
-          Quad_Instance inst = {
-            .matrix = m,
-            .texture_x = (u16)rect.min.x,
-            .texture_y = (u16)rect.min.y,
-            .texture_w = width,
-            .texture_h = height,
-            .color = char_color,
-          };
+          if (find_iterator_in_match(&matches, char_index_relative) &&
+              char_index_relative != buffer->cursor) {
+            V2 match_min = v2(offset.x,
+                              offset.y-font->line_spacing - font->descent);
+            Rect2 match_rect = rect2_min_size(match_min,
+                                              v2((f32)advance, font->line_height));
+            queue_rect(&instances, font, match_rect, theme->colors[Syntax_FIND_MATCH]);
+          }
           
-          sb_push(instances, inst);
+          Glyph *glyph = font_use_glyph(font, first);
+          if (recording && first >= FONT_ASCII_COUNT) {
+            Glyph_Run_Patch patch = {
+              .instance = sb_count(instances) - recording_first,
+              .glyph = first,
+              .p = v2_sub(offset, recording_origin),
+            };
+            sb_push(recording->patches, patch);
+          }
+          queue_glyph(&instances, glyph, offset, char_color);
           offset.x += advance;
         }
         
         
         end:;
+        view->visible_start = max(visible_start, 0);
+        view->visible_end = visible_end;
       } break;
     }
   }
   
-  renderer_dump_quads(gl, r, instances, current_clip);
+  renderer_copy_glyph_runs(r, instances);
+  r->instances = instances;
+  if (r->backend == Render_Backend_SOFTWARE || r->capture) {
+    renderer_rasterize_batches(r);
+  }
+  if (r->backend == Render_Backend_OPENGL) {
+    renderer_draw_batches(gl, r);
+  }
   
   pop_context();
   
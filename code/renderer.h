@@ -2,15 +2,27 @@
 #include "parser.h"
 #include "lvl5_opengl.h"
 
+// NOTE(lvl5): position and size are in pixels from the window center. the view
+// transform is a uniform, so a quad is 28 bytes instead of carrying a matrix
 typedef struct Quad_Instance {
+  V2 position;
+  V2 size;
   u16 texture_x;
   u16 texture_y;
   u16 texture_w;
   u16 texture_h;
-  M4 matrix;
   u32 color;
 } Quad_Instance;
 
+// NOTE(lvl5): a point p goes to origin + p.x*x_axis + p.y*y_axis. items that are
+// only translated are placed on the cpu, rotated or scaled ones get their own
+// draw with the transform as a uniform
+typedef struct {
+  V2 x_axis;
+  V2 y_axis;
+  V2 origin;
+} Render_Transform;
+
 #if 0
 typedef struct {
   Render_Layer_UI,
@@ -21,9 +33,9 @@ typedef struct {
 typedef struct {
   Font *font;
   u32 color;
-  M4 matrix;
+  Render_Transform transform;
   f32 z;
-  Rect2 clip;
+  i32 clip_index; // into Renderer.clips
 } Renderer_State;
 
 typedef enum {
@@ -36,9 +48,21 @@ typedef enum {
 typedef struct Buffer_View Buffer_View;
 typedef struct Color_Theme Color_Theme;
 
+// NOTE(lvl5): items are sorted by key, the layer in the top byte and the clip index
+// below it. clip indices only grow in the order things are drawn, so sorting
+// keeps the submission order within a layer and only groups equal clips together.
+// there is one atlas, so the texture doesn't need to be in the key
+#define RENDER_KEY_CLIP_MASK 0xFFFFFF
+#define RENDER_KEY_LAYER_SHIFT 24
+
+// translated items are placed when they are drawn, transform_index is
+// only set for rotated or scaled ones, 0 is none
 typedef struct {
   union {
-    String string;
+    struct {
+      String string;
+      V2 p;
+    };
     Rect2 rect;
     struct {
       Rect2 rect;
@@ -47,10 +71,112 @@ typedef struct {
       V2 *scroll;
     } buffer;
   };
-  Renderer_State state;
+  u32 key;
+  i32 transform_index; // into Renderer.transforms
+  u32 color;
   Render_Type type;
 } Render_Item;
 
+// NOTE(lvl5): the ascii glyphs of a font, rasterized once and kept on disk.
+// layout: header, FONT_ASCII_COUNT glyphs, coverage bytes
+#define FONT_CACHE_MAGIC 0x544E4F46
+#define FONT_CACHE_VERSION 1
+
+typedef struct {
+  u32 magic;
+  u32 version;
+  u32 total_size;
+  i32 pixel_height;
+  u64 ttf_hash;
+  i32 cell_width;
+  i32 cell_height;
+} Font_Cache_Header;
+
+typedef struct {
+  V2 origin;
+  u32 coverage_offset;
+  i8 advance;
+  u8 width;
+  u8 height;
+  u8 padding;
+} Font_Cache_Glyph;
+
+// NOTE(lvl5): the glyphs of one line laid out from the start of the line, keyed by
+// the hashes of its text and colors, so lines that didn't change get copied instead.
+// ascii glyphs are pinned in the atlas, the others can be evicted, so they are
+// looked up again every time the run is used
+typedef struct {
+  i32 instance;
+  i32 glyph;
+  V2 p;
+} Glyph_Run_Patch;
+
+typedef struct {
+  u64 key; // 0 is empty
+  u32 last_used;
+  f32 width;
+  Quad_Instance *instances;
+  Glyph_Run_Patch *patches;
+} Glyph_Run;
+
+// runs that weren't drawn for this many frames go away when the table fills up
+#define GLYPH_RUN_KEEP_FRAMES 120
+
+// NOTE(lvl5): cached lines only reserve their slice of the instances while items are
+// processed. the copies happen at the end, split between the main thread and the
+// workers, which is safe because they don't touch the atlas or the run table.
+// source is the run's own instances, which stay put even if the table is rebuilt
+typedef struct {
+  Quad_Instance *source;
+  i32 count;
+  i32 first;
+  V2 p;
+} Glyph_Run_Copy;
+
+// a patched glyph, resolved on the main thread and written over its copy
+typedef struct {
+  i32 index;
+  Quad_Instance instance;
+} Glyph_Run_Fixup;
+
+typedef struct {
+  volatile long ref_count;
+  volatile long next_chunk;
+  volatile long done_chunks;
+  i32 chunk_count;
+  Glyph_Run_Copy *copies;
+  i32 copy_count;
+  Quad_Instance *instances;
+  volatile long *queued_jobs;
+} Glyph_Run_Copy_Work;
+
+// fewer instances than this get copied on the main thread alone
+#define GLYPH_RUN_PARALLEL_MIN_INSTANCES 8192
+#define GLYPH_RUN_CHUNKS_PER_THREAD 4
+
+// NOTE(lvl5): instances from first up to the next batch's first share a clip and
+// a model transform, and go out in one draw
+typedef struct {
+  i32 first;
+  Rect2 clip;
+  Render_Transform transform;
+} Quad_Batch;
+
+// NOTE(lvl5): the instance buffer is split into one segment per frame in flight.
+// a frame copies all its instances into the next segment at once and draws every batch
+// out of it with an offset. with GL_ARB_buffer_storage the buffer stays mapped, and a
+// fence tells when the gpu is done with a segment, otherwise it's one BufferSubData
+#define INSTANCE_RING_FRAMES 3
+#define INSTANCE_RING_MIN_CAPACITY (1 << 16)
+
+// NOTE(lvl5): SOFTWARE rasterizes the same instances and batches into Renderer.target
+// on the cpu, so frames can be drawn and checked without a gpu. the OPENGL backend
+// uses it for Renderer.capture too
+typedef enum {
+  Render_Backend_OPENGL,
+  Render_Backend_SOFTWARE,
+} Render_Backend;
+
 #define MAX_STATE_COUNT 32
 typedef struct {
   Renderer_State stack[MAX_STATE_COUNT];
@@ -58,11 +184,43 @@ typedef struct {
   Renderer_State state;
   
   
+  Render_Backend backend;
+  // the next frame also goes into target, the caller saves it and clears this
+  bool capture;
+  // window sized, drawn by SOFTWARE and by captures. the bottom row comes first,
+  // like in a bmp
+  Bitmap target;
+  
   V2 window_size;
   Render_Item *items;
+  // side tables the items point into, cleared every frame
+  Rect2 *clips;
+  Render_Transform *transforms;
+  
+  // reused every frame
+  Quad_Instance *instances;
+  Quad_Batch *batches;
   
   GLuint vertex_vbo;
+  bool has_buffer_storage;
+  i32 instance_ring_capacity; // per segment
+  i32 instance_ring_segment;
+  Quad_Instance *instance_ring_memory; // null when it isn't mapped
+  GLsync instance_ring_fences[INSTANCE_RING_FRAMES];
   GLuint shader;
+  GLint view_location;
+  GLint model_location;
+  
+  u32 frame;
+  Glyph_Run_Copy *run_copies;
+  Glyph_Run_Fixup *run_fixups;
+  // copy jobs in the worker queue that haven't started yet
+  volatile long copy_jobs_queued;
+  // something is still moving, so the next frame will look different
+  bool animating;
+  Glyph_Run *glyph_runs;
+  i32 glyph_run_count;
+  i32 glyph_run_capacity;
 } Renderer;
 
 
@@ -0,0 +1,670 @@
+#include "search.h"
+
+#define TRIGRAM_COUNT (1 << 24)
+#define SEARCH_BINARY_CHECK_SIZE 4096
+
+void search_lock(Search_Index *index) {
+  while (_InterlockedCompareExchange(&index->lock, true, false) != false) {
+    _mm_pause();
+  }
+}
+
+void search_unlock(Search_Index *index) {
+  _InterlockedExchange(&index->lock, false);
+}
+
+u32 get_trigram(char *data) {
+  u32 result = ((u32)(u8)data[0] << 16) | ((u32)(u8)data[1] << 8) | (u32)(u8)data[2];
+  return result;
+}
+
+// NOTE(lvl5): trigrams are 24 bits, so three byte-wide passes are enough
+void sort_trigrams(u32 *values, u32 *temp, u32 count) {
+  u32 *src = values;
+  u32 *dst = temp;
+  for (u32 shift = 0; shift < 24; shift += 8) {
+    u32 offsets[256] = {0};
+    for (u32 i = 0; i < count; i++) {
+      offsets[(src[i] >> shift) & 0xFF]++;
+    }
+    u32 total = 0;
+    for (u32 i = 0; i < 256; i++) {
+      u32 c = offsets[i];
+      offsets[i] = total;
+      total += c;
+    }
+    for (u32 i = 0; i < count; i++) {
+      dst[offsets[(src[i] >> shift) & 0xFF]++] = src[i];
+    }
+    u32 *swap = src;
+    src = dst;
+    dst = swap;
+  }
+  // odd number of passes, the result is in temp
+  copy_memory_slow(values, src, count*sizeof(u32));
+}
+
+bool trigrams_contain(u32 *trigrams, u32 count, u32 trigram) {
+  u32 low = 0;
+  u32 high = count;
+  while (low < high) {
+    u32 mid = low + (high - low)/2;
+    if (trigrams[mid] < trigram) {
+      low = mid + 1;
+    } else {
+      high = mid;
+    }
+  }
+  bool result = low < count && trigrams[low] == trigram;
+  return result;
+}
+
+// NOTE(lvl5): seen is a bitset of TRIGRAM_COUNT bits, all zero,
+// and it's left all zero. result is a stretchy buffer allocated
+// with the current allocator
+u32 *extract_trigrams(char *data, i64 count, u32 *seen, u32 *trigram_count) {
+  u32 *result = sb_new(u32, 1024);
+  
+  for (i64 i = 0; i + 3 <= count; i++) {
+    u32 trigram = get_trigram(data + i);
+    u32 bit = 1u << (trigram & 31);
+    if (!(seen[trigram >> 5] & bit)) {
+      seen[trigram >> 5] |= bit;
+      sb_push(result, trigram);
+    }
+  }
+  
+  *trigram_count = sb_count(result);
+  for (u32 i = 0; i < *trigram_count; i++) {
+    seen[result[i] >> 5] = 0;
+  }
+  u32 *temp = alloc_array(u32, *trigram_count + 1);
+  sort_trigrams(result, temp, *trigram_count);
+  free_memory(temp);
+  
+  return result;
+}
+
+
+u32 search_get_file_slot(Search_Index *index, i32 *table, u32 capacity, String path) {
+  u32 slot = hash_string(path) & (capacity - 1);
+  while (table[slot] &&
+         !string_compare(index->files[table[slot] - 1]->path, path))
+  {
+    slot = (slot + 1) & (capacity - 1);
+  }
+  return slot;
+}
+
+// lock must be held
+Search_File *search_get_file(Search_Index *index, String path) {
+  u32 slot = search_get_file_slot(index, index->file_table,
+                                  index->file_table_capacity, path);
+  if (!index->file_table[slot]) {
+    push_system_context();
+    
+    if ((sb_count(index->files) + 1)*2 > index->file_table_capacity) {
+      u32 new_capacity = index->file_table_capacity*2;
+      i32 *new_table = alloc_array(i32, new_capacity);
+      zero_memory_slow(new_table, new_capacity*sizeof(i32));
+      for (u32 i = 0; i < sb_count(index->files); i++) {
+        u32 new_slot = search_get_file_slot(index, new_table, new_capacity,
+                                            index->files[i]->path);
+        new_table[new_slot] = i + 1;
+      }
+      free_memory(index->file_table);
+      index->file_table = new_table;
+      index->file_table_capacity = new_capacity;
+      slot = search_get_file_slot(index, index->file_table,
+                                  index->file_table_capacity, path);
+    }
+    
+    Search_File *file = alloc_struct(Search_File);
+    *file = (Search_File){
+      .path = alloc_string(path.data, path.count),
+      .index = sb_count(index->files),
+    };
+    sb_push(index->files, file);
+    index->file_table[slot] = sb_count(index->files);
+    
+    pop_context();
+  }
+  
+  Search_File *result = index->files[index->file_table[slot] - 1];
+  return result;
+}
+
+u32 hash_trigram(u32 trigram) {
+  u32 result = trigram;
+  result ^= result >> 16;
+  result *= 0x85EBCA6B;
+  result ^= result >> 13;
+  result *= 0xC2B2AE35;
+  result ^= result >> 16;
+  return result;
+}
+
+// lock must be held
+Search_Posting *search_get_posting(Search_Index *index, u32 trigram, bool create) {
+  if (create && (index->posting_count + 1)*2 > index->posting_capacity) {
+    push_system_context();
+    
+    u32 old_capacity = index->posting_capacity;
+    Search_Posting *old_postings = index->postings;
+    index->posting_capacity *= 2;
+    index->postings = alloc_array(Search_Posting, index->posting_capacity);
+    zero_memory_slow(index->postings, index->posting_capacity*sizeof(Search_Posting));
+    
+    for (u32 i = 0; i < old_capacity; i++) {
+      if (old_postings[i].files) {
+        u32 slot = hash_trigram(old_postings[i].trigram) & (index->posting_capacity - 1);
+        while (index->postings[slot].files) {
+          slot = (slot + 1) & (index->posting_capacity - 1);
+        }
+        index->postings[slot] = old_postings[i];
+      }
+    }
+    free_memory(old_postings);
+    
+    pop_context();
+  }
+  
+  Search_Posting *result = null;
+  u32 slot = hash_trigram(trigram) & (index->posting_capacity - 1);
+  while (index->postings[slot].files) {
+    if (index->postings[slot].trigram == trigram) {
+      result = index->postings + slot;
+      break;
+    }
+    slot = (slot + 1) & (index->posting_capacity - 1);
+  }
+  
+  if (!result && create) {
+    push_system_context();
+    result = index->postings + slot;
+    result->trigram = trigram;
+    result->files = sb_new(u32, 4);
+    index->posting_count++;
+    pop_context();
+  }
+  
+  return result;
+}
+
+// NOTE(lvl5): lock must be held. postings are only ever added to,
+// a file that lost a trigram stays in its posting, but the candidate check
+// goes through the file's own trigrams, so that's harmless
+void search_set_file_trigrams(Search_Index *index, Search_File *file,
+                              u32 *trigrams, u32 trigram_count)
+{
+  for (u32 i = 0; i < trigram_count; i++) {
+    if (!file->trigrams ||
+        !trigrams_contain(file->trigrams, file->trigram_count, trigrams[i]))
+    {
+      Search_Posting *posting = search_get_posting(index, trigrams[i], true);
+      sb_push(posting->files, file->index);
+    }
+  }
+  
+  push_system_context();
+  if (file->trigrams) {
+    free_memory(file->trigrams);
+  }
+  file->trigrams = alloc_array(u32, trigram_count + 1);
+  copy_memory_slow(file->trigrams, trigrams, trigram_count*sizeof(u32));
+  file->trigram_count = trigram_count;
+  pop_context();
+}
+
+
+// NOTE(lvl5): allocated with the system allocator, empty if the file is gone
+String search_read_file(String path) {
+  String result = {0};
+  os_File_Info info = global_os.get_file_info(path);
+  if (info.exists) {
+    os_File handle = global_os.open_file(path);
+    u64 size = global_os.get_file_size(handle);
+    
+    push_system_context();
+    result.data = alloc_array(char, size + 1);
+    pop_context();
+    
+    global_os.read_file(handle, result.data, 0, size);
+    global_os.close_file(handle);
+    result.count = size;
+  }
+  return result;
+}
+
+void search_free_file(String text) {
+  if (text.data) {
+    push_system_context();
+    free_memory(text.data);
+    pop_context();
+  }
+}
+
+bool text_is_binary(String text) {
+  i64 check_count = min((i64)text.count, SEARCH_BINARY_CHECK_SIZE);
+  bool result = find_literal(text.data, check_count, make_string("\0", 1)) >= 0;
+  return result;
+}
+
+void search_index_file(Search_Index *index, Search_File *file, String text,
+                       u64 write_time, u32 *seen)
+{
+  // NOTE(lvl5): not scratch, big files have millions of trigrams
+  push_system_context();
+  
+  bool is_binary = text_is_binary(text);
+  u32 trigram_count = 0;
+  u32 *trigrams = null;
+  if (!is_binary) {
+    trigrams = extract_trigrams(text.data, text.count, seen, &trigram_count);
+  }
+  
+  search_lock(index);
+  file->is_binary = is_binary;
+  if (!is_binary) {
+    search_set_file_trigrams(index, file, trigrams, trigram_count);
+  }
+  file->write_time = write_time;
+  file->indexed = true;
+  search_unlock(index);
+  
+  if (trigrams) {
+    free_memory(__get_header(trigrams));
+  }
+  pop_context();
+}
+
+void search_extract_job(void *data) {
+  Editor *editor = (Editor *)data;
+  Search_Index *index = &editor->search;
+  
+  push_system_context();
+  u32 *seen = alloc_array(u32, TRIGRAM_COUNT/32);
+  pop_context();
+  zero_memory_slow(seen, TRIGRAM_COUNT/32*sizeof(u32));
+  
+  while (true) {
+    search_lock(index);
+    Search_File *file = null;
+    while (!file && index->next_file < (i32)sb_count(index->files)) {
+      Search_File *candidate = index->files[index->next_file++];
+      if (!candidate->indexed) {
+        file = candidate;
+      }
+    }
+    search_unlock(index);
+    
+    if (!file) break;
+    
+    os_File_Info info = global_os.get_file_info(file->path);
+    String text = search_read_file(file->path);
+    search_index_file(index, file, text, info.write_time, seen);
+    search_free_file(text);
+  }
+  
+  push_system_context();
+  free_memory(seen);
+  pop_context();
+  
+  if (_InterlockedDecrement(&index->extract_jobs) == 0) {
+    index->building = false;
+  }
+}
+
+// NOTE(lvl5): finds new files and files that changed on disk since they were
+// indexed, then extracts their trigrams on all the worker threads
+void search_collect_job(void *data) {
+  Editor *editor = (Editor *)data;
+  Search_Index *index = &editor->search;
+  
+  push_system_context();
+  String *paths = sb_new(String, 256);
+  collect_files(editor->path, &paths, false);
+  pop_context();
+  
+  for (u32 i = 0; i < sb_count(paths); i++) {
+    Mem_Size mark = scratch_get_mark();
+    os_File_Info info = global_os.get_file_info(paths[i]);
+    scratch_set_mark(mark);
+    
+    search_lock(index);
+    Search_File *file = search_get_file(index, paths[i]);
+    if (file->indexed && file->write_time != info.write_time) {
+      file->indexed = false;
+    }
+    search_unlock(index);
+  }
+  
+  push_system_context();
+  for (u32 i = 0; i < sb_count(paths); i++) {
+    free_memory(paths[i].data);
+  }
+  free_memory(__get_header(paths));
+  pop_context();
+  
+  search_lock(index);
+  index->next_file = 0;
+  search_unlock(index);
+  
+  // NOTE(lvl5): these run until the whole tree is indexed, so one thread is left
+  // for search_query_job, or a query would wait for all of it
+  i32 job_count = max(global_os.thread_count - 1, 1);
+  index->extract_jobs = job_count;
+  for (i32 i = 0; i < job_count; i++) {
+    global_os.queue_add(global_os.thread_queue, search_extract_job, editor);
+  }
+}
+
+void search_init(Search_Index *index) {
+  push_system_context();
+  
+  *index = (Search_Index){0};
+  index->files = sb_new(Search_File *, 256);
+  index->file_table_capacity = 1024;
+  index->file_table = alloc_array(i32, index->file_table_capacity);
+  zero_memory_slow(index->file_table, index->file_table_capacity*sizeof(i32));
+  
+  index->posting_capacity = 1 << 16;
+  index->postings = alloc_array(Search_Posting, index->posting_capacity);
+  zero_memory_slow(index->postings, index->posting_capacity*sizeof(Search_Posting));
+  
+  index->results = sb_new(Search_Result, 64);
+  index->candidates = sb_new(u32, 64);
+  
+  index->input = buffer_make_empty();
+  index->input_view = (Buffer_View){
+    .buffer = &index->input,
+    .is_single_line = true,
+  };
+  
+  pop_context();
+}
+
+// NOTE(lvl5): call on startup and whenever files could have changed behind
+// our back, does nothing if a refresh is already running
+void search_refresh(Editor *editor) {
+  Search_Index *index = &editor->search;
+  if (_InterlockedCompareExchange(&index->building, true, false) == false) {
+    global_os.queue_add(global_os.thread_queue, search_collect_job, editor);
+  }
+}
+
+
+void search_push_result(Search_Index *index, i32 query_id, u32 file_index,
+                        String text, i64 match, i32 line)
+{
+  i64 line_start = match;
+  while (line_start > 0 && text.data[line_start - 1] != '\n') {
+    line_start--;
+  }
+  i64 line_end = line_start;
+  while (line_end < (i64)text.count &&
+         line_end - line_start < SEARCH_PREVIEW_MAX &&
+         text.data[line_end] != '\n' && text.data[line_end] != '\r')
+  {
+    line_end++;
+  }
+  
+  search_lock(index);
+  if (index->query_id == query_id &&
+      sb_count(index->results) < SEARCH_MAX_RESULTS)
+  {
+    String path = index->files[file_index]->path;
+    char line_str[16];
+    i32 line_str_count = sprintf_s(line_str, 16, ":%d: ", line + 1);
+    
+    push_system_context();
+    u64 count = path.count + line_str_count + (line_end - line_start);
+    String result_text = make_string(alloc_array(char, count), 0);
+    copy_memory_slow(result_text.data, path.data, path.count);
+    result_text.count += path.count;
+    copy_memory_slow(result_text.data + result_text.count, line_str, line_str_count);
+    result_text.count += line_str_count;
+    copy_memory_slow(result_text.data + result_text.count,
+                     text.data + line_start, line_end - line_start);
+    result_text.count += line_end - line_start;
+    
+    Search_Result result = {
+      .file_index = file_index,
+      .pos = (i32)match,
+      .line = line,
+      .text = result_text,
+    };
+    sb_push(index->results, result);
+    pop_context();
+  }
+  search_unlock(index);
+}
+
+// NOTE(lvl5): verifies candidate files one at a time, so results show up
+// while the rest are still being searched. when a newer query comes in the job
+// moves on to that one, so typing never queues more than thread_count of these
+void search_query_job(void *data) {
+  Editor *editor = (Editor *)data;
+  Search_Index *index = &editor->search;
+  
+  // query ids start at 1
+  i32 query_id = 0;
+  String query = {0};
+  // NOTE(lvl5): the dfa is built while matching, so every job needs its own
+  Regex regex = {0};
+  bool is_regex = false;
+  u32 *seen = null;
+  
+  while (true) {
+    search_lock(index);
+    if (index->query_id != query_id) {
+      query_id = index->query_id;
+      is_regex = index->is_regex;
+      push_system_context();
+      if (query.data) {
+        free_memory(query.data);
+      }
+      query = alloc_string(index->query.data, index->query.count);
+      regex_free(&regex);
+      if (is_regex && query.count) {
+        regex = regex_compile(query);
+      }
+      pop_context();
+    }
+    
+    bool done = index->next_candidate >= sb_count(index->candidates) ||
+      sb_count(index->results) >= SEARCH_MAX_RESULTS;
+    u32 file_index = 0;
+    Search_File *file = null;
+    if (done) {
+      // under the lock, so search_start knows whether to queue a new job
+      index->query_jobs--;
+    } else {
+      file_index = index->candidates[index->next_candidate++];
+      file = index->files[file_index];
+    }
+    search_unlock(index);
+    
+    if (done) break;
+    
+    os_File_Info info = global_os.get_file_info(file->path);
+    String text = search_read_file(file->path);
+    
+    // NOTE(lvl5): the file changed since it was indexed, fix that up while we're here
+    if (file->indexed && info.write_time != file->write_time) {
+      if (!seen) {
+        push_system_context();
+        seen = alloc_array(u32, TRIGRAM_COUNT/32);
+        pop_context();
+        zero_memory_slow(seen, TRIGRAM_COUNT/32*sizeof(u32));
+      }
+      search_index_file(index, file, text, info.write_time, seen);
+    }
+    
+    Regex_Input input = {
+      .first = text.data,
+      .first_count = (i32)text.count,
+      .second = text.data,
+      .count = (i32)text.count,
+    };
+    
+    i64 pos = 0;
+    i64 lines_counted_to = 0;
+    i32 line = 0;
+    while (pos < (i64)text.count && index->query_id == query_id) {
+      i64 match = 0;
+      i64 match_end = 0;
+      if (is_regex) {
+        i32 regex_end = 0;
+        i32 found = regex_find(&regex, &input, (i32)pos, input.count, &regex_end);
+        if (found < 0) break;
+        match = found;
+        match_end = regex_end;
+      } else {
+        i64 found = find_literal(text.data + pos, text.count - pos, query);
+        if (found < 0) break;
+        match = pos + found;
+        match_end = match + query.count;
+      }
+      
+      line += (i32)count_newlines(text.data + lines_counted_to, match - lines_counted_to);
+      lines_counted_to = match;
+      
+      search_push_result(index, query_id, file_index, text, match, line);
+      pos = match_end;
+    }
+    
+    search_free_file(text);
+    global_os.wake_main_thread();
+  }
+  
+  push_system_context();
+  free_memory(query.data);
+  regex_free(&regex);
+  if (seen) {
+    free_memory(seen);
+  }
+  pop_context();
+}
+
+// lock must be held
+void search_clear_results(Search_Index *index) {
+  push_system_context();
+  for (u32 i = 0; i < sb_count(index->results); i++) {
+    free_memory(index->results[i].text.data);
+  }
+  sb_count(index->results) = 0;
+  pop_context();
+}
+
+// NOTE(lvl5): lock must be held. a regex has no trigrams to go by,
+// every text file is a candidate
+void search_find_candidates(Search_Index *index, String query, bool is_regex) {
+  sb_count(index->candidates) = 0;
+  
+  Mem_Size mark = scratch_get_mark();
+  u32 *trigrams = scratch_push_array(u32, query.count);
+  u32 trigram_count = 0;
+  for (u64 i = 0; !is_regex && i + 3 <= query.count; i++) {
+    trigrams[trigram_count++] = get_trigram(query.data + i);
+  }
+  
+  // NOTE(lvl5): the shortest posting list is the best place to start
+  Search_Posting *shortest = null;
+  bool missing = false;
+  for (u32 i = 0; i < trigram_count; i++) {
+    Search_Posting *posting = search_get_posting(index, trigrams[i], false);
+    if (!posting) {
+      missing = true;
+    } else if (!shortest || sb_count(posting->files) < sb_count(shortest->files)) {
+      shortest = posting;
+    }
+  }
+  
+  for (u32 file_index = 0; file_index < sb_count(index->files); file_index++) {
+    Search_File *file = index->files[file_index];
+    // files that are not indexed yet can't be ruled out
+    if (!file->indexed) {
+      file->candidate_query_id = index->query_id;
+      sb_push(index->candidates, file_index);
+    }
+  }
+  
+  if (trigram_count == 0) {
+    for (u32 file_index = 0; file_index < sb_count(index->files); file_index++) {
+      Search_File *file = index->files[file_index];
+      if (file->indexed && !file->is_binary) {
+        sb_push(index->candidates, file_index);
+      }
+    }
+  } else if (!missing) {
+    for (u32 i = 0; i < sb_count(shortest->files); i++) {
+      u32 file_index = shortest->files[i];
+      Search_File *file = index->files[file_index];
+      // a file can show up twice in a posting if it was reindexed
+      if (!file->indexed || file->is_binary ||
+          file->candidate_query_id == index->query_id) continue;
+      
+      bool has_all = true;
+      for (u32 j = 0; j < trigram_count && has_all; j++) {
+        has_all = trigrams_contain(file->trigrams, file->trigram_count, trigrams[j]);
+      }
+      if (has_all) {
+        file->candidate_query_id = index->query_id;
+        sb_push(index->candidates, file_index);
+      }
+    }
+  }
+  
+  scratch_set_mark(mark);
+}
+
+// NOTE(lvl5): only call this from the main thread.
+// cancels the previous query, results stream into index->results
+void search_start(Editor *editor, String query, bool is_regex) {
+  begin_profiler_function();
+  Search_Index *index = &editor->search;
+  
+  // the jobs compile their own, this one only checks the pattern
+  bool regex_valid = true;
+  if (is_regex && query.count) {
+    push_system_context();
+    Regex regex = regex_compile(query);
+    regex_valid = regex.valid;
+    regex_free(&regex);
+    pop_context();
+  }
+  
+  search_lock(index);
+  
+  index->query_id++;
+  search_clear_results(index);
+  
+  push_system_context();
+  if (index->query.data) {
+    free_memory(index->query.data);
+  }
+  index->query = alloc_string(query.data, query.count);
+  pop_context();
+  index->is_regex = is_regex;
+  index->regex_valid = regex_valid;
+  
+  index->next_candidate = 0;
+  i32 new_jobs = 0;
+  if (query.count && regex_valid) {
+    search_find_candidates(index, index->query, is_regex);
+    // jobs that are still running pick up the new query themselves
+    new_jobs = max(global_os.thread_count, 1) - index->query_jobs;
+    index->query_jobs += new_jobs;
+  } else {
+    sb_count(index->candidates) = 0;
+  }
+  
+  search_unlock(index);
+  
+  for (i32 i = 0; i < new_jobs; i++) {
+    global_os.queue_add(global_os.thread_queue, search_query_job, editor);
+  }
+  
+  end_profiler_function();
+}
@@ -0,0 +1,73 @@
+#ifndef SEARCH_H
+#include "lvl5_types.h"
+#include "lvl5_string.h"
+#include "layout.h"
+
+#define SEARCH_MAX_RESULTS 4096
+#define SEARCH_PREVIEW_MAX 96
+
+typedef struct {
+  String path;
+  u32 index;
+  u64 write_time;
+  
+  // sorted and unique, so a file can be checked for a trigram with a binary search
+  u32 *trigrams;
+  u32 trigram_count;
+  bool indexed;
+  bool is_binary;
+  i32 candidate_query_id;
+} Search_File;
+
+typedef struct {
+  u32 trigram;
+  u32 *files;
+} Search_Posting;
+
+typedef struct {
+  i32 file_index;
+  i32 pos;
+  i32 line;
+  // "path:line: text", also the id of the result button
+  String text;
+} Search_Result;
+
+typedef struct {
+  // NOTE(lvl5): files never move or go away, workers can hold on to them
+  Search_File **files;
+  // path -> file_index + 1, 0 is empty
+  i32 *file_table;
+  u32 file_table_capacity;
+  
+  // trigram -> posting, open addressing
+  Search_Posting *postings;
+  u32 posting_capacity;
+  u32 posting_count;
+  
+  volatile long lock;
+  volatile long building;
+  volatile long next_file;
+  volatile long extract_jobs;
+  
+  // the query that is currently running, everything below is behind the lock.
+  // query_id is only written under it, jobs also poll it without it to stop early
+  String query;
+  // only the main thread writes these two
+  bool is_regex;
+  bool regex_valid;
+  volatile i32 query_id;
+  u32 *candidates;
+  u32 next_candidate;
+  Search_Result *results;
+  // queued or running search_query_jobs
+  i32 query_jobs;
+  
+  // ui
+  bool open;
+  Buffer input;
+  Buffer_View input_view;
+  V2 input_scroll;
+} Search_Index;
+
+#define SEARCH_H
+#endif
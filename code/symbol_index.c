@@ -0,0 +1,555 @@
+#include "symbol_index.h"
+
+typedef struct {
+  String name;
+  i32 pos;
+  Syntax kind;
+} Index_Build_Symbol;
+
+typedef struct {
+  String path;
+  u64 write_time;
+  u64 content_hash;
+  Index_Build_Symbol *symbols;
+} Index_Build_File;
+
+#define SYMBOL_INDEX_BUILD_ARENA_SIZE megabytes(64)
+#define SYMBOL_INDEX_PARSE_ARENA_SIZE megabytes(16)
+
+Index_File *index_get_files(Index_Header *header) {
+  Index_File *result = (Index_File *)((byte *)header + header->files_offset);
+  return result;
+}
+
+Index_Symbol *index_get_symbols(Index_Header *header) {
+  Index_Symbol *result = (Index_Symbol *)((byte *)header + header->symbols_offset);
+  return result;
+}
+
+u32 *index_get_table(Index_Header *header) {
+  u32 *result = (u32 *)((byte *)header + header->table_offset);
+  return result;
+}
+
+String index_get_string(Index_Header *header, u32 offset, u32 count) {
+  char *strings = (char *)header + header->strings_offset;
+  String result = make_string(strings + offset, count);
+  return result;
+}
+
+// NOTE(lvl5): offset and count*elem_size came from the file, so they are added up
+// in 64 bits where they can't wrap
+bool index_section_is_valid(u64 size, u32 offset, u32 count, u64 elem_size, u64 align) {
+  bool result = offset % align == 0 &&
+    (u64)offset + (u64)count*elem_size <= size;
+  return result;
+}
+
+// NOTE(lvl5): the index can be truncated or left by an older build, and everything
+// in it is used without checking later. so every offset, count and table entry
+// is checked here once, before the header is handed out
+Index_Header *index_validate(byte *data, u64 size) {
+  Index_Header *result = null;
+  Index_Header *header = (Index_Header *)data;
+  bool valid = data &&
+    size >= sizeof(Index_Header) &&
+    header->magic == SYMBOL_INDEX_MAGIC &&
+    header->version == SYMBOL_INDEX_VERSION &&
+    header->total_size == size;
+  
+  valid = valid &&
+    index_section_is_valid(size, header->files_offset, header->file_count,
+                           sizeof(Index_File), 8) &&
+    index_section_is_valid(size, header->symbols_offset, header->symbol_count,
+                           sizeof(Index_Symbol), 4) &&
+    index_section_is_valid(size, header->table_offset, header->table_capacity,
+                           sizeof(u32), 4) &&
+    index_section_is_valid(size, header->strings_offset, header->string_size, 1, 1);
+  
+  // probing has to hit an empty slot, that is checked with the entries below
+  valid = valid && (header->symbol_count == 0 ||
+                    (header->table_capacity > header->symbol_count &&
+                     (header->table_capacity & (header->table_capacity - 1)) == 0));
+  
+  if (valid) {
+    Index_File *files = index_get_files(header);
+    for (u32 i = 0; valid && i < header->file_count; i++) {
+      Index_File *file = files + i;
+      valid = (u64)file->path_offset + file->path_count <= header->string_size &&
+        (u64)file->first_symbol + file->symbol_count <= header->symbol_count;
+    }
+    
+    Index_Symbol *symbols = index_get_symbols(header);
+    for (u32 i = 0; valid && i < header->symbol_count; i++) {
+      Index_Symbol *s = symbols + i;
+      valid = (u64)s->name_offset + s->name_count <= header->string_size &&
+        s->file_index < header->file_count;
+    }
+    
+    if (header->symbol_count) {
+      u32 *table = index_get_table(header);
+      u32 empty_count = 0;
+      for (u32 i = 0; valid && i < header->table_capacity; i++) {
+        valid = table[i] <= header->symbol_count;
+        empty_count += table[i] == 0;
+      }
+      valid = valid && empty_count > 0;
+    }
+  }
+  
+  if (valid) {
+    result = header;
+  }
+  return result;
+}
+
+void symbol_index_release(Symbol_Index *index) {
+  if (index->data) {
+    if (index->is_mapped) {
+      global_os.unmap_file(index->data);
+    } else {
+      push_system_context();
+      free_memory(index->data);
+      pop_context();
+    }
+  }
+  index->data = null;
+  index->size = 0;
+  index->header = null;
+  index->is_mapped = false;
+}
+
+// NOTE(lvl5): maps the index left by the last run, so queries work
+// right away, before the rebuild has even started
+void symbol_index_init(Symbol_Index *index, String file_name) {
+  *index = (Symbol_Index){
+    .file_name = file_name,
+  };
+  
+  u64 size = 0;
+  byte *data = (byte *)global_os.map_file(file_name, &size);
+  if (data) {
+    index->data = data;
+    index->size = size;
+    index->is_mapped = true;
+    index->header = index_validate(data, size);
+    if (!index->header) {
+      symbol_index_release(index);
+    }
+  }
+}
+
+
+bool is_source_file(String path) {
+  bool result = false;
+  if (path.count > 2) {
+    String ext = substring(path, path.count - 2, path.count);
+    result = string_compare(ext, const_string(".c")) ||
+      string_compare(ext, const_string(".h"));
+  }
+  return result;
+}
+
+// NOTE(lvl5): every file under dir, recursively. the names and paths that get
+// looked at live on the scratch, only the paths that are pushed are allocated
+// with the current allocator, which can't be the scratch
+void collect_files(String dir, String **paths, bool source_only) {
+  Mem_Size mark = scratch_get_mark();
+  push_scratch_context();
+  String *names = global_os.get_file_names(dir);
+  pop_context();
+  
+  for (u32 i = 0; i < sb_count(names); i++) {
+    if (string_compare(names[i], const_string(".."))) continue;
+    
+    Mem_Size entry_mark = scratch_get_mark();
+    push_scratch_context();
+    String path = concat(concat(dir, const_string("/")), names[i]);
+    os_File_Info info = global_os.get_file_info(path);
+    pop_context();
+    
+    if (info.is_directory) {
+      collect_files(path, paths, source_only);
+    } else if (!source_only || is_source_file(path)) {
+      sb_push(*paths, alloc_string(path.data, path.count));
+    }
+    scratch_set_mark(entry_mark);
+  }
+  scratch_set_mark(mark);
+}
+
+// NOTE(lvl5): only symbols declared in the file itself,
+// the global scope also has everything pulled in by #include
+Index_Build_Symbol *symbol_index_parse_file(Editor *editor, Arena *parse_arena,
+                                            String path, String text)
+{
+  begin_profiler_function();
+  Index_Build_Symbol *result = sb_new(Index_Build_Symbol, 64);
+  
+  Buffer buffer = buffer_make_empty();
+  buffer_insert_string(&buffer, text);
+  buffer.path = path;
+  buffer.editor = editor;
+  buffer.cache.arena = *parse_arena;
+  
+  Mem_Size mark = scratch_get_mark();
+  buffer_parse(&buffer);
+  scratch_set_mark(mark);
+  
+  Token *first_token = buffer.cache.tokens;
+  Token *last_token = first_token + sb_count(buffer.cache.tokens);
+  Scope *scope = buffer.cache.scope;
+  for (u32 i = 0; i < scope->capacity; i++) {
+    Symbol *symbol = scope->values + i;
+    if (scope->occupancy[i] &&
+        symbol->token >= first_token && symbol->token < last_token)
+    {
+      Index_Build_Symbol s = {
+        .name = alloc_string(symbol->name.data, symbol->name.count),
+        .pos = symbol->token->start,
+        .kind = symbol->type,
+      };
+      sb_push(result, s);
+    }
+  }
+  
+  // NOTE(lvl5): the arena is the caller's, only the copy goes
+  buffer.cache.arena = (Arena){0};
+  buffer_free(&buffer);
+  
+  end_profiler_function();
+  return result;
+}
+
+u32 index_table_capacity(u32 count) {
+  u32 result = 16;
+  while (result < count*2) {
+    result *= 2;
+  }
+  return result;
+}
+
+byte *symbol_index_serialize(Index_Build_File *files, u64 *size) {
+  begin_profiler_function();
+  
+  u32 file_count = sb_count(files);
+  u32 symbol_count = 0;
+  u32 string_size = 0;
+  for (u32 i = 0; i < file_count; i++) {
+    Index_Build_File *file = files + i;
+    string_size += (u32)file->path.count;
+    symbol_count += sb_count(file->symbols);
+    for (u32 j = 0; j < sb_count(file->symbols); j++) {
+      string_size += (u32)file->symbols[j].name.count;
+    }
+  }
+  u32 table_capacity = index_table_capacity(symbol_count);
+  
+  Index_Header header = {
+    .magic = SYMBOL_INDEX_MAGIC,
+    .version = SYMBOL_INDEX_VERSION,
+    .file_count = file_count,
+    .symbol_count = symbol_count,
+    .table_capacity = table_capacity,
+    .string_size = string_size,
+  };
+  header.files_offset = sizeof(Index_Header);
+  header.symbols_offset = header.files_offset + file_count*sizeof(Index_File);
+  header.table_offset = header.symbols_offset + symbol_count*sizeof(Index_Symbol);
+  header.strings_offset = header.table_offset + table_capacity*sizeof(u32);
+  header.total_size = header.strings_offset + string_size;
+  
+  push_system_context();
+  byte *data = alloc_array(byte, header.total_size);
+  pop_context();
+  
+  zero_memory_slow(data, header.total_size);
+  Index_Header *result = (Index_Header *)data;
+  *result = header;
+  
+  Index_File *out_files = index_get_files(result);
+  Index_Symbol *out_symbols = index_get_symbols(result);
+  u32 *table = index_get_table(result);
+  char *strings = (char *)data + header.strings_offset;
+  
+  u32 string_offset = 0;
+  u32 symbol_index = 0;
+  for (u32 i = 0; i < file_count; i++) {
+    Index_Build_File *file = files + i;
+    out_files[i] = (Index_File){
+      .path_offset = string_offset,
+      .path_count = (u32)file->path.count,
+      .first_symbol = symbol_index,
+      .symbol_count = sb_count(file->symbols),
+      .write_time = file->write_time,
+      .content_hash = file->content_hash,
+    };
+    copy_memory_slow(strings + string_offset, file->path.data, file->path.count);
+    string_offset += (u32)file->path.count;
+    
+    for (u32 j = 0; j < sb_count(file->symbols); j++) {
+      Index_Build_Symbol *s = file->symbols + j;
+      u32 name_hash = hash_string(s->name);
+      out_symbols[symbol_index] = (Index_Symbol){
+        .name_offset = string_offset,
+        .name_count = (u32)s->name.count,
+        .name_hash = name_hash,
+        .file_index = i,
+        .pos = s->pos,
+        .kind = s->kind,
+      };
+      copy_memory_slow(strings + string_offset, s->name.data, s->name.count);
+      string_offset += (u32)s->name.count;
+      
+      u32 slot = name_hash & (table_capacity - 1);
+      while (table[slot]) {
+        slot = (slot + 1) & (table_capacity - 1);
+      }
+      table[slot] = symbol_index + 1;
+      
+      symbol_index++;
+    }
+  }
+  
+  *size = header.total_size;
+  end_profiler_function();
+  return data;
+}
+
+// NOTE(lvl5): runs on a worker thread. files whose write time or content hash
+// match the previous index reuse its symbols, everything else gets parsed
+void symbol_index_build(void *data) {
+  Editor *editor = (Editor *)data;
+  Symbol_Index *index = &editor->symbols;
+  
+  // the main thread only swaps the index after we publish the result,
+  // so the old one is safe to read the whole time
+  Index_Header *old = index->header;
+  
+  push_system_context();
+  Arena build_arena;
+  arena_init(&build_arena, alloc_array(byte, SYMBOL_INDEX_BUILD_ARENA_SIZE),
+             SYMBOL_INDEX_BUILD_ARENA_SIZE);
+  Arena parse_arena;
+  arena_init(&parse_arena, alloc_array(byte, SYMBOL_INDEX_PARSE_ARENA_SIZE),
+             SYMBOL_INDEX_PARSE_ARENA_SIZE);
+  pop_context();
+  
+  push_arena_context(&build_arena);
+  
+  u32 old_table_capacity = 0;
+  u32 *old_table = null;
+  if (old) {
+    old_table_capacity = index_table_capacity(old->file_count);
+    old_table = alloc_array(u32, old_table_capacity);
+    zero_memory_slow(old_table, old_table_capacity*sizeof(u32));
+    
+    Index_File *old_files = index_get_files(old);
+    for (u32 i = 0; i < old->file_count; i++) {
+      String path = index_get_string(old, old_files[i].path_offset,
+                                     old_files[i].path_count);
+      u32 slot = hash_string(path) & (old_table_capacity - 1);
+      while (old_table[slot]) {
+        slot = (slot + 1) & (old_table_capacity - 1);
+      }
+      old_table[slot] = i + 1;
+    }
+  }
+  
+  String *paths = sb_new(String, 256);
+  collect_files(editor->path, &paths, true);
+  
+  Index_Build_File *files = sb_new(Index_Build_File, sb_count(paths));
+  for (u32 path_index = 0; path_index < sb_count(paths); path_index++) {
+    Mem_Size mark = scratch_get_mark();
+    String path = paths[path_index];
+    os_File_Info info = global_os.get_file_info(path);
+    
+    Index_File *old_file = null;
+    if (old) {
+      u32 slot = hash_string(path) & (old_table_capacity - 1);
+      while (old_table[slot]) {
+        Index_File *candidate = index_get_files(old) + old_table[slot] - 1;
+        String candidate_path = index_get_string(old, candidate->path_offset,
+                                                 candidate->path_count);
+        if (string_compare(candidate_path, path)) {
+          old_file = candidate;
+          break;
+        }
+        slot = (slot + 1) & (old_table_capacity - 1);
+      }
+    }
+    
+    Index_Build_File file = {
+      .path = path,
+      .write_time = info.write_time,
+    };
+    
+    bool reuse = old_file && old_file->write_time == info.write_time;
+    if (!reuse) {
+      os_File handle = global_os.open_file(path);
+      u64 file_size = global_os.get_file_size(handle);
+      push_system_context();
+      char *text = alloc_array(char, file_size);
+      pop_context();
+      global_os.read_file(handle, text, 0, file_size);
+      global_os.close_file(handle);
+      
+      file.content_hash = hash_bytes_64(text, file_size);
+      // NOTE(lvl5): touched, but not changed
+      reuse = old_file && old_file->content_hash == file.content_hash;
+      
+      if (!reuse) {
+        String str = make_string(text, file_size);
+        file.symbols = symbol_index_parse_file(editor, &parse_arena, path, str);
+      }
+      
+      push_system_context();
+      free_memory(text);
+      pop_context();
+    }
+    
+    if (reuse) {
+      file.content_hash = old_file->content_hash;
+      file.symbols = sb_new(Index_Build_Symbol, old_file->symbol_count + 1);
+      Index_Symbol *old_symbols = index_get_symbols(old) + old_file->first_symbol;
+      for (u32 i = 0; i < old_file->symbol_count; i++) {
+        Index_Symbol *s = old_symbols + i;
+        String name = index_get_string(old, s->name_offset, s->name_count);
+        Index_Build_Symbol symbol = {
+          .name = alloc_string(name.data, name.count),
+          .pos = s->pos,
+          .kind = s->kind,
+        };
+        sb_push(file.symbols, symbol);
+      }
+    }
+    
+    sb_push(files, file);
+    scratch_set_mark(mark);
+  }
+  
+  u64 size = 0;
+  byte *result = symbol_index_serialize(files, &size);
+  
+  pop_context();
+  
+  push_system_context();
+  free_memory(build_arena.data);
+  free_memory(parse_arena.data);
+  pop_context();
+  
+  index->pending_size = size;
+  _InterlockedExchangePointer((void *volatile *)&index->pending, result);
+  global_os.wake_main_thread();
+}
+
+// NOTE(lvl5): only call this from the main thread. files that didn't change
+// keep their symbols, so this is cheap after saving one file
+void symbol_index_rebuild(Editor *editor) {
+  Symbol_Index *index = &editor->symbols;
+  if (_InterlockedCompareExchange(&index->building, true, false) == false) {
+    global_os.queue_add(global_os.thread_queue, symbol_index_build, editor);
+  } else {
+    index->rebuild_pending = true;
+  }
+}
+
+// NOTE(lvl5): call once a frame on the main thread.
+// the index file is written here and not on the worker, because it can't be
+// overwritten while the old one is still mapped
+void symbol_index_poll(Editor *editor) {
+  Symbol_Index *index = &editor->symbols;
+  byte *pending = index->pending;
+  if (pending) {
+    index->pending = null;
+    symbol_index_release(index);
+    
+    index->data = pending;
+    index->size = index->pending_size;
+    index->header = (Index_Header *)pending;
+    global_os.write_entire_file(index->file_name, index->data, index->size);
+    
+    index->building = false;
+    if (index->rebuild_pending) {
+      index->rebuild_pending = false;
+      symbol_index_rebuild(editor);
+    }
+  }
+}
+
+// NOTE(lvl5): the returned strings point into the index,
+// don't hold on to them across symbol_index_poll
+Symbol_Location *symbol_index_find(Symbol_Index *index, String name) {
+  begin_profiler_function();
+  Symbol_Location *result = sb_new(Symbol_Location, 4);
+  
+  Index_Header *header = index->header;
+  if (header && header->symbol_count) {
+    Index_File *files = index_get_files(header);
+    Index_Symbol *symbols = index_get_symbols(header);
+    u32 *table = index_get_table(header);
+    u32 name_hash = hash_string(name);
+    
+    u32 slot = name_hash & (header->table_capacity - 1);
+    while (table[slot]) {
+      Index_Symbol *s = symbols + table[slot] - 1;
+      if (s->name_hash == name_hash) {
+        String symbol_name = index_get_string(header, s->name_offset, s->name_count);
+        if (string_compare(symbol_name, name)) {
+          Index_File *file = files + s->file_index;
+          Symbol_Location location = {
+            .path = index_get_string(header, file->path_offset, file->path_count),
+            .name = symbol_name,
+            .pos = s->pos,
+            .kind = s->kind,
+          };
+          sb_push(result, location);
+        }
+      }
+      slot = (slot + 1) & (header->table_capacity - 1);
+    }
+  }
+  
+  end_profiler_function();
+  return result;
+}
+
+// NOTE(lvl5): workspace symbol search, every symbol starting with prefix.
+// it scans instead of using the name table, because that is keyed by the hash of
+// the whole name, which says nothing about the names that share a prefix
+Symbol_Location *symbol_index_search(Symbol_Index *index, String prefix,
+                                     i32 max_count)
+{
+  begin_profiler_function();
+  Symbol_Location *result = sb_new(Symbol_Location, 16);
+  
+  Index_Header *header = index->header;
+  if (header) {
+    Index_File *files = index_get_files(header);
+    Index_Symbol *symbols = index_get_symbols(header);
+    
+    for (u32 i = 0;
+         i < header->symbol_count && (i32)sb_count(result) < max_count;
+         i++)
+    {
+      Index_Symbol *s = symbols + i;
+      if (s->name_count >= prefix.count) {
+        String symbol_name = index_get_string(header, s->name_offset, s->name_count);
+        if (string_compare(substring(symbol_name, 0, prefix.count), prefix)) {
+          Index_File *file = files + s->file_index;
+          Symbol_Location location = {
+            .path = index_get_string(header, file->path_offset, file->path_count),
+            .name = symbol_name,
+            .pos = s->pos,
+            .kind = s->kind,
+          };
+          sb_push(result, location);
+        }
+      }
+    }
+  }
+  
+  end_profiler_function();
+  return result;
+}
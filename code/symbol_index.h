@@ -0,0 +1,75 @@
+#ifndef SYMBOL_INDEX_H
+#include "lvl5_types.h"
+#include "lvl5_string.h"
+#include "parser.h"
+
+// NOTE(lvl5): the index file is used directly from a memory mapping,
+// so everything in it is offsets and fixed size structs.
+// layout: header, files, symbols, name table, strings
+#define SYMBOL_INDEX_MAGIC 0x58444E49
+#define SYMBOL_INDEX_VERSION 1
+
+typedef struct {
+  u32 magic;
+  u32 version;
+  u32 total_size;
+  u32 file_count;
+  u32 symbol_count;
+  u32 table_capacity;
+  u32 string_size;
+  
+  u32 files_offset;
+  u32 symbols_offset;
+  u32 table_offset;
+  u32 strings_offset;
+  u32 padding;
+} Index_Header;
+
+typedef struct {
+  u32 path_offset;
+  u32 path_count;
+  u32 first_symbol;
+  u32 symbol_count;
+  
+  // a file is only reparsed if both of these changed
+  u64 write_time;
+  u64 content_hash;
+} Index_File;
+
+typedef struct {
+  u32 name_offset;
+  u32 name_count;
+  u32 name_hash;
+  u32 file_index;
+  i32 pos;
+  Syntax kind;
+  u8 padding[3];
+} Index_Symbol;
+
+typedef struct {
+  String path;
+  String name;
+  i32 pos;
+  Syntax kind;
+} Symbol_Location;
+
+typedef struct {
+  String file_name;
+  
+  // NOTE(lvl5): either a mapping of the index file, or the result of the last
+  // rebuild. only ever touched on the main thread
+  byte *data;
+  u64 size;
+  bool is_mapped;
+  Index_Header *header;
+  
+  // set by the worker when a rebuild is done, picked up by symbol_index_poll
+  byte *volatile pending;
+  u64 pending_size;
+  volatile long building;
+  // asked for while a rebuild was running, so it missed the change
+  bool rebuild_pending;
+} Symbol_Index;
+
+#define SYMBOL_INDEX_H
+#endif
@@ -3,16 +3,19 @@
 #version 330 core
 layout(location = 0) in vec2 position;
 layout(location = 1) in vec4 tex;
-layout(location = 2) in mat4x4 model;
-layout(location = 6) in vec4 color;
+layout(location = 2) in vec2 offset;
+layout(location = 3) in vec2 size;
+layout(location = 4) in vec4 color;
+
+uniform mat4x4 view;
+uniform mat4x4 model;
 
 out vec2 tex_coord;
 out vec4 fr_color;
 
 
 void main() {
-  mat4x4 u_model = transpose(model);
-  gl_Position = u_model*vec4(position, 0.0f, 1.0f);
+  gl_Position = view*model*vec4(offset + position*size, 0.0f, 1.0f);
   
   fr_color = vec4(color.z, color.y, color.x, color.w)/255.0f;
   tex_coord = tex.xy + position.xy*tex.zw;